@@ -0,0 +1,99 @@
+// Streaming differentiation: one expression, or one "left = right" equation for dy/dx,
+// per input line; one result per output line, in input order.
+// Build: g++ -std=c++17 -O2 -pthread -o batch_diff batch_diff.cpp
+// Usage: batch_diff [--threads N] [--batch LINES] [--trace FILE] [--trace-min NODES] [file]
+//        (reads stdin without a file; --trace writes a Chrome trace of the spans over
+//        trees of at least NODES nodes, 64 by default)
+#include "node_arena.cpp"
+#include "expression_writer.cpp"
+#include "chain_rule.cpp"
+#include "poly_kernel.cpp"
+#include "rational.cpp"
+#include "polynomials_and_exponential_functions.cpp"
+#include "trigonometric_functions.cpp"
+#include "inverse_trigonometric_functions.cpp"
+#include "implicit_differentiation.cpp"
+#include "expression_store.cpp"
+#include "memo.cpp"
+#include "exp_stats.cpp"
+#include "exp_trace.cpp"
+#include "compiled_expression.cpp"
+#include "multivariable.cpp"
+#include "simd_math.cpp"
+#include "parallel_evaluator.cpp"
+#include "gradient_tape.cpp"
+#include "taylor_tape.cpp"
+#include "expression_parser.cpp"
+#include "mapped_file.cpp"
+#include "diff_pipeline.cpp"
+#include "expression_utils.hpp"
+
+#ifndef BATCH_DIFF_CPP
+#define BATCH_DIFF_CPP
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+static int usage() {
+    cerr << "usage: batch_diff [--threads N] [--batch LINES] [--trace FILE] [--trace-min NODES] [file]" << endl;
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    PipelineOptions options;
+    const char* path = nullptr;
+    const char* tracePath = nullptr;
+    TraceOptions trace;
+    for (int i = 1; i < argc; ++i) {
+        if ((strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "--batch") == 0) && i + 1 < argc) {
+            long value = strtol(argv[i + 1], nullptr, 10);
+            if (value <= 0) return usage();
+            (argv[i][2] == 't' ? options.threads : options.batchLines) = static_cast<size_t>(value);
+            ++i;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--trace-min") == 0 && i + 1 < argc) {
+            long value = strtol(argv[++i], nullptr, 10);
+            if (value <= 0) return usage();
+            trace.minTreeSize = static_cast<size_t>(value);
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            return usage();
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            return usage();
+        }
+    }
+
+    ios::sync_with_stdio(false);
+    if (tracePath) startTrace(trace);
+    PipelineStats stats;
+    if (path) {
+        MappedFile file;
+        if (!file.open(path)) {
+            cerr << "batch_diff: " << file.error() << endl;
+            return 1;
+        }
+        stats = differentiateText(file.text(), cout, options);
+    } else {
+        stats = differentiateStream(stdin, cout, options);
+    }
+
+    cerr << stats.expressions << " expressions (" << stats.errors << " errors) in " << stats.seconds << " s: "
+         << (stats.seconds > 0 ? stats.expressions / stats.seconds : 0.0) << " expressions/s, latency p50 "
+         << stats.p50Us << " us, p99 " << stats.p99Us << " us" << endl;
+    if (tracePath) {
+        stopTrace();
+        string error;
+        if (!saveChromeTrace(tracePath, &error)) {
+            cerr << "batch_diff: " << error << endl;
+            return 1;
+        }
+        cerr << traceEvents() << " spans traced (" << traceDropped() << " dropped) to " << tracePath << endl;
+    }
+    return 0;
+}
+
+#endif
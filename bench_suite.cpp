@@ -0,0 +1,435 @@
+// Regression benchmark suite: synthetic workloads of adjustable size, each timed through
+// derivative(), simplify(), evaluate() and toString(), with node and heap allocation
+// counts. Results go to JSON; a stored run can be passed back in as the baseline.
+// Build: g++ -std=c++17 -O2 -pthread -o bench_suite bench_suite.cpp
+// Usage: bench_suite [--scale S] [--repeats N] [--filter TEXT] [--json FILE]
+//                    [--baseline FILE] [--threshold F] [--alloc-threshold F] [--stats FILE]
+// --stats writes the run's per-kind timings and rule counts, which are only collected
+// when built with -DCALCULUS_STATS.
+#include "node_arena.cpp"
+#include "expression_writer.cpp"
+#include "chain_rule.cpp"
+#include "poly_kernel.cpp"
+#include "rational.cpp"
+#include "polynomials_and_exponential_functions.cpp"
+#include "trigonometric_functions.cpp"
+#include "inverse_trigonometric_functions.cpp"
+#include "implicit_differentiation.cpp"
+#include "expression_store.cpp"
+#include "memo.cpp"
+#include "exp_stats.cpp"
+#include "exp_trace.cpp"
+#include "compiled_expression.cpp"
+#include "multivariable.cpp"
+#include "simd_math.cpp"
+#include "parallel_evaluator.cpp"
+#include "gradient_tape.cpp"
+#include "taylor_tape.cpp"
+#include "expression_utils.hpp"
+
+#ifndef BENCH_SUITE_CPP
+#define BENCH_SUITE_CPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+// Every heap allocation in the process goes through here, so an operation's count is
+// the difference across it. Nodes come from the heap too: the suite runs without a
+// NodeArena, and NodeArena::allocate falls through to operator new.
+static size_t heapAllocations = 0;
+static size_t heapBytes = 0;
+
+// noinline keeps GCC from pairing the malloc and free across inlined call sites.
+__attribute__((noinline)) void* operator new(size_t bytes) {
+    ++heapAllocations;
+    heapBytes += bytes;
+    if (void* p = malloc(bytes ? bytes : 1)) return p;
+    throw bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+struct Options {
+    double scale = 1.0;
+    int repeats = 5;
+    string filter;
+    string jsonPath;
+    string baselinePath;
+    string statsPath;
+    double threshold = 0.10;      // allowed slowdown of the median, as a fraction
+    double allocThreshold = 0.05; // allowed growth of the allocation count
+    double noiseMs = 0.05;        // differences below this never count as regressions
+};
+
+struct Result {
+    string workload;
+    int size = 0;
+    string op;
+    double medianMs = 0;
+    double minMs = 0;
+    size_t nodesIn = 0;  // distinct nodes of what the operation reads
+    size_t nodesOut = 0; // distinct nodes of what it returns; characters for toString
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+    string name() const {
+        return workload + "/" + to_string(size) + "/" + op;
+    }
+};
+
+// A workload hands simplify() its input and times its own derivative, which is one
+// derivative() for most, n of them in a row for nth_derivative, and the implicit dy/dx
+// for the equations. evaluate() and toString() run on what derive returns.
+struct Workload {
+    string name;
+    int size;
+    shared_ptr<Exp> input;
+    function<shared_ptr<Exp>()> derive;
+};
+
+template <class F>
+static void forEachChild(const Exp& e, F f) {
+    switch (e.kind()) {
+        case ExpKind::AddSub: f(*static_cast<const AddSub&>(e).left); f(*static_cast<const AddSub&>(e).right); break;
+        case ExpKind::Multiply: f(*static_cast<const Multiply&>(e).left); f(*static_cast<const Multiply&>(e).right); break;
+        case ExpKind::Divide: f(*static_cast<const Divide&>(e).left); f(*static_cast<const Divide&>(e).right); break;
+        case ExpKind::ChainRule: f(*static_cast<const ChainRule&>(e).outer); f(*static_cast<const ChainRule&>(e).inner); break;
+        case ExpKind::SineComposed: f(*static_cast<const SineComposed&>(e).arg); break;
+        case ExpKind::CosineComposed: f(*static_cast<const CosineComposed&>(e).arg); break;
+        case ExpKind::PowerComposed: f(*static_cast<const PowerComposed&>(e).arg); break;
+        case ExpKind::ExponentialComposed: f(*static_cast<const ExponentialComposed&>(e).arg); break;
+        case ExpKind::Sqrt: f(*static_cast<const Sqrt&>(e).arg); break;
+        default: break;
+    }
+}
+
+static size_t countNodes(const Exp& root) {
+    unordered_set<const Exp*> seen;
+    vector<const Exp*> stack{&root};
+    while (!stack.empty()) {
+        const Exp* e = stack.back();
+        stack.pop_back();
+        if (!seen.insert(e).second) continue;
+        forEachChild(*e, [&](const Exp& child) { stack.push_back(&child); });
+    }
+    return seen.size();
+}
+
+// One of x, sin(x), e^x, cos(x), x^2, arctan(x), picked by i.
+static shared_ptr<Exp> factor(int i) {
+    switch (i % 6) {
+        case 0: return make_shared<VariableX>();
+        case 1: return make_shared<Sine>();
+        case 2: return make_shared<Exponential>(1.0);
+        case 3: return make_shared<Cosine>();
+        case 4: return make_shared<Power>(2.0);
+        default: return make_shared<ArcTangent>();
+    }
+}
+
+// f1*f2*...*fn, left-deep.
+static shared_ptr<Exp> multiplyChain(int n) {
+    shared_ptr<Exp> acc = factor(0);
+    for (int i = 1; i < n; ++i) acc = make_shared<Multiply>(acc, factor(i));
+    return acc;
+}
+
+// k*x^(k mod 5 + 1) and sin(k*x) terms, alternately added and subtracted.
+static shared_ptr<Exp> addSubSum(int n) {
+    shared_ptr<Exp> acc;
+    for (int k = 1; k <= n; ++k) {
+        shared_ptr<Exp> term;
+        if (k % 2) {
+            term = make_shared<Multiply>(make_shared<Constant>(k), make_shared<Power>(k % 5 + 1));
+        } else {
+            term = make_shared<SineComposed>(make_shared<Multiply>(make_shared<Constant>(k), make_shared<VariableX>()));
+        }
+        acc = acc ? make_shared<AddSub>(acc, term, k % 3 ? '+' : '-') : term;
+    }
+    return acc;
+}
+
+// sin((sin(x + x)^3 + x))... : SineComposed and PowerComposed, one level at a time.
+static shared_ptr<Exp> nestedComposition(int depth) {
+    shared_ptr<Exp> acc = make_shared<VariableX>();
+    for (int i = 0; i < depth; ++i) {
+        if (i % 2 == 0) {
+            acc = make_shared<SineComposed>(make_shared<AddSub>(acc, make_shared<VariableX>(), '+'));
+        } else {
+            acc = make_shared<PowerComposed>(acc, 3.0);
+        }
+    }
+    return acc;
+}
+
+// sum over k = 1..n of y^k*sin(k*x) = x*y + cos(y)
+static shared_ptr<ImplicitEquation> implicitSum(int n) {
+    shared_ptr<Exp> left;
+    for (int k = 1; k <= n; ++k) {
+        shared_ptr<Exp> term = make_shared<Multiply>(
+            make_shared<PowerComposed>(make_shared<VariableY>(), static_cast<double>(k)),
+            make_shared<SineComposed>(make_shared<Multiply>(make_shared<Constant>(k), make_shared<VariableX>())));
+        left = left ? make_shared<AddSub>(left, term, '+') : term;
+    }
+    shared_ptr<Exp> right = make_shared<AddSub>(make_shared<Multiply>(make_shared<VariableX>(), make_shared<VariableY>()),
+                                                make_shared<CosineComposed>(make_shared<VariableY>()), '+');
+    return make_shared<ImplicitEquation>(left, right);
+}
+
+static vector<Workload> workloads(double scale) {
+    auto sized = [&](int base) { return max(1, static_cast<int>(base * scale + 0.5)); };
+    vector<Workload> out;
+
+    int n = sized(40);
+    shared_ptr<Exp> chain = multiplyChain(n);
+    out.push_back({"multiply_chain", n, chain, [chain] { return shareNode(chain->derivative()); }});
+
+    n = sized(400);
+    shared_ptr<Exp> sum = addSubSum(n);
+    out.push_back({"addsub_sum", n, sum, [sum] { return shareNode(sum->derivative()); }});
+
+    n = sized(16);
+    shared_ptr<Exp> nested = nestedComposition(n);
+    out.push_back({"nested_composition", n, nested, [nested] { return shareNode(nested->derivative()); }});
+
+    n = sized(5);
+    shared_ptr<Exp> f = make_shared<Multiply>(make_shared<SineComposed>(make_shared<Power>(2.0)),
+                                              make_shared<ExponentialComposed>(make_shared<Cosine>()));
+    out.push_back({"nth_derivative", n, f, [f, n] {
+        shared_ptr<Exp> d = f;
+        for (int k = 0; k < n; ++k) d = shareNode(d->derivative());
+        return d;
+    }});
+
+    n = sized(12);
+    shared_ptr<ImplicitEquation> eq = implicitSum(n);
+    shared_ptr<Exp> difference = make_shared<AddSub>(eq->left, eq->right, '-');
+    out.push_back({"implicit", n, difference, [eq] { return shareNode(eq->derivative()); }});
+    return out;
+}
+
+template <class F>
+static Result measure(const Workload& w, const string& op, int repeats, F body) {
+    Result r;
+    r.workload = w.name;
+    r.size = w.size;
+    r.op = op;
+    vector<double> times;
+    for (int i = 0; i <= repeats; ++i) {
+        size_t allocationsBefore = heapAllocations, bytesBefore = heapBytes;
+        auto start = chrono::steady_clock::now();
+        body();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        // The first run warms up and supplies the counts, which do not vary between runs.
+        if (i == 0) {
+            r.allocations = heapAllocations - allocationsBefore;
+            r.bytes = heapBytes - bytesBefore;
+        } else {
+            times.push_back(ms);
+        }
+    }
+    sort(times.begin(), times.end());
+    r.medianMs = times[times.size() / 2];
+    r.minMs = times.front();
+    return r;
+}
+
+static vector<Result> runWorkload(const Workload& w, const Options& options) {
+    const int points = 1000;
+    vector<Result> out;
+    shared_ptr<Exp> d;
+
+    Result derive = measure(w, "derivative", options.repeats, [&] { d = w.derive(); });
+    derive.nodesIn = countNodes(*w.input);
+    derive.nodesOut = countNodes(*d);
+    out.push_back(derive);
+
+    dExp simplified;
+    Result simplify = measure(w, "simplify", options.repeats, [&] { simplified = w.input->simplify(); });
+    simplify.nodesIn = derive.nodesIn;
+    simplify.nodesOut = countNodes(*simplified);
+    out.push_back(simplify);
+
+    double sink = 0;
+    Result evaluate = measure(w, "evaluate", options.repeats, [&] {
+        for (int i = 0; i < points; ++i) sink += d->evaluate(-2.0 + 4.0 * i / points);
+    });
+    evaluate.nodesIn = derive.nodesOut;
+    evaluate.nodesOut = points;
+    out.push_back(evaluate);
+
+    string text;
+    Result print = measure(w, "toString", options.repeats, [&] { text = d->toString(); });
+    print.nodesIn = derive.nodesOut;
+    print.nodesOut = text.size() + (sink == 0.5 ? 1 : 0);
+    out.push_back(print);
+    return out;
+}
+
+static void writeJson(ostream& os, const vector<Result>& results, const Options& options) {
+    os << "{\n  \"suite\": \"differentiation\",\n  \"version\": 1,\n  \"scale\": " << options.scale
+       << ",\n  \"repeats\": " << options.repeats << ",\n  \"results\": [\n";
+    os << setprecision(6);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        os << "    {\"name\": \"" << r.name() << "\", \"workload\": \"" << r.workload << "\", \"size\": " << r.size
+           << ", \"op\": \"" << r.op << "\", \"median_ms\": " << r.medianMs << ", \"min_ms\": " << r.minMs
+           << ", \"nodes_in\": " << r.nodesIn << ", \"nodes_out\": " << r.nodesOut
+           << ", \"allocations\": " << r.allocations << ", \"bytes\": " << r.bytes << "}"
+           << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+// Reads back what writeJson produces, one result object per line; only the fields the
+// comparison uses are picked out.
+static string jsonField(const string& line, const string& key) {
+    string quoted = "\"" + key + "\": ";
+    size_t at = line.find(quoted);
+    if (at == string::npos) return "";
+    at += quoted.size();
+    if (line[at] == '"') {
+        size_t end = line.find('"', at + 1);
+        return line.substr(at + 1, end - at - 1);
+    }
+    size_t end = line.find_first_of(",}", at);
+    return line.substr(at, end - at);
+}
+
+static bool readBaseline(const string& path, map<string, Result>& baseline) {
+    ifstream in(path);
+    if (!in) return false;
+    string line;
+    while (getline(in, line)) {
+        string name = jsonField(line, "name");
+        if (name.empty()) continue;
+        Result r;
+        r.medianMs = atof(jsonField(line, "median_ms").c_str());
+        r.allocations = strtoull(jsonField(line, "allocations").c_str(), nullptr, 10);
+        baseline[name] = r;
+    }
+    return true;
+}
+
+// Prints a line per result that has a baseline and returns how many regressed.
+static int compare(const vector<Result>& results, const map<string, Result>& baseline, const Options& options) {
+    int regressions = 0;
+    cout << "\n" << left << setw(36) << "vs baseline" << right << setw(12) << "base ms" << setw(12) << "ms"
+         << setw(9) << "change" << setw(12) << "allocs" << "\n";
+    for (const Result& r : results) {
+        auto it = baseline.find(r.name());
+        if (it == baseline.end()) {
+            cout << left << setw(36) << r.name() << right << "  (new)\n";
+            continue;
+        }
+        const Result& b = it->second;
+        double change = b.medianMs > 0 ? r.medianMs / b.medianMs - 1.0 : 0.0;
+        bool slower = change > options.threshold && r.medianMs - b.medianMs > options.noiseMs;
+        bool moreAllocations = r.allocations > b.allocations * (1.0 + options.allocThreshold);
+        cout << left << setw(36) << r.name() << right << fixed << setprecision(3) << setw(12) << b.medianMs
+             << setw(12) << r.medianMs << setw(8) << setprecision(1) << change * 100 << "%" << setw(12)
+             << static_cast<long long>(r.allocations) - static_cast<long long>(b.allocations)
+             << (slower ? "  SLOWER" : "") << (moreAllocations ? "  MORE ALLOCATIONS" : "") << "\n";
+        cout.unsetf(ios::fixed);
+        regressions += slower || moreAllocations;
+    }
+    return regressions;
+}
+
+static int usage() {
+    cerr << "usage: bench_suite [--scale S] [--repeats N] [--filter TEXT] [--json FILE]\n"
+            "                   [--baseline FILE] [--threshold F] [--alloc-threshold F] [--stats FILE]" << endl;
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) return usage();
+        const char* value = argv[++i];
+        if (arg == "--scale") {
+            options.scale = atof(value);
+        } else if (arg == "--repeats") {
+            options.repeats = atoi(value);
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--json") {
+            options.jsonPath = value;
+        } else if (arg == "--baseline") {
+            options.baselinePath = value;
+        } else if (arg == "--threshold") {
+            options.threshold = atof(value);
+        } else if (arg == "--alloc-threshold") {
+            options.allocThreshold = atof(value);
+        } else if (arg == "--stats") {
+            options.statsPath = value;
+        } else {
+            return usage();
+        }
+    }
+    if (options.scale <= 0 || options.repeats <= 0) return usage();
+
+    map<string, Result> baseline;
+    if (!options.baselinePath.empty() && !readBaseline(options.baselinePath, baseline)) {
+        cerr << options.baselinePath << ": cannot read the baseline" << endl;
+        return 2;
+    }
+
+    vector<Result> results;
+    cout << left << setw(36) << "benchmark" << right << setw(12) << "median ms" << setw(12) << "min ms"
+         << setw(10) << "nodes in" << setw(10) << "out" << setw(12) << "allocs" << "\n";
+    for (const Workload& w : workloads(options.scale)) {
+        if (!options.filter.empty() && w.name.find(options.filter) == string::npos) continue;
+        for (const Result& r : runWorkload(w, options)) {
+            cout << left << setw(36) << r.name() << right << fixed << setprecision(3) << setw(12) << r.medianMs
+                 << setw(12) << r.minMs << setw(10) << r.nodesIn << setw(10) << r.nodesOut << setw(12)
+                 << r.allocations << "\n";
+            cout.unsetf(ios::fixed);
+            results.push_back(r);
+        }
+    }
+
+    if (!options.jsonPath.empty()) {
+        ofstream out(options.jsonPath);
+        writeJson(out, results, options);
+        if (!out) {
+            cerr << options.jsonPath << ": cannot write the results" << endl;
+            return 2;
+        }
+    }
+    if (!options.statsPath.empty()) {
+        ofstream out(options.statsPath);
+        expStats().writeJson(out);
+        if (!out) {
+            cerr << options.statsPath << ": cannot write the stats" << endl;
+            return 2;
+        }
+    }
+    if (!options.baselinePath.empty()) {
+        int regressions = compare(results, baseline, options);
+        cout << setprecision(6) << regressions << " regression" << (regressions == 1 ? "" : "s") << " beyond "
+             << options.threshold * 100 << "% time / " << options.allocThreshold * 100 << "% allocations" << endl;
+        return regressions ? 1 : 0;
+    }
+    return 0;
+}
+
+#endif
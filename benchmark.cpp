@@ -0,0 +1,1158 @@
+// Benchmarks for the differentiation engine.
+// Build: g++ -std=c++17 -O2 -pthread -o benchmark benchmark.cpp -ldl
+#include "node_arena.cpp"
+#include "expression_writer.cpp"
+#include "chain_rule.cpp"
+#include "poly_kernel.cpp"
+#include "rational.cpp"
+#include "polynomials_and_exponential_functions.cpp"
+#include "trigonometric_functions.cpp"
+#include "inverse_trigonometric_functions.cpp"
+#include "implicit_differentiation.cpp"
+#include "expression_store.cpp"
+#include "memo.cpp"
+#include "exp_stats.cpp"
+#include "exp_trace.cpp"
+#include "compiled_expression.cpp"
+#include "multivariable.cpp"
+#include "simd_math.cpp"
+#include "parallel_evaluator.cpp"
+#include "gradient_tape.cpp"
+#include "taylor_tape.cpp"
+#include "expression_parser.cpp"
+#include "mapped_file.cpp"
+#include "expression_archive.cpp"
+#include "native_jit.cpp"
+#include "expression_utils.hpp"
+
+#ifndef BENCHMARK_CPP
+#define BENCHMARK_CPP
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+template <class F>
+static double timeMs(F&& body) {
+    auto start = chrono::steady_clock::now();
+    body();
+    auto stop = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(stop - start).count();
+}
+
+// sin(x + y) = y^2*cos(x), the example from main.cpp
+static ImplicitEquation implicitExample() {
+    return ImplicitEquation(
+        make_unique<SineComposed>(
+            make_unique<AddSub>(make_shared<VariableX>(), make_shared<VariableY>(), '+')
+        ),
+        make_unique<Multiply>(
+            make_unique<PowerComposed>(make_shared<VariableY>(), 2.0),
+            make_unique<CosineComposed>(make_shared<VariableX>())
+        )
+    );
+}
+
+// The same equation with y replaced by x^2, so every point evaluates to a number:
+// sin(x + x^2) - x^2*cos(x)
+static shared_ptr<Exp> explicitExample() {
+    return make_shared<AddSub>(
+        make_shared<SineComposed>(
+            make_shared<AddSub>(make_shared<VariableX>(), make_shared<Power>(2.0), '+')
+        ),
+        make_shared<Multiply>(make_shared<Power>(2.0), make_shared<CosineComposed>(make_shared<VariableX>())),
+        '-'
+    );
+}
+
+static bool sameValue(double a, double b) {
+    return (std::isnan(a) && std::isnan(b)) || a == b;
+}
+
+static void benchCompiledEvaluate(const string& name, const Exp& expr, int points) {
+    CompiledExp tape = compile(expr);
+    double sink = 0;
+    double treeMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) sink += expr.evaluate(-2.0 + 4.0 * i / points);
+    });
+    double tapeMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) sink += tape.evaluate(-2.0 + 4.0 * i / points);
+    });
+    vector<double> xs(points), ys(points);
+    for (int i = 0; i < points; ++i) xs[i] = -2.0 + 4.0 * i / points;
+    double blockMs = timeMs([&] { tape.evaluate(xs.data(), ys.data(), xs.size()); });
+
+    vector<double> treeBatch(points);
+    expr.evaluate(xs.data(), treeBatch.data(), xs.size());
+    int mismatches = 0;
+    for (int i = 0; i < points; i += points / 1000) {
+        if (!sameValue(expr.evaluate(xs[i]), tape.evaluate(xs[i]))) ++mismatches;
+        if (!sameValue(treeBatch[i], ys[i])) ++mismatches;
+    }
+    cout << name << ": " << tape.size() << " instrs, tree " << treeMs << " ms, tape "
+         << tapeMs << " ms (" << treeMs / tapeMs << "x), tape blocks " << blockMs << " ms ("
+         << treeMs / blockMs << "x), mismatches " << mismatches << (sink == 0.5 ? " " : "") << endl;
+}
+
+// f and its first derivatives through generated C against the tape they were emitted
+// from; the second run of compileNative() should come from the disk cache.
+static void benchNative(const string& name, const shared_ptr<Exp>& f, size_t derivatives, int points) {
+    JitOptions options;
+    options.useCache = false;
+    NativeExp native;
+    double buildMs = timeMs([&] { native = compileNative(f, derivatives, options); });
+    options.useCache = true;
+    NativeExp again;
+    double cachedMs = timeMs([&] { again = compileNative(f, derivatives); });
+    if (!native.isNative()) {
+        cout << name << ": no native code (" << native.error() << "), falling back to evaluate()" << endl;
+        return;
+    }
+    cout << name << ": compiled in " << buildMs << " ms, reloaded in " << cachedMs << " ms"
+         << (again.fromCache() ? " from the cache" : " (cache missed)") << endl;
+
+    vector<double> xs(points), ys(points);
+    for (int i = 0; i < points; ++i) xs[i] = -2.0 + 4.0 * i / points;
+    for (size_t k = 0; k < native.orders(); ++k) {
+        CompiledExp tape = compile(*native.expression(k));
+        NativeExp::Function fn = native.function(k);
+        double sink = 0;
+        double tapeMs = timeMs([&] {
+            for (int i = 0; i < points; ++i) sink += tape.evaluate(xs[i]);
+        });
+        double nativeMs = timeMs([&] {
+            for (int i = 0; i < points; ++i) sink += fn(xs[i]);
+        });
+        double blockMs = timeMs([&] { tape.evaluate(xs.data(), ys.data(), xs.size()); });
+        double batchMs = timeMs([&] { native.evaluate(xs.data(), ys.data(), xs.size(), k); });
+        int mismatches = 0;
+        for (int i = 0; i < points; i += points / 1000) {
+            if (!sameValue(tape.evaluate(xs[i]), fn(xs[i]))) ++mismatches;
+            if (!sameValue(tape.evaluate(xs[i]), ys[i])) ++mismatches;
+        }
+        cout << "  f^(" << k << "): " << tape.size() << " instrs, tape " << tapeMs << " ms, native " << nativeMs
+             << " ms (" << tapeMs / nativeMs << "x), tape blocks " << blockMs << " ms, native batch " << batchMs
+             << " ms (" << blockMs / batchMs << "x), mismatches " << mismatches << (sink == 0.5 ? " " : "") << endl;
+    }
+
+    JitOptions missing;
+    missing.compiler = "/nonexistent/cc";
+    NativeExp fallback = compileNative(f, 0, missing);
+    cout << "  without a compiler: " << (fallback.isNative() ? "native" : fallback.error()) << ", f(0.5) = "
+         << fallback.evaluate(0.5) << " vs " << f->evaluate(0.5) << endl;
+}
+
+static void benchBatchEvaluate(const string& name, const Exp& expr, int points) {
+    vector<double> xs(points), scalar(points), batch(points);
+    for (int i = 0; i < points; ++i) xs[i] = -2.0 + 4.0 * i / points;
+    double scalarMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) scalar[i] = expr.evaluate(xs[i]);
+    });
+    double batchMs = timeMs([&] { expr.evaluate(xs.data(), batch.data(), xs.size()); });
+
+    // Accuracy against the scalar path, relative to max(|f|, 1).
+    double maxErr = 0;
+    for (int i = 0; i < points; ++i) {
+        if (std::isnan(scalar[i]) && std::isnan(batch[i])) continue;
+        maxErr = max(maxErr, fabs(batch[i] - scalar[i]) / max(fabs(scalar[i]), 1.0));
+    }
+    cout << name << ": scalar " << scalarMs << " ms, batch " << batchMs << " ms ("
+         << scalarMs / batchMs << "x), max rel error " << maxErr << endl;
+}
+
+// Distance in ulps between two results; NaN against NaN is 0, and a zero against a zero
+// of the other sign, or a NaN or infinity against anything else, counts as a mismatch.
+static double ulpDistance(double a, double b, size_t& mismatches) {
+    if (std::isnan(a) || std::isnan(b) || std::isinf(a) || std::isinf(b) || (a == 0 && b == 0)) {
+        bool same = std::isnan(a) ? std::isnan(b) : a == b && std::signbit(a) == std::signbit(b);
+        mismatches += !same;
+        return 0;
+    }
+    // Bit patterns in the order of the values they encode.
+    auto ordered = [](double v) {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof bits);
+        return bits >> 63 ? ~bits : bits | (uint64_t(1) << 63);
+    };
+    uint64_t x = ordered(a), y = ordered(b);
+    return static_cast<double>(x > y ? x - y : y - x);
+}
+
+// The AVX2 kernels against scalar evaluate() on the same node: signed zeros in every
+// lane position through sin and cos, and pow for every integer exponent up to 64.
+static void checkBatchKernels() {
+    vector<double> xs;
+    for (int i = 0; i < 64; ++i) xs.push_back(-8.0 + 16.0 * i / 64);
+    for (int i = 0; i < 8; ++i) xs.insert(xs.begin() + 9 * i, i % 2 ? -0.0 : 0.0);
+    xs.push_back(-0.0);
+    vector<double> batch(xs.size());
+    double trigUlps = 0;
+    size_t trigMismatches = 0;
+    for (const shared_ptr<Exp>& f : {shared_ptr<Exp>(make_shared<Sine>()), shared_ptr<Exp>(make_shared<Cosine>())}) {
+        f->evaluate(xs.data(), batch.data(), xs.size());
+        for (size_t i = 0; i < xs.size(); ++i) trigUlps = max(trigUlps, ulpDistance(batch[i], f->evaluate(xs[i]), trigMismatches));
+    }
+
+    vector<double> bases = {0.0, -0.0, HUGE_VAL, -HUGE_VAL, 1.0, -1.0};
+    for (int i = 0; i <= 60; ++i) {
+        bases.push_back(0.5 + 1.5 * i / 60);
+        bases.push_back(-0.5 - 1.5 * i / 60);
+    }
+    batch.resize(bases.size());
+    double powUlps = 0;
+    size_t powMismatches = 0;
+    for (int k = -64; k <= 64; ++k) {
+        Power f(static_cast<double>(k));
+        f.evaluate(bases.data(), batch.data(), bases.size());
+        for (size_t i = 0; i < bases.size(); ++i) powUlps = max(powUlps, ulpDistance(batch[i], f.evaluate(bases[i]), powMismatches));
+    }
+    cout << "sin/cos with signed zeros: max " << trigUlps << " ulp, " << trigMismatches
+         << " mismatches; x^n for |n| <= 64: max " << powUlps << " ulp, " << powMismatches << " mismatches" << endl;
+}
+
+// Tape with and without common subexpression merging, scalar and blocked.
+static void benchCse(const string& name, const Exp& expr, int points) {
+    CompileStats stats;
+    CompiledExp plain = compile(expr, false);
+    CompiledExp merged = compile(expr, true, &stats);
+    vector<double> xs(points), plainOut(points), mergedOut(points);
+    for (int i = 0; i < points; ++i) xs[i] = -2.0 + 4.0 * i / points;
+
+    double sink = 0;
+    double plainMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) sink += plain.evaluate(xs[i]);
+    });
+    double mergedMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) sink += merged.evaluate(xs[i]);
+    });
+    double plainBlockMs = timeMs([&] { plain.evaluate(xs.data(), plainOut.data(), xs.size()); });
+    double mergedBlockMs = timeMs([&] { merged.evaluate(xs.data(), mergedOut.data(), xs.size()); });
+
+    int mismatches = 0;
+    for (int i = 0; i < points; ++i) {
+        if (!sameValue(plainOut[i], mergedOut[i])) ++mismatches;
+    }
+    cout << name << ": " << stats.merged << " of " << stats.lowered << " nodes merged, "
+         << plain.size() << " -> " << merged.size() << " instrs, scalar " << plainMs << " -> "
+         << mergedMs << " ms (" << plainMs / mergedMs << "x), blocks " << plainBlockMs << " -> "
+         << mergedBlockMs << " ms (" << plainBlockMs / mergedBlockMs << "x), mismatches "
+         << mismatches << (sink == 0.5 ? " " : "") << endl;
+}
+
+// Forward-mode f'(x) against building derivative() once and evaluating it.
+static void benchDual(const string& name, const shared_ptr<Exp>& f, int points) {
+    shared_ptr<Exp> df;
+    double sink = 0;
+    double symbolicMs = timeMs([&] {
+        df = f->derivative();
+        for (int i = 0; i < points; ++i) sink += df->evaluate(-2.0 + 4.0 * i / points);
+    });
+    double evalMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) sink += f->evaluate(-2.0 + 4.0 * i / points);
+    });
+    double dualMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) sink += f->evaluateWithDerivative(-2.0 + 4.0 * i / points).deriv;
+    });
+
+    double maxErr = 0;
+    int nanMismatches = 0;
+    for (int i = 0; i < points; i += points / 1000) {
+        double x = -2.0 + 4.0 * i / points;
+        double a = df->evaluate(x);
+        double b = f->evaluateWithDerivative(x).deriv;
+        if (std::isnan(a) || std::isnan(b)) {
+            if (std::isnan(a) != std::isnan(b)) ++nanMismatches;
+            continue;
+        }
+        maxErr = max(maxErr, fabs(a - b) / max(fabs(a), 1.0));
+    }
+    cout << name << ": symbolic " << symbolicMs << " ms, dual " << dualMs << " ms ("
+         << symbolicMs / dualMs << "x, " << dualMs / evalMs << "x one evaluate), max rel error "
+         << maxErr << ", nan mismatches " << nanMismatches << (sink == 0.5 ? " " : "") << endl;
+}
+
+// One node of every class: arctan(x)*sec(x) + sqrt(e^x)/(2 + arcsin(x/2)) - csc(x^3)^2 ...
+static shared_ptr<Exp> everyClassExample() {
+    auto x = make_shared<VariableX>();
+    shared_ptr<Exp> trig = make_shared<AddSub>(
+        make_shared<Multiply>(make_shared<ArcTangent>(), make_shared<Secant>()),
+        make_shared<Multiply>(make_shared<Tangent>(), make_shared<Cotangent>()),
+        '+'
+    );
+    shared_ptr<Exp> inverse = make_shared<AddSub>(
+        make_shared<ChainRule>(make_shared<ArcSine>(), make_shared<Multiply>(make_shared<Constant>(0.25), x)),
+        make_shared<ChainRule>(make_shared<ArcCosine>(), make_shared<Multiply>(make_shared<Constant>(0.25), x)),
+        '-'
+    );
+    shared_ptr<Exp> reciprocal = make_shared<AddSub>(
+        make_shared<ChainRule>(make_shared<ArcSecant>(), make_shared<AddSub>(make_shared<Power>(2.0), make_shared<Constant>(2.0), '+')),
+        make_shared<AddSub>(
+            make_shared<ChainRule>(make_shared<ArcCosecant>(), make_shared<AddSub>(make_shared<Power>(2.0), make_shared<Constant>(2.0), '+')),
+            make_shared<ArcCotangent>(),
+            '+'
+        ),
+        '+'
+    );
+    shared_ptr<Exp> composed = make_shared<Divide>(
+        make_shared<Multiply>(make_shared<Sqrt>(make_shared<Exponential>(1.0)), make_shared<ExponentialComposed>(make_shared<SineComposed>(x))),
+        make_shared<AddSub>(
+            make_shared<PowerComposed>(make_shared<CosineComposed>(make_shared<Power>(3.0)), 2.0),
+            make_shared<Multiply>(make_shared<Cosecant>(), make_shared<Multiply>(make_shared<Sine>(), make_shared<Cosine>())),
+            '+'
+        )
+    );
+    return make_shared<AddSub>(make_shared<AddSub>(trig, inverse, '+'), make_shared<AddSub>(reciprocal, composed, '+'), '+');
+}
+
+// Reverse-mode partials of F(x, y) = left - right for the implicit example, checked by
+// forming dy/dx = -F_x/F_y and comparing with the symbolic dy/dx compiled and bound
+// at the same (x, y).
+static void benchGradient(int points) {
+    ImplicitEquation eq = implicitExample();
+    AddSub F(eq.left, eq.right, '-');
+    GradientTape tape(F);
+    CompiledExp value = compile(F);
+    CompiledExp dydx = compile(*eq.derivative());
+
+    vector<double> in(tape.inputs(), 0.0), grad(tape.inputs());
+    double sink = 0;
+    double evalMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) {
+            in[CompiledExp::xReg] = -2.0 + 4.0 * i / points;
+            in[CompiledExp::yReg] = 0.5 + 0.25 * in[CompiledExp::xReg];
+            sink += value.evaluate(in.data());
+        }
+    });
+    double gradMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) {
+            in[CompiledExp::xReg] = -2.0 + 4.0 * i / points;
+            in[CompiledExp::yReg] = 0.5 + 0.25 * in[CompiledExp::xReg];
+            sink += tape.gradient(in.data(), grad.data());
+        }
+    });
+
+    double maxErr = 0;
+    for (int i = 0; i < points; i += points / 1000) {
+        in[CompiledExp::xReg] = -2.0 + 4.0 * i / points;
+        in[CompiledExp::yReg] = 0.5 + 0.25 * in[CompiledExp::xReg];
+        tape.gradient(in.data(), grad.data());
+        double reverse = -grad[CompiledExp::xReg] / grad[CompiledExp::yReg];
+        double symbolic = dydx.evaluate(in.data());
+        maxErr = max(maxErr, fabs(reverse - symbolic) / max(fabs(symbolic), 1.0));
+    }
+    cout << "F(x, y): evaluate " << evalMs << " ms, value + gradient " << gradMs << " ms ("
+         << gradMs / evalMs << "x), -F_x/F_y vs symbolic dy/dx max rel error " << maxErr
+         << (sink == 0.5 ? " " : "") << endl;
+}
+
+// f^(k)(x0) from Taylor arithmetic against k symbolic derivative() passes.
+static void benchTaylor(const string& name, const shared_ptr<Exp>& f, double x0, int symbolicOrder, int taylorOrder) {
+    vector<double> symbolic;
+    double symbolicMs = timeMs([&] {
+        MemoSession session;
+        shared_ptr<Exp> d = f;
+        symbolic.push_back(d->evaluate(x0));
+        for (int k = 1; k <= symbolicOrder; ++k) {
+            d = session.derivative(d);
+            symbolic.push_back(d->evaluate(x0));
+        }
+    });
+    TaylorTape taylor(*f);
+    vector<double> derivs;
+    double lowMs = timeMs([&] { derivs = taylor.derivatives(x0, symbolicOrder); });
+    double maxErr = 0;
+    for (int k = 0; k <= symbolicOrder; ++k) {
+        maxErr = max(maxErr, fabs(derivs[k] - symbolic[k]) / max(fabs(symbolic[k]), 1.0));
+    }
+    double highMs = timeMs([&] { derivs = taylor.derivatives(x0, taylorOrder); });
+    cout << name << ": symbolic to order " << symbolicOrder << " " << symbolicMs << " ms, taylor "
+         << lowMs << " ms (" << symbolicMs / lowMs << "x), max rel error " << maxErr
+         << "; taylor to order " << taylorOrder << " " << highMs << " ms, f^(" << taylorOrder
+         << ") = " << derivs[taylorOrder] << endl;
+}
+
+// Random trees mixing every composite class, for simplify()/derivative() timing.
+static shared_ptr<Exp> generatedTree(int depth, uint32_t& seed) {
+    auto next = [&](uint32_t range) {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) % range;
+    };
+    if (depth == 0) {
+        switch (next(7)) {
+            case 0: return make_shared<VariableX>();
+            case 1: return make_shared<Constant>(static_cast<double>(next(5) + 1));
+            case 2: return make_shared<Sine>();
+            case 3: return make_shared<Cosine>();
+            case 4: return make_shared<Tangent>();
+            case 5: return make_shared<Power>(static_cast<double>(next(3) + 2));
+            default: return make_shared<Exponential>(static_cast<double>(next(3) + 1));
+        }
+    }
+    switch (next(8)) {
+        case 0:
+        case 1: return make_shared<Multiply>(generatedTree(depth - 1, seed), generatedTree(depth - 1, seed));
+        case 2: return make_shared<AddSub>(generatedTree(depth - 1, seed), generatedTree(depth - 1, seed), '+');
+        case 3: return make_shared<AddSub>(generatedTree(depth - 1, seed), generatedTree(depth - 1, seed), '-');
+        case 4: return make_shared<Divide>(generatedTree(depth - 1, seed), generatedTree(depth - 1, seed));
+        case 5: return make_shared<SineComposed>(generatedTree(depth - 1, seed));
+        case 6: return make_shared<PowerComposed>(generatedTree(depth - 1, seed), 2.0);
+        default: return make_shared<ExponentialComposed>(generatedTree(depth - 1, seed));
+    }
+}
+
+static void benchGeneratedSimplify(int depth, int trees) {
+    vector<shared_ptr<Exp>> forest;
+    uint32_t seed = 12345;
+    for (int i = 0; i < trees; ++i) forest.push_back(generatedTree(depth, seed));
+    size_t sink = 0;
+    double simplifyMs = timeMs([&] {
+        for (const auto& t : forest) sink += t->simplify()->toString().size();
+    });
+    double derivativeMs = timeMs([&] {
+        for (const auto& t : forest) sink += t->derivative()->toString().size();
+    });
+    cout << "depth " << depth << ", " << trees << " trees: simplify + print " << simplifyMs
+         << " ms, derivative + print " << derivativeMs << " ms (" << sink << " chars)" << endl;
+}
+
+// Nodes visited per top-level simplify() with and without the already-simplified
+// shortcut. The derivative chain re-simplifies its own output at every order.
+static void benchSimplifyVisits(const string& name, const vector<shared_ptr<Exp>>& work, int rounds) {
+    for (bool shortcut : {false, true}) {
+        setSimplifiedShortcut(shortcut);
+        SimplifyCounters& c = simplifyCounters();
+        c = SimplifyCounters();
+        size_t sink = 0;
+        double ms = timeMs([&] {
+            for (int r = 0; r < rounds; ++r) {
+                for (const auto& e : work) {
+                    dExp once = e->simplify();
+                    sink += once->simplify()->toString().size();
+                }
+            }
+        });
+        size_t calls = 2 * work.size() * rounds;
+        cout << name << (shortcut ? ", marked:   " : ", unmarked: ") << ms << " ms, "
+             << static_cast<double>(c.visits) / calls << " visits and "
+             << static_cast<double>(c.skips) / calls << " skips per simplify (" << sink << " chars)" << endl;
+    }
+    setSimplifiedShortcut(true);
+}
+
+// The map<int, double> product that Poly replaced, kept as the reference.
+static map<int, double> mapPolyMul(const map<int, double>& a, const map<int, double>& b) {
+    map<int, double> out;
+    for (const auto& ka : a) {
+        for (const auto& kb : b) out[ka.first + kb.first] += ka.second * kb.second;
+    }
+    return out;
+}
+
+// terms coefficients at degrees 0, stride, 2 * stride, ...; integral ones when whole is set.
+static map<int, double> randomPolyTerms(int terms, int stride, bool whole, uint32_t& seed) {
+    map<int, double> out;
+    for (int i = 0; i < terms; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        double c = static_cast<double>((seed >> 8) % 19) - 9.0;
+        if (!whole) c += 0.125 * static_cast<double>((seed >> 4) % 7) + 0.1;
+        if (c != 0.0) out[i * stride] = c;
+    }
+    return out;
+}
+
+static Poly toKernelPoly(const map<int, double>& terms) {
+    Poly p;
+    for (const auto& kv : terms) p = polyAdd(p, Poly::monomial(kv.first, kv.second), 1.0);
+    return p;
+}
+
+static void benchPolyMul(const string& name, int terms, int stride, bool whole) {
+    uint32_t seed = 4242;
+    auto a = randomPolyTerms(terms, stride, whole, seed);
+    auto b = randomPolyTerms(terms, stride, whole, seed);
+    Poly pa = toKernelPoly(a), pb = toKernelPoly(b);
+    map<int, double> reference;
+    Poly product;
+    int reps = 5;
+    double mapMs = timeMs([&] {
+        for (int r = 0; r < reps; ++r) reference = mapPolyMul(a, b);
+    });
+    double kernelMs = timeMs([&] {
+        for (int r = 0; r < reps; ++r) product = polyMul(pa, pb);
+    });
+    bool identical = true;
+    size_t nonZero = 0;
+    for (size_t i = 0; i < product.size(); ++i) {
+        double c = product.coefficientAt(i);
+        if (c == 0.0) continue;
+        ++nonZero;
+        auto it = reference.find(product.degreeAt(i));
+        identical = identical && it != reference.end() && it->second == c;
+    }
+    for (const auto& kv : reference) nonZero -= kv.second != 0.0;
+    identical = identical && nonZero == 0;
+    cout << name << ": map " << mapMs / reps << " ms, " << (product.dense() ? "dense" : "sparse")
+         << " kernel " << kernelMs / reps << " ms (" << mapMs / kernelMs << "x), coefficients "
+         << (identical ? "identical" : "DIFFER") << endl;
+}
+
+// simplify() on (sum a_k x^k) * (sum b_k x^k) + 0, which expands through toPoly.
+static void benchPolySimplify(int terms) {
+    uint32_t seed = 99;
+    auto sumOf = [](const map<int, double>& t) {
+        shared_ptr<Exp> acc;
+        for (const auto& kv : t) {
+            shared_ptr<Exp> term = makeNode<Multiply>(makeNode<Constant>(kv.second), makeNode<Power>(kv.first));
+            acc = acc ? makeNode<AddSub>(acc, term, '+') : term;
+        }
+        return acc;
+    };
+    auto product = makeNode<Multiply>(sumOf(randomPolyTerms(terms, 1, true, seed)),
+                                      sumOf(randomPolyTerms(terms, 1, true, seed)));
+    auto expr = makeNode<AddSub>(product, makeNode<Constant>(0), '+');
+    size_t chars = 0;
+    double ms = timeMs([&] { chars = expr->simplify()->toString().size(); });
+    cout << "expanded product of two degree-" << terms - 1 << " polynomials: simplify + print "
+         << ms << " ms (" << chars << " chars)" << endl;
+}
+
+// A degree-(terms - 1) polynomial as a Polynomial node and as the AddSub/Multiply/Power
+// chain polyToExpr used to return: evaluate, and f' through f^(4) with printing.
+static void benchPolynomialNode(int terms, int points) {
+    uint32_t seed = 31;
+    Poly p = toKernelPoly(randomPolyTerms(terms, 1, false, seed));
+    shared_ptr<Exp> node = makeNode<Polynomial>(p);
+    shared_ptr<Exp> tree = shareNode(polyToExpr(p));
+    double sink = 0;
+    double treeEvalMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) sink += tree->evaluate(-1.0 + 2.0 * i / points);
+    });
+    double nodeEvalMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) sink += node->evaluate(-1.0 + 2.0 * i / points);
+    });
+    double treeDiffMs = timeMs([&] {
+        for (int k = 0; k < 4; ++k) tree = shareNode(tree->derivative());
+    });
+    double nodeDiffMs = timeMs([&] {
+        for (int k = 0; k < 4; ++k) node = shareNode(node->derivative());
+    });
+    bool identical = tree->toString() == node->toString();
+    cout << "degree " << terms - 1 << ": evaluate tree " << treeEvalMs << " ms, node " << nodeEvalMs << " ms ("
+         << treeEvalMs / nodeEvalMs << "x); f' .. f^(4) tree " << treeDiffMs << " ms, node " << nodeDiffMs
+         << " ms (" << treeDiffMs / nodeDiffMs << "x), printed " << (identical ? "identical" : "DIFFER")
+         << " (" << sink << ")" << endl;
+}
+
+// The k-th derivative of x^(1/3) carries the coefficient (1/3)(-2/3)...(1/3 - k + 1),
+// whose denominator 3^k leaves 64 bits at k = 40.
+static void benchRationalPowers(int order) {
+    size_t before = Rational::promotions();
+    shared_ptr<Exp> f = makeNode<Power>(1, 3);
+    double ms = timeMs([&] {
+        for (int k = 0; k < order; ++k) f = shareNode(f->derivative());
+    });
+    string text = f->toString();
+    cout << "x^(1/3) through f^(" << order << "): " << ms << " ms, " << Rational::promotions() - before
+         << " promotions, result " << text.size() << " chars" << endl;
+}
+
+// Inline arithmetic on small fractions, next to the unchecked long long arithmetic
+// with normaliseFraction that Constant used before. None of these leave 64 bits.
+static void benchRationalSmall(int ops) {
+    long long an = 1, ad = 7;
+    double uncheckedMs = timeMs([&] {
+        for (int i = 1; i <= ops; ++i) {
+            long long bn = i % 5 + 1, bd = i % 3 + 2, cn = 1, cd = i % 7 + 1;
+            normaliseFraction(bn, bd);
+            normaliseFraction(cn, cd);
+            long long mn = an * bn, md = ad * bd;
+            normaliseFraction(mn, md);
+            an = mn * cd + cn * md;
+            ad = md * cd;
+            normaliseFraction(an, ad);
+            if (ad > 1000000) an = 1, ad = 7;
+        }
+    });
+    Rational acc(1, 7);
+    size_t before = Rational::promotions();
+    double ms = timeMs([&] {
+        for (int i = 1; i <= ops; ++i) {
+            acc = acc * Rational(i % 5 + 1, i % 3 + 2) + Rational(1, i % 7 + 1);
+            if (!acc.isSmall() || acc.den() > 1000000) acc = Rational(1, 7);
+        }
+    });
+    cout << "small fractions: unchecked " << uncheckedMs * 1e6 / ops << " ns, Rational " << ms * 1e6 / ops
+         << " ns per multiply-add, " << Rational::promotions() - before << " promotions, results "
+         << (acc == Rational(an, ad) ? "identical" : "DIFFER") << endl;
+}
+
+// Parse throughput on printed text: generated trees, their simplified forms and
+// derivatives, plus the implicit equation from main.cpp. The parsed trees are kept
+// until the round ends, so releasing them is timed on its own. Round trips count the
+// expressions whose reparse prints back to the same text.
+static void benchParse(int trees, int rounds) {
+    vector<string> corpus;
+    uint32_t seed = 2024;
+    for (int i = 0; i < trees; ++i) {
+        shared_ptr<Exp> t = generatedTree(6, seed);
+        corpus.push_back(t->toString());
+        corpus.push_back(t->simplify()->toString());
+        corpus.push_back(t->derivative()->toString());
+    }
+    size_t bytes = 0;
+    for (const auto& s : corpus) bytes += s.size();
+
+    ExpParser parser;
+    size_t failures = 0, roundTrips = 0;
+    for (const auto& s : corpus) {
+        shared_ptr<Exp> e = parser.parse(s);
+        failures += e == nullptr;
+        roundTrips += e && e->toString() == s;
+    }
+    double parseMs = 0, releaseMs = 0;
+    size_t nodes = 0;
+    {
+        NodeArena arena;
+        vector<shared_ptr<Exp>> parsed(corpus.size());
+        for (int r = 0; r < rounds; ++r) {
+            parseMs += timeMs([&] {
+                for (size_t i = 0; i < corpus.size(); ++i) parsed[i] = parser.parse(corpus[i]);
+            });
+            releaseMs += timeMs([&] {
+                for (auto& e : parsed) e.reset();
+            });
+        }
+        nodes = arena.allocations();
+    }
+    double total = static_cast<double>(bytes) * rounds;
+    cout << corpus.size() << " expressions (" << bytes / 1024 << " KiB) x " << rounds << ": parse " << parseMs
+         << " ms, " << total / parseMs / 1e3 << " MB/s, " << corpus.size() * rounds / parseMs * 1e3
+         << " expressions/s, " << parseMs * 1e6 / nodes << " ns per node; release " << releaseMs << " ms" << endl;
+    cout << "failures " << failures << ", round trips " << roundTrips << "/" << corpus.size() << endl;
+
+    const string equation = "sin(x + y) = y^2*cos(x)";
+    int equations = 200000;
+    size_t ok = 0;
+    double equationMs = timeMs([&] {
+        NodeArena arena;
+        for (int i = 0; i < equations; ++i) ok += parser.parseEquation(equation) != nullptr;
+    });
+    cout << "\"" << equation << "\" x " << equations << ": " << equationMs << " ms, "
+         << equation.size() * equations / equationMs / 1e3 << " MB/s, " << ok << " parsed" << endl;
+}
+
+// Caching derivatives on disk as printed text (written, read back and parsed) against
+// a binary archive (saved, mapped and rebuilt), and evaluating straight off the mapped
+// node table against the rebuilt trees.
+static void benchArchive(int trees, int points) {
+    vector<shared_ptr<Exp>> work;
+    uint32_t seed = 4242;
+    for (int i = 0; i < trees; ++i) {
+        shared_ptr<Exp> d = shareNode(generatedTree(6, seed)->derivative());
+        work.push_back(d);
+        work.push_back(shareNode(d->derivative()));
+    }
+    const string textPath = "/tmp/benchmark_archive.txt";
+    const string binaryPath = "/tmp/benchmark_archive.bin";
+
+    size_t textBytes = 0, textSame = 0;
+    double textMs = timeMs([&] {
+        ExpWriter out;
+        for (const auto& e : work) out << *e << '\n';
+        string text = out.take();
+        textBytes = text.size();
+        ofstream(textPath, ios::binary) << text;
+        MappedFile file;
+        file.open(textPath);
+        string_view rest = file.text();
+        ExpParser parser;
+        for (const auto& e : work) {
+            size_t end = rest.find('\n');
+            shared_ptr<Exp> back = parser.parse(rest.substr(0, end));
+            rest.remove_prefix(end + 1);
+            textSame += back && back->toString() == e->toString();
+        }
+    });
+
+    size_t binaryBytes = 0, nodes = 0, binarySame = 0;
+    ExpArchive archive;
+    double saveMs = timeMs([&] {
+        ExpArchiveWriter writer;
+        for (const auto& e : work) writer.add(e);
+        writer.save(binaryPath);
+        nodes = writer.nodes();
+    });
+    vector<shared_ptr<Exp>> loaded(work.size());
+    double loadMs = timeMs([&] {
+        archive.open(binaryPath);
+        for (size_t i = 0; i < work.size(); ++i) loaded[i] = archive.root(i);
+    });
+    {
+        MappedFile file;
+        file.open(binaryPath);
+        binaryBytes = file.size();
+    }
+    for (size_t i = 0; i < work.size(); ++i) binarySame += loaded[i]->toString() == work[i]->toString();
+    cout << work.size() << " derivatives: text " << textBytes / 1024 << " KiB, write + parse " << textMs
+         << " ms, round trips " << textSame << "; archive " << binaryBytes / 1024 << " KiB (" << nodes
+         << " nodes), save " << saveMs << " ms, map + rebuild " << loadMs << " ms, round trips " << binarySame << endl;
+
+    vector<double> xs(points), fromTable(points), fromTree(points);
+    for (int i = 0; i < points; ++i) xs[i] = -3.0 + 6.0 * i / points;
+    size_t mismatches = 0;
+    double tableMs = 0, treeMs = 0;
+    for (size_t i = 0; i < work.size(); i += 50) {
+        tableMs += timeMs([&] { archive.evaluate(i, xs.data(), fromTable.data(), points); });
+        treeMs += timeMs([&] {
+            for (int k = 0; k < points; ++k) fromTree[k] = loaded[i]->evaluate(xs[k]);
+        });
+        for (int k = 0; k < points; ++k) mismatches += !sameValue(fromTable[k], fromTree[k]);
+    }
+    cout << "evaluate " << (work.size() + 49) / 50 << " roots x " << points << " points: from the table " << tableMs
+         << " ms, rebuilt tree " << treeMs << " ms, mismatches " << mismatches << endl;
+    remove(textPath.c_str());
+    remove(binaryPath.c_str());
+}
+
+// Printing large results next to the differentiation that produced them. write()
+// streams to /dev/null through the writer's 64 KB buffer instead of one string.
+static void benchPrint(const string& name, const shared_ptr<Exp>& f) {
+    shared_ptr<Exp> d;
+    double diffMs = timeMs([&] { d = shareNode(f->derivative()); });
+    string text;
+    double printMs = timeMs([&] { text = d->toString(); });
+    ofstream devnull("/dev/null");
+    double streamMs = timeMs([&] { d->write(devnull); });
+    cout << name << ": derivative " << diffMs << " ms, toString " << printMs << " ms, write " << streamMs
+         << " ms (" << text.size() << " chars)" << endl;
+}
+
+// sin(...sin(sin(x) + x)... + x), depth levels deep.
+static shared_ptr<Exp> deepChain(int depth) {
+    shared_ptr<Exp> f = makeNode<VariableX>();
+    for (int i = 0; i < depth; ++i) {
+        f = makeNode<AddSub>(makeNode<SineComposed>(f), makeNode<VariableX>(), '+');
+    }
+    return f;
+}
+
+// f^(order) built twice as plain trees, then twice with an ExpStore bound, so
+// derivative() and simplify() intern what they build. The store keeps one node per
+// distinct subtree, and the two interned copies come out as the same node, so comparing
+// them is a pointer compare instead of a walk.
+static void benchInternedDerivatives(const string& name, const shared_ptr<Exp>& f, int order) {
+    auto build = [&] {
+        shared_ptr<Exp> d = f;
+        for (int k = 0; k < order; ++k) d = shareNode(d->derivative());
+        return d;
+    };
+    // One untimed interned build first: after a section that frees millions of nodes,
+    // the first larger blocks malloc hands out (the store's bucket arrays) pay for
+    // sorting them, which would be charged to the interned build alone.
+    {
+        ExpStore warm;
+        InternScope scope(&warm);
+        warm.intern(build());
+    }
+    shared_ptr<Exp> first, second;
+    double plainMs = timeMs([&] {
+        first = build();
+        second = build();
+    });
+    bool same = false;
+    double walkMs = timeMs([&] { same = sameExp(*first, *second); });
+
+    ExpStore store;
+    shared_ptr<Exp> a, b;
+    double internedMs = timeMs([&] {
+        InternScope scope(&store);
+        a = store.intern(build());
+        b = store.intern(build());
+    });
+    bool interned = false;
+    double pointerMs = timeMs([&] { interned = sameExp(*a, *b); });
+    bool sameText = a->toString() == first->toString();
+    cout << name << " f^(" << order << "): " << treeSize(*first) << " tree nodes, " << store.size()
+         << " nodes in the store; build both plain " << plainMs << " ms, interned " << internedMs << " ms, sameExp walk "
+         << walkMs << " ms, interned " << pointerMs << " ms ("
+         << (same && interned && a == b && sameText ? "equal" : "MISMATCH") << ")" << endl;
+}
+
+static long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// A long-running worker: many short differentiation sessions over generated trees,
+// each result kept only until the next session. Runs in a child process so peak RSS
+// is its own.
+static void benchArenaWorker(bool arena, int sessions) {
+    cout.flush();
+    pid_t pid = fork();
+    if (pid != 0) {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+    long rssBefore = peakRssKb();
+    size_t sink = 0;
+    size_t allocations = 0;
+    double ms = timeMs([&] {
+        uint32_t seed = 777;
+        shared_ptr<Exp> kept;
+        for (int s = 0; s < sessions; ++s) {
+            unique_ptr<NodeArena> scope(arena ? new NodeArena() : nullptr);
+            MemoSession memo;
+            for (int t = 0; t < 8; ++t) {
+                shared_ptr<Exp> f = generatedTree(7, seed);
+                shared_ptr<Exp> d2 = memo.derivative(memo.derivative(f));
+                sink += d2->toString().size();
+                kept = d2;
+            }
+            if (scope) allocations += scope->allocations();
+        }
+    });
+    cout << (arena ? "arena" : "heap ") << ": " << ms << " ms, peak RSS +" << (peakRssKb() - rssBefore)
+         << " KB";
+    if (arena) cout << ", " << allocations << " arena allocations";
+    cout << " (" << sink << " chars)" << endl;
+    cout.flush();
+    _exit(0);
+}
+
+// f through f^(order) over one grid, split across pools of growing size.
+static void benchParallelGrid(const shared_ptr<Exp>& f, int order, size_t points) {
+    vector<vector<double>> reference(order + 1, vector<double>(points));
+    vector<double*> refOuts;
+    for (auto& r : reference) refOuts.push_back(r.data());
+    WorkStealingPool single(1);
+    double baseMs = timeMs([&] { evaluateWithDerivatives(single, f, order, -2.0, 2.0, points, refOuts); });
+    cout << "1 thread: " << baseMs << " ms" << endl;
+
+    size_t hardware = max<size_t>(1, thread::hardware_concurrency());
+    for (size_t threads = 2; threads <= hardware; threads *= 2) {
+        vector<vector<double>> results(order + 1, vector<double>(points));
+        vector<double*> outs;
+        for (auto& r : results) outs.push_back(r.data());
+        WorkStealingPool pool(threads);
+        double ms = timeMs([&] { evaluateWithDerivatives(pool, f, order, -2.0, 2.0, points, outs); });
+        int mismatches = 0;
+        for (int k = 0; k <= order; ++k) {
+            for (size_t i = 0; i < points; ++i) {
+                if (!sameValue(results[k][i], reference[k][i])) ++mismatches;
+            }
+        }
+        cout << threads << " threads: " << ms << " ms (" << baseMs / ms << "x), mismatches "
+             << mismatches << endl;
+    }
+}
+
+// A sum of damped oscillations a_k e^(-b_k x) sin(c_k x), with a_k, b_k, c_k as
+// x_(3k+1) .. x_(3k+3): the gradient and Hessian in the parameters built in one
+// PartialSession against each entry built on its own, and the shared MatrixTape
+// against central differences of f.
+static void benchMultivariable(int terms, int points) {
+    shared_ptr<Exp> f;
+    vector<uint32_t> params;
+    for (int k = 0; k < terms; ++k) {
+        auto a = makeVariable(3 * k + 1), b = makeVariable(3 * k + 2), c = makeVariable(3 * k + 3);
+        auto term = make_shared<Multiply>(
+            make_shared<Multiply>(a, make_shared<ExponentialComposed>(make_shared<Multiply>(
+                make_shared<Constant>(-1), make_shared<Multiply>(b, make_shared<VariableX>())))),
+            make_shared<SineComposed>(make_shared<Multiply>(c, make_shared<VariableX>())));
+        f = f ? make_shared<AddSub>(f, term, '+') : shared_ptr<Exp>(term);
+        for (uint32_t v = 1; v <= 3; ++v) params.push_back(3 * k + v);
+    }
+    const size_t n = params.size();
+
+    ExpMatrix g, h;
+    size_t hits = 0;
+    double sharedMs = timeMs([&] {
+        PartialSession session;
+        g = gradient(f, params);
+        h = hessian(f, params);
+        hits = session.partialHits();
+    });
+    size_t separateNodes = 0;
+    double separateMs = timeMs([&] {
+        for (size_t i = 0; i < n; ++i) {
+            shared_ptr<Exp> gi = shareNode(f->derivative(params[i]));
+            separateNodes += treeSize(*gi);
+            for (size_t j = 0; j < n; ++j) separateNodes += treeSize(*gi->derivative(params[j]));
+        }
+    });
+    MatrixTape gradTape(g), hessTape(h);
+    size_t separateInstrs = 0;
+    for (const auto& e : h.entries) separateInstrs += compile(*e.value).size();
+
+    CompiledExp value = compile(*f);
+    vector<double> out(n * n), gv(n);
+    Environment env(vector<double>(n + 1, 0.0));
+    double sink = 0;
+    auto point = [&](int i) {
+        env[0] = -1.0 + 2.0 * i / points;
+        for (size_t v = 1; v <= n; ++v) env[v] = 0.5 + 0.1 * static_cast<double>((v * 7 + i) % 11);
+    };
+    double tapeMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) {
+            point(i);
+            gradTape.evaluate(env, gv.data());
+            hessTape.evaluate(env, out.data());
+            sink += gv[0] + out[0];
+        }
+    });
+    // Central differences: 2 evaluations per gradient entry, 4 per Hessian entry.
+    vector<double> in(value.inputs, 0.0);
+    auto at = [&](size_t a, double da, size_t b, double db) {
+        in[CompiledExp::xReg] = env[0];
+        for (size_t v = 1; v <= n; ++v) in[CompiledExp::variableReg(static_cast<uint32_t>(v))] = env[v];
+        in[CompiledExp::variableReg(params[a])] += da;
+        in[CompiledExp::variableReg(params[b])] += db;
+        return value.evaluate(in.data());
+    };
+    const double eps = 1e-4;
+    double maxErr = 0;
+    double fdMs = timeMs([&] {
+        for (int i = 0; i < points; ++i) {
+            point(i);
+            for (size_t r = 0; r < n; ++r) {
+                gv[r] = (at(r, eps, r, 0) - at(r, -eps, r, 0)) / (2 * eps);
+                for (size_t c = 0; c < n; ++c) {
+                    out[r * n + c] = (at(r, eps, c, eps) - at(r, eps, c, -eps) - at(r, -eps, c, eps) +
+                                      at(r, -eps, c, -eps)) / (4 * eps * eps);
+                }
+            }
+            sink += gv[0] + out[0];
+            if (i % (points / 10) != 0) continue;
+            vector<double> exact(n * n);
+            hessTape.evaluate(env, exact.data());
+            for (size_t k = 0; k < n * n; ++k) maxErr = max(maxErr, fabs(exact[k] - out[k]) / max(fabs(exact[k]), 1.0));
+        }
+    });
+    cout << n << " parameters: gradient + Hessian built shared " << sharedMs << " ms (" << hits
+         << " partial cache hits), entry by entry " << separateMs << " ms ("
+         << separateMs / sharedMs << "x, " << separateNodes << " nodes)" << endl;
+    cout << "  Hessian " << h.nonZeros() << " of " << n * n << " entries stored, one tape "
+         << hessTape.compiled().size() << " instructions vs " << separateInstrs << " as separate tapes" << endl;
+    cout << "  " << points << " points: gradient + Hessian tapes " << tapeMs << " ms, central differences "
+         << fdMs << " ms (" << fdMs / tapeMs << "x), max rel difference " << maxErr
+         << (sink == 0.5 ? " " : "") << endl;
+}
+
+// Every function name the parser reads, applied to a non-trivial argument in its domain
+// (and squared), differentiated and compared against central differences. x stays in
+// [0.2, 0.9], where no argument reaches a pole.
+static void checkParsedDerivatives(int points) {
+    ExpParser parser;
+    double maxErr = 0;
+    string worst;
+    for (const char* name : {"sin", "cos", "tan", "csc", "sec", "cot", "arcsin", "arccos", "arctan", "arccsc",
+                             "arcsec", "arccot", "sqrt"}) {
+        string n = name;
+        string arg = n == "arcsin" || n == "arccos" ? "0.5*x^2" : n == "arccsc" || n == "arcsec" ? "x^2 + 1.5" : "x^2 + 0.5";
+        vector<string> texts{n + "(" + arg + ")", n + "(" + arg + ")*x"};
+        if (n.size() == 3 && n != "sqrt") texts.push_back(n + "^2(" + arg + ")");
+        for (const string& text : texts) {
+            shared_ptr<Exp> f = parser.parse(text);
+            shared_ptr<Exp> d = shareNode(f->derivative());
+            const double eps = 1e-5;
+            for (int i = 0; i < points; ++i) {
+                double x = 0.2 + 0.7 * i / points;
+                double fd = (f->evaluate(x + eps) - f->evaluate(x - eps)) / (2 * eps);
+                double err = fabs(d->evaluate(x) - fd) / max(fabs(fd), 1.0);
+                if (err > maxErr) {
+                    maxErr = err;
+                    worst = text;
+                }
+            }
+        }
+    }
+    cout << "parsed functions, derivative vs central differences: max rel difference " << maxErr << " (" << worst
+         << ")" << endl;
+}
+
+// Gradient and Hessian of f at a few points against central differences, every entry
+// including the structural zeros, as the largest relative difference.
+static double partialsError(const shared_ptr<Exp>& f, const vector<uint32_t>& vars, int points) {
+    ExpMatrix g, h;
+    {
+        PartialSession session;
+        g = gradient(f, vars);
+        h = hessian(f, vars);
+    }
+    MatrixTape gradTape(g), hessTape(h);
+    const size_t n = vars.size();
+    uint32_t top = *max_element(vars.begin(), vars.end());
+    Environment env(vector<double>(top + 1, 0.0));
+    auto at = [&](size_t a, double da, size_t b, double db) {
+        Environment moved = env;
+        moved[vars[a]] += da;
+        moved[vars[b]] += db;
+        return evaluate(*f, moved);
+    };
+    const double eps = 1e-4;
+    double maxErr = 0;
+    vector<double> gv(n), hv(n * n);
+    for (int i = 0; i < points; ++i) {
+        env[0] = 0.3 + 0.4 * i / points;
+        for (uint32_t v = 1; v <= top; ++v) env[v] = 0.5 + 0.1 * static_cast<double>((v * 7 + i) % 11);
+        gradTape.evaluate(env, gv.data());
+        hessTape.evaluate(env, hv.data());
+        for (size_t r = 0; r < n; ++r) {
+            double fd = (at(r, eps, r, 0) - at(r, -eps, r, 0)) / (2 * eps);
+            maxErr = max(maxErr, fabs(gv[r] - fd) / max(fabs(fd), 1.0));
+            for (size_t c = 0; c < n; ++c) {
+                fd = (at(r, eps, c, eps) - at(r, eps, c, -eps) - at(r, -eps, c, eps) + at(r, -eps, c, -eps)) /
+                     (4 * eps * eps);
+                maxErr = max(maxErr, fabs(hv[r * n + c] - fd) / max(fabs(fd), 1.0));
+            }
+        }
+    }
+    return maxErr;
+}
+
+// tan, sec and the arc functions of x_i products, whose partials go through the chain
+// rule with the leaf's derivative substituted at the product.
+static void checkFunctionPartials(int points) {
+    ExpParser parser;
+    for (const char* text : {"sec(x_1*x_2)", "tan(x_2*x_3) + x", "csc(x_1*x_3)*cot(x_2)", "arcsin(0.3*x_1*x_2)",
+                             "arccos(0.3*x_2*x_3)*x", "arctan(x_1*x_3)", "arccsc(x_1*x_2 + 2)", "arcsec(x_2*x_3 + 2)",
+                             "arccot(x_1*x_2*x)"}) {
+        shared_ptr<Exp> f = parser.parse(text);
+        cout << "  " << text << ": max rel difference " << partialsError(f, {0, 1, 2, 3}, points) << endl;
+    }
+}
+
+int main() {
+    const int points = 1000000;
+    cout << "== compiled tape vs tree evaluate (" << points << " points) ==" << endl;
+
+    dExp dydx = implicitExample().derivative();
+    benchCompiledEvaluate("implicit dy/dx", *dydx, points);
+
+    shared_ptr<Exp> f = explicitExample();
+    benchCompiledEvaluate("explicit f", *f, points);
+    for (int k = 1; k <= 3; ++k) {
+        f = f->derivative();
+        benchCompiledEvaluate("explicit f^(" + to_string(k) + ")", *f, points);
+    }
+
+    cout << "== native code vs compiled tape (" << points << " points) ==" << endl;
+    benchNative("explicit f", explicitExample(), 3, points);
+    benchNative("implicit dy/dx", shareNode(implicitExample().derivative()), 0, points);
+
+    cout << "== batch evaluate vs scalar evaluate (" << points << " points, simd "
+         << (simdAvailable() ? "on" : "off") << ") ==" << endl;
+    benchBatchEvaluate("implicit dy/dx", *dydx, points);
+    f = explicitExample();
+    benchBatchEvaluate("explicit f", *f, points);
+    for (int k = 1; k <= 3; ++k) {
+        f = f->derivative();
+        benchBatchEvaluate("explicit f^(" + to_string(k) + ")", *f, points);
+    }
+    checkBatchKernels();
+
+    cout << "== common subexpression elimination (" << points << " points) ==" << endl;
+    benchCse("implicit dy/dx", *dydx, points);
+    f = explicitExample();
+    for (int k = 1; k <= 3; ++k) {
+        f = f->derivative();
+        benchCse("explicit f^(" + to_string(k) + ")", *f, points);
+    }
+
+    cout << "== forward-mode dual evaluate vs symbolic derivative (" << points << " points) ==" << endl;
+    f = explicitExample();
+    for (int k = 0; k <= 3; ++k) {
+        benchDual("explicit f^(" + to_string(k) + ")", f, points);
+        f = f->derivative();
+    }
+    benchDual("every class", everyClassExample(), points);
+
+    cout << "== reverse-mode gradient (" << points << " points) ==" << endl;
+    benchGradient(points);
+
+    cout << "== taylor-mode derivatives at a point ==" << endl;
+    benchTaylor("explicit f", explicitExample(), 0.7, 6, 20);
+    benchTaylor("sin(e^(x^2)*cos(x))", make_shared<SineComposed>(make_shared<Multiply>(
+        make_shared<ExponentialComposed>(make_shared<Power>(2.0)), make_shared<Cosine>())), 0.3, 5, 20);
+    benchTaylor("every class", everyClassExample(), 0.6, 4, 20);
+
+    cout << "== simplify on generated trees ==" << endl;
+    benchGeneratedSimplify(6, 400);
+    benchGeneratedSimplify(9, 40);
+    benchGeneratedSimplify(12, 4);
+
+    cout << "== re-simplifying simplified output ==" << endl;
+    {
+        vector<shared_ptr<Exp>> forest;
+        uint32_t seed = 777;
+        for (int i = 0; i < 40; ++i) forest.push_back(generatedTree(9, seed));
+        benchSimplifyVisits("generated trees, depth 9", forest, 1);
+        vector<shared_ptr<Exp>> chain{explicitExample()};
+        for (int order = 1; order <= 4; ++order) chain.push_back(shareNode(chain.back()->derivative()));
+        benchSimplifyVisits("f through f^(4)", chain, 20);
+    }
+
+    cout << "== polynomial kernel vs map<int, double> ==" << endl;
+    benchPolyMul("dense integer, 400 x 400 terms", 400, 1, true);
+    benchPolyMul("dense fractional, 400 x 400 terms", 400, 1, false);
+    benchPolyMul("sparse, 300 x 300 terms, stride 1000", 300, 1000, true);
+    benchPolySimplify(100);
+    benchPolySimplify(300);
+
+    cout << "== polynomial node vs expression chain (100000 points) ==" << endl;
+    benchPolynomialNode(20, 100000);
+    benchPolynomialNode(200, 100000);
+
+    cout << "== exact rationals ==" << endl;
+    benchRationalSmall(1000000);
+    benchRationalPowers(20);
+    benchRationalPowers(60);
+
+    cout << "== parsing printed text ==" << endl;
+    benchParse(2000, 20);
+    checkParsedDerivatives(50);
+
+    cout << "== binary archive vs printed text ==" << endl;
+    benchArchive(1000, 2000);
+
+    cout << "== printing large derivatives ==" << endl;
+    {
+        uint32_t seed = 99;
+        benchPrint("generated tree, depth 12", generatedTree(12, seed));
+        benchPrint("sin/+ chain, depth 2000", deepChain(2000));
+    }
+
+    cout << "== hash-consed derivatives ==" << endl;
+    benchInternedDerivatives("explicit f", explicitExample(), 4);
+    benchInternedDerivatives("every class", everyClassExample(), 3);
+    {
+        uint32_t seed = 4242;
+        benchInternedDerivatives("generated tree, depth 8", generatedTree(8, seed), 2);
+    }
+
+    cout << "== node arena vs heap, 60 worker sessions ==" << endl;
+    benchArenaWorker(false, 60);
+    benchArenaWorker(true, 60);
+
+    cout << "== parallel grid, f through f^(3) (" << points << " points, "
+         << thread::hardware_concurrency() << " hardware threads) ==" << endl;
+    benchParallelGrid(explicitExample(), 3, points);
+
+    cout << "== multivariable gradient and Hessian ==" << endl;
+    benchMultivariable(2, 2000);
+    benchMultivariable(8, 200);
+    cout << "function partials vs central differences:" << endl;
+    checkFunctionPartials(20);
+    return 0;
+}
+
+#endif
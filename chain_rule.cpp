@@ -4,186 +4,338 @@
 #include "chain_rule.hpp"
 
 #include "expression_utils.hpp"
+#include "expression_writer.hpp"
 #include "inverse_trigonometric_functions.hpp"
+#include "memo.hpp"
 #include "polynomials_and_exponential_functions.hpp"
+#include "simd_math.hpp"
 #include "trigonometric_functions.hpp"
 
+#include <algorithm>
 #include <cmath>
 
 using namespace std;
 
-ChainRule::ChainRule(shared_ptr<Exp> f, shared_ptr<Exp> g) : outer(f), inner(g) {}
-string ChainRule::toString() const {
-    return "f(" + inner->toString() + ")";
+ChainRule::ChainRule(shared_ptr<Exp> f, shared_ptr<Exp> g) : Exp(Kind), outer(move(f)), inner(move(g)) {}
+// The name a one-argument function leaf prints before "(x)", or nullptr.
+static const char* functionName(ExpKind kind) {
+    switch (kind) {
+        case ExpKind::Sine: return "sin";
+        case ExpKind::Cosine: return "cos";
+        case ExpKind::Tangent: return "tan";
+        case ExpKind::Cosecant: return "csc";
+        case ExpKind::Secant: return "sec";
+        case ExpKind::Cotangent: return "cot";
+        case ExpKind::ArcSine: return "arcsin";
+        case ExpKind::ArcCosine: return "arccos";
+        case ExpKind::ArcTangent: return "arctan";
+        case ExpKind::ArcCosecant: return "arccsc";
+        case ExpKind::ArcSecant: return "arcsec";
+        case ExpKind::ArcCotangent: return "arccot";
+        default: return nullptr;
+    }
+}
+
+// name(inner) for a function leaf, as the parser reads it back. Any other outer is
+// printed as text with inner's text put in for every x, bracketed unless the x already
+// stands alone in brackets; no function name contains an x, and x_i is left alone.
+// Only text is made, no nodes.
+void ChainRule::print(ExpWriter& out) const {
+    if (const char* name = functionName(outer->kind())) {
+        out << name << '(' << *inner << ')';
+        return;
+    }
+    ExpWriter outerWriter, innerWriter;
+    outer->print(outerWriter);
+    inner->print(innerWriter);
+    string text = outerWriter.take();
+    string innerText = innerWriter.take();
+    auto isWord = [](char c) { return (c >= 'a' && c <= 'z') || c == '_'; };
+    size_t done = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != 'x' || (i > 0 && isWord(text[i - 1])) || (i + 1 < text.size() && isWord(text[i + 1]))) continue;
+        out << string_view(text).substr(done, i - done);
+        bool bracketed = i > 0 && text[i - 1] == '(' && i + 1 < text.size() && text[i + 1] == ')';
+        if (bracketed) {
+            out << string_view(innerText);
+        } else {
+            out << '(' << string_view(innerText) << ')';
+        }
+        done = i + 1;
+    }
+    out << string_view(text).substr(done);
+}
+dExp composeLeaf(const Exp& leaf, const shared_ptr<Exp>& replacement) {
+    if (replacement->kind() == ExpKind::VariableX) return leaf.clone();
+    return make_unique<ChainRule>(shareNode(leaf.clone()), replacement)->simplify();
 }
-dExp ChainRule::derivative() const {
-    auto outer_deriv = outer->derivative();
+
+dExp ChainRule::derivativeNode() const {
+    auto outer_deriv = derivativeOf(outer);
     auto outer_deriv_at_g = outer_deriv->substitute(inner);
-    auto inner_deriv = inner->derivative();
+    auto inner_deriv = derivativeOf(inner);
 
     return make_unique<Multiply>(
-        shared_ptr<Exp>(move(outer_deriv_at_g)),
-        shared_ptr<Exp>(move(inner_deriv))
+        shareNode(move(outer_deriv_at_g)),
+        inner_deriv
     )->simplify();
 }
-dExp ChainRule::simplify() const {
-    auto o = outer->simplify();
-    auto i = inner->simplify();
-    return make_unique<ChainRule>(shared_ptr<Exp>(move(o)), shared_ptr<Exp>(move(i)));
+dExp ChainRule::simplifyNode() const {
+    return make_unique<ChainRule>(simplifyOf(outer), simplifyOf(inner));
 }
 double ChainRule::evaluate(double x) const {
     double inner_val = inner->evaluate(x);
     return outer->evaluate(inner_val);
 }
-dExp ChainRule::substitute(const shared_ptr<Exp>& replacement) const {
+void ChainRule::evaluate(const double* xs, double* out, size_t n) const {
+    double tmp[batchBlock];
+    for (size_t start = 0; start < n; start += batchBlock) {
+        size_t m = min(batchBlock, n - start);
+        inner->evaluate(xs + start, tmp, m);
+        outer->evaluate(tmp, out + start, m);
+    }
+}
+Dual ChainRule::evaluateWithDerivative(double x) const {
+    Dual in = inner->evaluateWithDerivative(x);
+    Dual out = outer->evaluateWithDerivative(in.value);
+    return Dual{out.value, out.deriv * in.deriv};
+}
+dExp ChainRule::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<ChainRule>(outer, inner->substitute(replacement))->simplify();
 }
 
-SineComposed::SineComposed(shared_ptr<Exp> a) : arg(a) {}
-string SineComposed::toString() const {
-    return "sin(" + arg->toString() + ")";
+SineComposed::SineComposed(shared_ptr<Exp> a) : Exp(Kind), arg(move(a)) {}
+void SineComposed::print(ExpWriter& out) const {
+    out << "sin(" << *arg << ')';
 }
-dExp SineComposed::derivative() const {
+dExp SineComposed::derivativeNode() const {
     return make_unique<Multiply>(
-        make_shared<CosineComposed>(arg),
-        arg->derivative()
+        makeNode<CosineComposed>(arg),
+        derivativeOf(arg)
     )->simplify();
 }
-dExp SineComposed::simplify() const {
-    auto a = arg->simplify();
-    if (dynamic_cast<VariableX*>(a.get())) {
+dExp SineComposed::simplifyNode() const {
+    auto a = simplifyOf(arg);
+    if (as<VariableX>(a.get())) {
         return make_unique<Sine>();
     }
-    return make_unique<SineComposed>(shared_ptr<Exp>(move(a)));
+    return make_unique<SineComposed>(a);
 }
 double SineComposed::evaluate(double x) const {
     return sin(arg->evaluate(x));
 }
-dExp SineComposed::substitute(const shared_ptr<Exp>& replacement) const {
+void SineComposed::evaluate(const double* xs, double* out, size_t n) const {
+    arg->evaluate(xs, out, n);
+    batchSin(out, out, n);
+}
+Dual SineComposed::evaluateWithDerivative(double x) const {
+    Dual a = arg->evaluateWithDerivative(x);
+    return Dual{sin(a.value), cos(a.value) * a.deriv};
+}
+dExp SineComposed::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<SineComposed>(arg->substitute(replacement))->simplify();
 }
 
-CosineComposed::CosineComposed(shared_ptr<Exp> a) : arg(a) {}
-string CosineComposed::toString() const {
-    return "cos(" + arg->toString() + ")";
+CosineComposed::CosineComposed(shared_ptr<Exp> a) : Exp(Kind), arg(move(a)) {}
+void CosineComposed::print(ExpWriter& out) const {
+    out << "cos(" << *arg << ')';
 }
-dExp CosineComposed::derivative() const {
+dExp CosineComposed::derivativeNode() const {
     return make_unique<Multiply>(
-        make_unique<Multiply>(
-            make_unique<Constant>(-1),
-            make_shared<SineComposed>(arg)
+        makeNode<Multiply>(
+            makeNode<Constant>(-1),
+            makeNode<SineComposed>(arg)
         ),
-        arg->derivative()
+        derivativeOf(arg)
     )->simplify();
 }
-dExp CosineComposed::simplify() const {
-    auto a = arg->simplify();
-    if (dynamic_cast<VariableX*>(a.get())) {
+dExp CosineComposed::simplifyNode() const {
+    auto a = simplifyOf(arg);
+    if (as<VariableX>(a.get())) {
         return make_unique<Cosine>();
     }
-    return make_unique<CosineComposed>(shared_ptr<Exp>(move(a)));
+    return make_unique<CosineComposed>(a);
 }
 double CosineComposed::evaluate(double x) const {
     return cos(arg->evaluate(x));
 }
-dExp CosineComposed::substitute(const shared_ptr<Exp>& replacement) const {
+void CosineComposed::evaluate(const double* xs, double* out, size_t n) const {
+    arg->evaluate(xs, out, n);
+    batchCos(out, out, n);
+}
+Dual CosineComposed::evaluateWithDerivative(double x) const {
+    Dual a = arg->evaluateWithDerivative(x);
+    return Dual{cos(a.value), -sin(a.value) * a.deriv};
+}
+dExp CosineComposed::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<CosineComposed>(arg->substitute(replacement))->simplify();
 }
 
-PowerComposed::PowerComposed(shared_ptr<Exp> a, double n) : arg(a), exponent(n) {}
+PowerComposed::PowerComposed(shared_ptr<Exp> a, double n) : Exp(Kind), arg(move(a)), exponent(n) {}
 PowerComposed::PowerComposed(shared_ptr<Exp> a, long long n, long long d)
-    : arg(a), exponent(static_cast<double>(n) / static_cast<double>(d)) {
-    hasFraction = true;
-    num = n;
-    den = d;
-    normaliseFraction(num, den);
-}
-string PowerComposed::toString() const {
-    if (hasFraction) {
-        if (den == 1) return "(" + arg->toString() + ")^" + to_string(num);
-        return "(" + arg->toString() + ")^(" + formatFraction(num, den) + ")";
+    : PowerComposed(move(a), Rational(n, d)) {}
+PowerComposed::PowerComposed(shared_ptr<Exp> a, const Rational& r)
+    : Exp(Kind), arg(move(a)), exponent(r.toDouble()), hasFraction(true), fraction(r) {}
+void PowerComposed::print(ExpWriter& out) const {
+    out << '(' << *arg << ")^";
+    if (!hasFraction) {
+        out.number(exponent);
+    } else if (fraction.isInteger()) {
+        out << fraction.toString();
+    } else {
+        out << '(' << fraction.toString() << ')';
     }
-    return "(" + arg->toString() + ")^" + formatNumber(exponent);
 }
-dExp PowerComposed::derivative() const {
+dExp PowerComposed::derivativeNode() const {
     if (hasFraction) {
-        long long n = num;
-        long long d = den;
-        long long n_minus = n - d;
         return make_unique<Multiply>(
-            make_unique<Multiply>(
-                make_unique<Constant>(n, d),
-                make_shared<PowerComposed>(arg, n_minus, d)
+            makeNode<Multiply>(
+                makeNode<Constant>(fraction),
+                makeNode<PowerComposed>(arg, fraction - 1)
             ),
-            arg->derivative()
+            derivativeOf(arg)
         )->simplify();
     }
     return make_unique<Multiply>(
-        make_unique<Multiply>(
-            make_unique<Constant>(exponent),
-            make_shared<PowerComposed>(arg, exponent - 1)
+        makeNode<Multiply>(
+            makeNode<Constant>(exponent),
+            makeNode<PowerComposed>(arg, exponent - 1)
         ),
-        arg->derivative()
+        derivativeOf(arg)
     )->simplify();
 }
-dExp PowerComposed::simplify() const {
-    auto a = arg->simplify();
+dExp PowerComposed::simplifyNode() const {
+    auto a = simplifyOf(arg);
     if (hasFraction) {
-        if (num == 0) return make_unique<Constant>(1);
-        if (den == 1 && num == 1) return a;
-        if (dynamic_cast<VariableX*>(a.get())) {
-            return make_unique<Power>(num, den);
+        if (fraction.isZero()) return make_unique<Constant>(1);
+        if (fraction.isOne()) return a->clone();
+        if (as<VariableX>(a.get())) {
+            return make_unique<Power>(fraction);
         }
-        if (auto c = dynamic_cast<Constant*>(a.get())) {
+        if (auto c = as<Constant>(a.get())) {
             return make_unique<Constant>(pow(c->value, exponent));
         }
-        return make_unique<PowerComposed>(shared_ptr<Exp>(move(a)), num, den);
+        return make_unique<PowerComposed>(a, fraction);
     }
     if (exponent == 0.0) return make_unique<Constant>(1);
-    if (exponent == 1.0) return a;
-    if (dynamic_cast<VariableX*>(a.get())) {
+    if (exponent == 1.0) return a->clone();
+    if (as<VariableX>(a.get())) {
         return make_unique<Power>(exponent);
     }
-    if (auto c = dynamic_cast<Constant*>(a.get())) {
+    if (auto c = as<Constant>(a.get())) {
         return make_unique<Constant>(pow(c->value, exponent));
     }
-    return make_unique<PowerComposed>(shared_ptr<Exp>(move(a)), exponent);
+    return make_unique<PowerComposed>(a, exponent);
 }
 double PowerComposed::evaluate(double x) const {
     return pow(arg->evaluate(x), exponent);
 }
-dExp PowerComposed::substitute(const shared_ptr<Exp>& replacement) const {
+void PowerComposed::evaluate(const double* xs, double* out, size_t n) const {
+    arg->evaluate(xs, out, n);
+    batchPow(out, exponent, out, n);
+}
+Dual PowerComposed::evaluateWithDerivative(double x) const {
+    if (exponent == 0) return Dual{1.0, 0.0};
+    Dual a = arg->evaluateWithDerivative(x);
+    return Dual{pow(a.value, exponent), exponent * pow(a.value, exponent - 1) * a.deriv};
+}
+dExp PowerComposed::substituteNode(const shared_ptr<Exp>& replacement) const {
     if (hasFraction) {
-        return make_unique<PowerComposed>(arg->substitute(replacement), num, den)->simplify();
+        return make_unique<PowerComposed>(arg->substitute(replacement), fraction)->simplify();
     }
     return make_unique<PowerComposed>(arg->substitute(replacement), exponent)->simplify();
 }
 
-ExponentialComposed::ExponentialComposed(shared_ptr<Exp> a) : arg(a) {}
-string ExponentialComposed::toString() const {
-    return "e^(" + arg->toString() + ")";
+ExponentialComposed::ExponentialComposed(shared_ptr<Exp> a) : Exp(Kind), arg(move(a)) {}
+void ExponentialComposed::print(ExpWriter& out) const {
+    out << "e^(" << *arg << ')';
 }
-dExp ExponentialComposed::derivative() const {
+dExp ExponentialComposed::derivativeNode() const {
     return make_unique<Multiply>(
-        make_shared<ExponentialComposed>(arg),
-        arg->derivative()
+        makeNode<ExponentialComposed>(arg),
+        derivativeOf(arg)
     )->simplify();
 }
-dExp ExponentialComposed::simplify() const {
-    auto a = arg->simplify();
-    if (dynamic_cast<VariableX*>(a.get())) {
+dExp ExponentialComposed::simplifyNode() const {
+    auto a = simplifyOf(arg);
+    if (as<VariableX>(a.get())) {
         return make_unique<Exponential>(1);
     }
-    if (auto c = dynamic_cast<Constant*>(a.get())) {
+    if (auto c = as<Constant>(a.get())) {
         return make_unique<Constant>(exp(c->value));
     }
-    return make_unique<ExponentialComposed>(shared_ptr<Exp>(move(a)));
+    return make_unique<ExponentialComposed>(a);
 }
 double ExponentialComposed::evaluate(double x) const {
     return exp(arg->evaluate(x));
 }
-dExp ExponentialComposed::substitute(const shared_ptr<Exp>& replacement) const {
+void ExponentialComposed::evaluate(const double* xs, double* out, size_t n) const {
+    arg->evaluate(xs, out, n);
+    batchExp(out, out, n);
+}
+Dual ExponentialComposed::evaluateWithDerivative(double x) const {
+    Dual a = arg->evaluateWithDerivative(x);
+    double e = exp(a.value);
+    return Dual{e, e * a.deriv};
+}
+dExp ExponentialComposed::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<ExponentialComposed>(arg->substitute(replacement))->simplify();
 }
 
+
+dExp ChainRule::clone() const {
+    return make_unique<ChainRule>(*this);
+}
+dExp SineComposed::clone() const {
+    return make_unique<SineComposed>(*this);
+}
+dExp CosineComposed::clone() const {
+    return make_unique<CosineComposed>(*this);
+}
+dExp PowerComposed::clone() const {
+    return make_unique<PowerComposed>(*this);
+}
+dExp ExponentialComposed::clone() const {
+    return make_unique<ExponentialComposed>(*this);
+}
+
+bool ChainRule::equals(const Exp& other) const {
+    auto c = as<ChainRule>(&other);
+    return c && sameExp(outer, c->outer) && sameExp(inner, c->inner);
+}
+size_t ChainRule::computeHashCode() const {
+    size_t h = hashCombine(static_cast<size_t>(Kind), outer->hashCode());
+    return hashCombine(h, inner->hashCode());
+}
+bool SineComposed::equals(const Exp& other) const {
+    auto s = as<SineComposed>(&other);
+    return s && sameExp(arg, s->arg);
+}
+size_t SineComposed::computeHashCode() const {
+    return hashCombine(static_cast<size_t>(Kind), arg->hashCode());
+}
+bool CosineComposed::equals(const Exp& other) const {
+    auto c = as<CosineComposed>(&other);
+    return c && sameExp(arg, c->arg);
+}
+size_t CosineComposed::computeHashCode() const {
+    return hashCombine(static_cast<size_t>(Kind), arg->hashCode());
+}
+bool PowerComposed::equals(const Exp& other) const {
+    auto p = as<PowerComposed>(&other);
+    return p && sameNumber(exponent, hasFraction ? &fraction : nullptr, p->exponent, p->hasFraction ? &p->fraction : nullptr) &&
+           sameExp(arg, p->arg);
+}
+size_t PowerComposed::computeHashCode() const {
+    size_t h = hashCombine(static_cast<size_t>(Kind), numberHash(exponent, hasFraction ? &fraction : nullptr));
+    return hashCombine(h, arg->hashCode());
+}
+bool ExponentialComposed::equals(const Exp& other) const {
+    auto e = as<ExponentialComposed>(&other);
+    return e && sameExp(arg, e->arg);
+}
+size_t ExponentialComposed::computeHashCode() const {
+    return hashCombine(static_cast<size_t>(Kind), arg->hashCode());
+}
+
 #endif
\ No newline at end of file
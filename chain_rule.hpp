@@ -2,66 +2,106 @@
 #define CHAIN_RULE_HPP
 
 #include "expression.hpp"
+#include "rational.hpp"
 
 class ChainRule : public Exp {
     public:
+        static constexpr ExpKind Kind = ExpKind::ChainRule;
         shared_ptr<Exp> outer;
         shared_ptr<Exp> inner;
         ChainRule(shared_ptr<Exp> f, shared_ptr<Exp> g);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
+// leaf(replacement) for a function leaf with no composed class of its own (tan, csc,
+// the arc functions): a ChainRule, or the leaf itself when replacement is x.
+dExp composeLeaf(const Exp& leaf, const shared_ptr<Exp>& replacement);
+
 class SineComposed : public Exp {
     public:
+        static constexpr ExpKind Kind = ExpKind::SineComposed;
         shared_ptr<Exp> arg;
         explicit SineComposed(shared_ptr<Exp> a);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 class CosineComposed : public Exp {
     public:
+        static constexpr ExpKind Kind = ExpKind::CosineComposed;
         shared_ptr<Exp> arg;
         explicit CosineComposed(shared_ptr<Exp> a);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 class PowerComposed : public Exp {
     public:
+        static constexpr ExpKind Kind = ExpKind::PowerComposed;
         shared_ptr<Exp> arg;
         double exponent;
         bool hasFraction = false;
-        long long num = 0;
-        long long den = 1;
+        Rational fraction; // exact exponent when hasFraction
         PowerComposed(shared_ptr<Exp> a, double n);
         PowerComposed(shared_ptr<Exp> a, long long n, long long d);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        PowerComposed(shared_ptr<Exp> a, const Rational& r);
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 class ExponentialComposed : public Exp {
     public:
+        static constexpr ExpKind Kind = ExpKind::ExponentialComposed;
         shared_ptr<Exp> arg;
         explicit ExponentialComposed(shared_ptr<Exp> a);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 #endif
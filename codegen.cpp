@@ -0,0 +1,94 @@
+// Ahead-of-time code generation: writes a C++ header of inline functions for an
+// expression and its derivatives, or for dy/dx when the argument is "left = right".
+// Build: g++ -std=c++17 -O2 -pthread -o codegen codegen.cpp
+// Usage: codegen [--name NAME] [--namespace NS] [--orders N] [--no-arrays] [-o FILE] EXPRESSION
+#include "node_arena.cpp"
+#include "expression_writer.cpp"
+#include "chain_rule.cpp"
+#include "poly_kernel.cpp"
+#include "rational.cpp"
+#include "polynomials_and_exponential_functions.cpp"
+#include "trigonometric_functions.cpp"
+#include "inverse_trigonometric_functions.cpp"
+#include "implicit_differentiation.cpp"
+#include "expression_store.cpp"
+#include "memo.cpp"
+#include "exp_stats.cpp"
+#include "exp_trace.cpp"
+#include "compiled_expression.cpp"
+#include "multivariable.cpp"
+#include "simd_math.cpp"
+#include "expression_parser.cpp"
+#include "cpp_codegen.cpp"
+#include "expression_utils.hpp"
+
+#ifndef CODEGEN_CPP
+#define CODEGEN_CPP
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+using namespace std;
+
+static int usage() {
+    cerr << "usage: codegen [--name NAME] [--namespace NS] [--orders N] [--no-arrays] [-o FILE] EXPRESSION" << endl;
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    CodegenOptions options;
+    const char* outPath = nullptr;
+    const char* text = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+            options.name = argv[++i];
+        } else if (strcmp(argv[i], "--namespace") == 0 && i + 1 < argc) {
+            options.nameSpace = argv[++i];
+        } else if (strcmp(argv[i], "--orders") == 0 && i + 1 < argc) {
+            long value = strtol(argv[++i], nullptr, 10);
+            if (value < 0) return usage();
+            options.orders = static_cast<size_t>(value);
+        } else if (strcmp(argv[i], "--no-arrays") == 0) {
+            options.arrays = false;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outPath = argv[++i];
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0' && !text) {
+            return usage();
+        } else if (!text) {
+            text = argv[i];
+        } else {
+            return usage();
+        }
+    }
+    if (!text) return usage();
+
+    ExpParser parser;
+    ParseError error;
+    string header;
+    if (strchr(text, '=')) {
+        unique_ptr<ImplicitEquation> equation = parser.parseEquation(text, &error);
+        if (equation) header = emitHeader(*equation, options);
+    } else {
+        shared_ptr<Exp> expr = parser.parse(text, &error);
+        if (expr) header = emitHeader(expr, options);
+    }
+    if (header.empty()) {
+        cerr << "codegen: error at column " << error.offset + 1 << ": " << error.message << endl;
+        return 1;
+    }
+
+    if (!outPath) {
+        cout << header;
+        return 0;
+    }
+    ofstream out(outPath);
+    out << header;
+    if (!out) {
+        cerr << "codegen: " << outPath << ": cannot write the header" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif
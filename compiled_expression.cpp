@@ -0,0 +1,373 @@
+#ifndef COMPILED_EXPRESSION_CPP
+#define COMPILED_EXPRESSION_CPP
+
+#include "compiled_expression.hpp"
+
+#include "chain_rule.hpp"
+#include "expression_utils.hpp"
+#include "implicit_differentiation.hpp"
+#include "inverse_trigonometric_functions.hpp"
+#include "multivariable.hpp"
+#include "polynomials_and_exponential_functions.hpp"
+#include "simd_math.hpp"
+#include "trigonometric_functions.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+using namespace std;
+
+static double applyTapeOp(TapeOp op, double a, double b) {
+    switch (op) {
+        case TapeOp::Add: return a + b;
+        case TapeOp::Sub: return a - b;
+        case TapeOp::Mul: return a * b;
+        case TapeOp::Div: return b == 0 ? NAN : a / b;
+        case TapeOp::Pow: return pow(a, b);
+        case TapeOp::Recip: return 1.0 / a;
+        case TapeOp::Square: return a * a;
+        case TapeOp::Sqrt: return sqrt(a);
+        case TapeOp::Exp: return exp(a);
+        case TapeOp::Sin: return sin(a);
+        case TapeOp::Cos: return cos(a);
+        case TapeOp::Tan: return tan(a);
+        case TapeOp::Asin: return asin(a);
+        case TapeOp::Acos: return acos(a);
+        case TapeOp::Atan: return atan(a);
+    }
+    return NAN;
+}
+
+// Values are built as a graph of nodes first (x, y, constants and operations), then
+// dead nodes are dropped and the survivors are laid out in CompiledExp's register order.
+class TapeBuilder {
+    public:
+        enum class NodeKind : uint8_t { Input, Const, Op };
+        struct Node {
+            NodeKind kind;
+            TapeOp op;
+            uint32_t a;
+            uint32_t b;
+            double value;
+        };
+        vector<Node> nodes;
+        bool cse = true;
+        CompileStats stats;
+
+        uint32_t input(uint32_t index) { return push(Node{NodeKind::Input, TapeOp::Add, index, 0, 0.0}); }
+        uint32_t constant(double v) { return push(Node{NodeKind::Const, TapeOp::Add, 0, 0, v}); }
+        uint32_t unary(TapeOp op, uint32_t a) {
+            if (isConst(a)) return constant(applyTapeOp(op, nodes[a].value, 0.0));
+            return push(Node{NodeKind::Op, op, a, 0, 0.0});
+        }
+        uint32_t binary(TapeOp op, uint32_t a, uint32_t b) {
+            if (isConst(a) && isConst(b)) return constant(applyTapeOp(op, nodes[a].value, nodes[b].value));
+            return push(Node{NodeKind::Op, op, a, b, 0.0});
+        }
+        uint32_t power(uint32_t a, double exponent) {
+            if (exponent == 0.0) return constant(1.0);
+            if (exponent == 1.0) return a;
+            if (exponent == 2.0) return unary(TapeOp::Square, a);
+            return binary(TapeOp::Pow, a, constant(exponent));
+        }
+
+        uint32_t lower(const Exp* expr, uint32_t x);
+        // Lays out what the roots need; regs[i] is the register of roots[i].
+        CompiledExp finish(const vector<uint32_t>& roots, vector<uint32_t>& regs) const;
+
+    private:
+        struct NodeKey {
+            NodeKind kind;
+            TapeOp op;
+            uint32_t a;
+            uint32_t b;
+            uint64_t bits;
+            bool operator==(const NodeKey& o) const {
+                return kind == o.kind && op == o.op && a == o.a && b == o.b && bits == o.bits;
+            }
+        };
+        struct NodeKeyHash {
+            size_t operator()(const NodeKey& k) const {
+                size_t h = hashCombine(static_cast<size_t>(k.kind), static_cast<size_t>(k.op));
+                h = hashCombine(h, k.a);
+                h = hashCombine(h, k.b);
+                return hashCombine(h, hash<uint64_t>()(k.bits));
+            }
+        };
+        unordered_map<NodeKey, uint32_t, NodeKeyHash> numbered;
+
+        // With cse on, a node equal to an earlier one (same kind, op, operands and
+        // constant bits) is not added again; the earlier index is returned instead.
+        // Operands are numbered before their users, so whole repeated subtrees collapse.
+        uint32_t push(Node node) {
+            ++stats.lowered;
+            if ((node.op == TapeOp::Add || node.op == TapeOp::Mul) && node.kind == NodeKind::Op && node.a > node.b) {
+                swap(node.a, node.b);
+            }
+            NodeKey key{node.kind, node.op, node.a, node.b, 0};
+            memcpy(&key.bits, &node.value, sizeof(key.bits));
+            if (cse) {
+                auto it = numbered.find(key);
+                if (it != numbered.end()) {
+                    ++stats.merged;
+                    return it->second;
+                }
+            }
+            nodes.push_back(node);
+            uint32_t index = static_cast<uint32_t>(nodes.size() - 1);
+            if (cse) numbered.emplace(key, index);
+            return index;
+        }
+        bool isConst(uint32_t n) const {
+            return nodes[n].kind == NodeKind::Const;
+        }
+};
+
+// x is the node holding the current value of the variable; ChainRule rebinds it.
+uint32_t TapeBuilder::lower(const Exp* expr, uint32_t x) {
+    switch (expr->kind()) {
+        case ExpKind::Constant: return constant(static_cast<const Constant*>(expr)->value);
+        case ExpKind::VariableX: return x;
+        case ExpKind::VariableY: return input(CompiledExp::yReg);
+        case ExpKind::DerivativeY: return input(CompiledExp::yPrimeReg);
+        case ExpKind::Power: return power(x, static_cast<const Power*>(expr)->exponent);
+        case ExpKind::Exponential: {
+            double c = static_cast<const Exponential*>(expr)->coefficient;
+            return unary(TapeOp::Exp, binary(TapeOp::Mul, constant(c), x));
+        }
+        case ExpKind::AddSub: {
+            auto add = static_cast<const AddSub*>(expr);
+            uint32_t l = lower(add->left.get(), x);
+            uint32_t r = lower(add->right.get(), x);
+            return binary(add->op == '+' ? TapeOp::Add : TapeOp::Sub, l, r);
+        }
+        case ExpKind::Multiply: {
+            auto mul = static_cast<const Multiply*>(expr);
+            uint32_t l = lower(mul->left.get(), x);
+            uint32_t r = lower(mul->right.get(), x);
+            return binary(TapeOp::Mul, l, r);
+        }
+        case ExpKind::Divide: {
+            auto div = static_cast<const Divide*>(expr);
+            uint32_t l = lower(div->left.get(), x);
+            uint32_t r = lower(div->right.get(), x);
+            return binary(TapeOp::Div, l, r);
+        }
+        case ExpKind::Polynomial: {
+            // Horner's rule over the non-zero terms, matching Polynomial::evaluate.
+            const Poly& p = static_cast<const Polynomial*>(expr)->poly;
+            uint32_t acc = constant(0.0);
+            int prev = -1;
+            for (size_t i = p.size(); i-- > 0;) {
+                double c = p.coefficientAt(i);
+                if (c == 0.0) continue;
+                int d = p.degreeAt(i);
+                if (prev >= 0) acc = binary(TapeOp::Mul, acc, power(x, prev - d));
+                acc = binary(TapeOp::Add, acc, constant(c));
+                prev = d;
+            }
+            if (prev > 0) acc = binary(TapeOp::Mul, acc, power(x, prev));
+            return acc;
+        }
+        case ExpKind::ChainRule: {
+            auto chain = static_cast<const ChainRule*>(expr);
+            return lower(chain->outer.get(), lower(chain->inner.get(), x));
+        }
+        case ExpKind::SineComposed:
+            return unary(TapeOp::Sin, lower(static_cast<const SineComposed*>(expr)->arg.get(), x));
+        case ExpKind::CosineComposed:
+            return unary(TapeOp::Cos, lower(static_cast<const CosineComposed*>(expr)->arg.get(), x));
+        case ExpKind::PowerComposed: {
+            auto p = static_cast<const PowerComposed*>(expr);
+            return power(lower(p->arg.get(), x), p->exponent);
+        }
+        case ExpKind::ExponentialComposed:
+            return unary(TapeOp::Exp, lower(static_cast<const ExponentialComposed*>(expr)->arg.get(), x));
+        case ExpKind::Sqrt:
+            return unary(TapeOp::Sqrt, lower(static_cast<const Sqrt*>(expr)->arg.get(), x));
+        case ExpKind::Sine: return unary(TapeOp::Sin, x);
+        case ExpKind::Cosine: return unary(TapeOp::Cos, x);
+        case ExpKind::Tangent: return unary(TapeOp::Tan, x);
+        case ExpKind::Cosecant: return unary(TapeOp::Recip, unary(TapeOp::Sin, x));
+        case ExpKind::Secant: return unary(TapeOp::Recip, unary(TapeOp::Cos, x));
+        case ExpKind::Cotangent: return unary(TapeOp::Recip, unary(TapeOp::Tan, x));
+        case ExpKind::ArcSine: return unary(TapeOp::Asin, x);
+        case ExpKind::ArcCosine: return unary(TapeOp::Acos, x);
+        case ExpKind::ArcTangent: return unary(TapeOp::Atan, x);
+        case ExpKind::ArcCosecant: return unary(TapeOp::Asin, unary(TapeOp::Recip, x));
+        case ExpKind::ArcSecant: return unary(TapeOp::Acos, unary(TapeOp::Recip, x));
+        case ExpKind::ArcCotangent: return unary(TapeOp::Atan, unary(TapeOp::Recip, x));
+        case ExpKind::Variable: return input(CompiledExp::variableReg(static_cast<const Variable*>(expr)->index));
+    }
+    return constant(NAN);
+}
+
+CompiledExp TapeBuilder::finish(const vector<uint32_t>& roots, vector<uint32_t>& regs) const {
+    vector<bool> live(nodes.size(), false);
+    uint32_t root = 0;
+    for (uint32_t r : roots) {
+        live[r] = true;
+        root = max(root, r);
+    }
+    for (size_t i = root + 1; i-- > 0;) {
+        if (!live[i] || nodes[i].kind != NodeKind::Op) continue;
+        live[nodes[i].a] = true;
+        if (isBinaryTapeOp(nodes[i].op)) live[nodes[i].b] = true;
+    }
+
+    CompiledExp out;
+    for (size_t i = 0; i <= root; ++i) {
+        if (live[i] && nodes[i].kind == NodeKind::Input) out.inputs = max(out.inputs, nodes[i].a + 1);
+    }
+    vector<uint32_t> reg(nodes.size(), 0);
+    unordered_map<uint64_t, uint32_t> constIndex;
+    for (size_t i = 0; i <= root; ++i) {
+        if (!live[i]) continue;
+        if (nodes[i].kind == NodeKind::Input) reg[i] = nodes[i].a;
+        if (nodes[i].kind != NodeKind::Const) continue;
+        // Constants are shared by bit pattern, so 0.0 and -0.0 stay distinct.
+        uint64_t bits;
+        memcpy(&bits, &nodes[i].value, sizeof(bits));
+        auto it = constIndex.find(bits);
+        if (it == constIndex.end()) {
+            it = constIndex.emplace(bits, static_cast<uint32_t>(out.consts.size())).first;
+            out.consts.push_back(nodes[i].value);
+        }
+        reg[i] = out.firstConst() + it->second;
+    }
+    for (size_t i = 0; i <= root; ++i) {
+        if (!live[i] || nodes[i].kind != NodeKind::Op) continue;
+        const Node& n = nodes[i];
+        reg[i] = out.firstTemp() + static_cast<uint32_t>(out.code.size());
+        out.code.push_back(TapeInstr{n.op, reg[n.a], isBinaryTapeOp(n.op) ? reg[n.b] : 0});
+    }
+    regs.clear();
+    for (uint32_t r : roots) regs.push_back(reg[r]);
+    out.result = regs.empty() ? CompiledExp::xReg : regs[0];
+    return out;
+}
+
+CompiledExp compile(const Exp& expr, bool cse, CompileStats* stats) {
+    TapeBuilder builder;
+    builder.cse = cse;
+    uint32_t root = builder.lower(&expr, builder.input(CompiledExp::xReg));
+    if (stats) *stats = builder.stats;
+    vector<uint32_t> regs;
+    return builder.finish({root}, regs);
+}
+
+CompiledExp compile(const vector<const Exp*>& exprs, vector<uint32_t>& results, bool cse) {
+    TapeBuilder builder;
+    builder.cse = cse;
+    uint32_t x = builder.input(CompiledExp::xReg);
+    vector<uint32_t> roots;
+    for (const Exp* e : exprs) roots.push_back(builder.lower(e, x));
+    return builder.finish(roots, results);
+}
+
+double CompiledExp::evaluate(double x) const {
+    const size_t n = registers();
+    double stackRegs[256];
+    vector<double> heapRegs;
+    double* r = stackRegs;
+    if (n > 256) {
+        heapRegs.resize(n);
+        r = heapRegs.data();
+    }
+    r[xReg] = x;
+    fill(r + 1, r + inputs, NAN);
+    for (uint32_t v = yPrimeReg + 1; v < inputs; ++v) r[v] = variableValue(v - yPrimeReg);
+    forward(r);
+    return r[result];
+}
+
+double CompiledExp::evaluate(const double* in) const {
+    const size_t n = registers();
+    double stackRegs[256];
+    vector<double> heapRegs;
+    double* r = stackRegs;
+    if (n > 256) {
+        heapRegs.resize(n);
+        r = heapRegs.data();
+    }
+    memcpy(r, in, inputs * sizeof(double));
+    forward(r);
+    return r[result];
+}
+
+void CompiledExp::forward(double* r) const {
+    if (!consts.empty()) memcpy(r + firstConst(), consts.data(), consts.size() * sizeof(double));
+
+    double* out = r + firstTemp();
+    for (const TapeInstr& in : code) {
+        switch (in.op) {
+            case TapeOp::Add: *out = r[in.a] + r[in.b]; break;
+            case TapeOp::Sub: *out = r[in.a] - r[in.b]; break;
+            case TapeOp::Mul: *out = r[in.a] * r[in.b]; break;
+            case TapeOp::Div: *out = r[in.b] == 0 ? NAN : r[in.a] / r[in.b]; break;
+            case TapeOp::Pow: *out = pow(r[in.a], r[in.b]); break;
+            case TapeOp::Recip: *out = 1.0 / r[in.a]; break;
+            case TapeOp::Square: *out = r[in.a] * r[in.a]; break;
+            case TapeOp::Sqrt: *out = sqrt(r[in.a]); break;
+            case TapeOp::Exp: *out = exp(r[in.a]); break;
+            case TapeOp::Sin: *out = sin(r[in.a]); break;
+            case TapeOp::Cos: *out = cos(r[in.a]); break;
+            case TapeOp::Tan: *out = tan(r[in.a]); break;
+            case TapeOp::Asin: *out = asin(r[in.a]); break;
+            case TapeOp::Acos: *out = acos(r[in.a]); break;
+            case TapeOp::Atan: *out = atan(r[in.a]); break;
+        }
+        ++out;
+    }
+}
+
+void CompiledExp::evaluate(const double* xs, double* out, size_t n) const {
+    const size_t block = 128;
+    thread_local vector<double> scratch;
+    if (scratch.size() < registers() * block) scratch.resize(registers() * block);
+    double* r = scratch.data();
+
+    for (size_t start = 0; start < n; start += block) {
+        const size_t m = min(block, n - start);
+        double* rx = r + xReg * block;
+        for (size_t j = 0; j < m; ++j) rx[j] = xs[start + j];
+        for (uint32_t v = 1; v < inputs; ++v) {
+            fill(r + v * block, r + v * block + m, v > yPrimeReg ? variableValue(v - yPrimeReg) : NAN);
+        }
+        for (size_t c = 0; c < consts.size(); ++c) {
+            double* rc = r + (firstConst() + c) * block;
+            for (size_t j = 0; j < m; ++j) rc[j] = consts[c];
+        }
+
+        double* dst = r + firstTemp() * block;
+        for (const TapeInstr& in : code) {
+            const double* a = r + in.a * block;
+            const double* b = r + in.b * block;
+            switch (in.op) {
+                case TapeOp::Add: for (size_t j = 0; j < m; ++j) dst[j] = a[j] + b[j]; break;
+                case TapeOp::Sub: for (size_t j = 0; j < m; ++j) dst[j] = a[j] - b[j]; break;
+                case TapeOp::Mul: for (size_t j = 0; j < m; ++j) dst[j] = a[j] * b[j]; break;
+                case TapeOp::Div: for (size_t j = 0; j < m; ++j) dst[j] = b[j] == 0 ? NAN : a[j] / b[j]; break;
+                case TapeOp::Pow: batchPow(a, b[0], dst, m); break;
+                case TapeOp::Recip: for (size_t j = 0; j < m; ++j) dst[j] = 1.0 / a[j]; break;
+                case TapeOp::Square: for (size_t j = 0; j < m; ++j) dst[j] = a[j] * a[j]; break;
+                case TapeOp::Sqrt: batchSqrt(a, dst, m); break;
+                case TapeOp::Exp: batchExp(a, dst, m); break;
+                case TapeOp::Sin: batchSin(a, dst, m); break;
+                case TapeOp::Cos: batchCos(a, dst, m); break;
+                case TapeOp::Tan: for (size_t j = 0; j < m; ++j) dst[j] = tan(a[j]); break;
+                case TapeOp::Asin: for (size_t j = 0; j < m; ++j) dst[j] = asin(a[j]); break;
+                case TapeOp::Acos: for (size_t j = 0; j < m; ++j) dst[j] = acos(a[j]); break;
+                case TapeOp::Atan: for (size_t j = 0; j < m; ++j) dst[j] = atan(a[j]); break;
+            }
+            dst += block;
+        }
+
+        const double* res = r + result * block;
+        for (size_t j = 0; j < m; ++j) out[start + j] = res[j];
+    }
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef COMPILED_EXPRESSION_HPP
+#define COMPILED_EXPRESSION_HPP
+
+#include "expression.hpp"
+
+#include <cstdint>
+#include <vector>
+
+enum class TapeOp : uint8_t {
+    Add,    // r = r[a] + r[b]
+    Sub,    // r = r[a] - r[b]
+    Mul,    // r = r[a] * r[b]
+    Div,    // r = r[a] / r[b], NaN when r[b] == 0
+    Pow,    // r = pow(r[a], r[b]), r[b] is always a constant
+    Recip,  // r = 1 / r[a]
+    Square, // r = r[a] * r[a]
+    Sqrt,
+    Exp,
+    Sin,
+    Cos,
+    Tan,
+    Asin,
+    Acos,
+    Atan
+};
+
+inline bool isBinaryTapeOp(TapeOp op) {
+    return op <= TapeOp::Pow;
+}
+
+struct TapeInstr {
+    TapeOp op;
+    uint32_t a;
+    uint32_t b;
+};
+
+// An Exp lowered into a flat register tape with constants folded.
+//
+// Register layout: the inputs first (r[0] = x, r[1] = y, r[2] = y', then x_1, x_2, ...
+// up to the highest variable the tree uses), then one register per constant, then one
+// register per instruction, in order. Instruction i writes r[firstTemp() + i] and only
+// reads earlier registers. Evaluating at x alone gives the same values as Exp::evaluate
+// on the source tree (y and y' are NaN there, x_i comes from the thread's Environment);
+// the inputs can also be bound directly through evaluate(in).
+class CompiledExp {
+    public:
+        static const uint32_t xReg = 0;
+        static const uint32_t yReg = 1;
+        static const uint32_t yPrimeReg = 2;
+        // The register of x_index; index 0 is x.
+        static uint32_t variableReg(uint32_t index) { return index == 0 ? xReg : yPrimeReg + index; }
+
+        vector<TapeInstr> code;
+        vector<double> consts;
+        uint32_t inputs = 3;
+        uint32_t result = xReg;
+
+        uint32_t firstConst() const { return inputs; }
+        uint32_t firstTemp() const { return firstConst() + static_cast<uint32_t>(consts.size()); }
+        size_t registers() const { return firstTemp() + code.size(); }
+        size_t size() const { return code.size(); }
+
+        double evaluate(double x) const;
+        // in holds one value per input register.
+        double evaluate(const double* in) const;
+        // Evaluates n points, running each instruction over a block of points at a time.
+        // Uses the simd_math kernels, so it matches Exp::evaluate(xs, out, n).
+        void evaluate(const double* xs, double* out, size_t n) const;
+        // Loads the constants and runs every instruction over r, which holds registers()
+        // doubles with the inputs already set. Leaves every intermediate value in r.
+        void forward(double* r) const;
+};
+
+struct CompileStats {
+    size_t lowered = 0; // nodes requested while lowering the tree
+    size_t merged = 0;  // of those, nodes that reused an identical earlier node
+};
+
+// cse merges repeated subexpressions so each is computed once per point; turning it
+// off keeps one instruction per tree occurrence (after constant folding).
+CompiledExp compile(const Exp& expr, bool cse = true, CompileStats* stats = nullptr);
+// Several expressions on one tape, so what they have in common is computed once;
+// results[i] is the register that holds exprs[i], and result is results[0].
+CompiledExp compile(const vector<const Exp*>& exprs, vector<uint32_t>& results, bool cse = true);
+
+#endif
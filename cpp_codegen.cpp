@@ -0,0 +1,250 @@
+#ifndef CPP_CODEGEN_CPP
+#define CPP_CODEGEN_CPP
+
+#include "cpp_codegen.hpp"
+
+#include "compiled_expression.hpp"
+#include "expression_utils.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+string cppLiteral(double v) {
+    if (std::isnan(v)) return "NAN";
+    if (std::isinf(v)) return v > 0 ? "INFINITY" : "(-INFINITY)";
+    char buf[64];
+    snprintf(buf, sizeof buf, v < 0 || (v == 0 && signbit(v)) ? "(%a)" : "%a", v);
+    return buf;
+}
+
+// The printed form for a comment line, cut short when it would run on.
+string describe(const string& text) {
+    const size_t limit = 160;
+    if (text.size() <= limit) return text;
+    return text.substr(0, limit) + " ...";
+}
+
+// The statements of one tape as straight-line C++, one const double per instruction.
+class TapeWriter {
+    public:
+        string body;
+        bool usesMath = false;
+        bool usesX = false;
+        bool usesY = false;
+
+        TapeWriter(const CompiledExp& tape, bool bindY) : tape(tape), bindY(bindY) {
+            for (size_t i = 0; i < tape.code.size(); ++i) statement(i);
+        }
+
+        // Marks the parameters it names as used.
+        string value(uint32_t r) {
+            if (r == CompiledExp::xReg) {
+                usesX = true;
+                return "x";
+            }
+            if (r == CompiledExp::yReg && bindY) {
+                usesY = true;
+                return "y";
+            }
+            if (r < tape.firstConst()) return "NAN"; // y' and x_i are not parameters here
+            if (r < tape.firstTemp()) return cppLiteral(tape.consts[r - tape.firstConst()]);
+            return names[r - tape.firstTemp()];
+        }
+
+    private:
+        const CompiledExp& tape;
+        bool bindY;
+        vector<string> names;           // what each instruction's value is called
+        unordered_map<string, string> named; // right-hand side -> the temporary holding it
+        size_t helpers = 0;
+
+        // The temporary holding expr, declared under name unless an earlier one has it.
+        string declare(const string& name, const string& expr) {
+            auto it = named.find(expr);
+            if (it != named.end()) return it->second;
+            body += "    const double " + name + " = " + expr + ";\n";
+            named.emplace(expr, name);
+            return name;
+        }
+
+        string helper(const string& expr) {
+            auto it = named.find(expr);
+            if (it != named.end()) return it->second;
+            return declare("p" + to_string(helpers++), expr);
+        }
+
+        string call(const char* fn, const string& a) {
+            usesMath = true;
+            return string("std::") + fn + "(" + a + ")";
+        }
+
+        // base^n by repeated squaring, the squares kept as helper temporaries.
+        string integerPower(const string& base, long long n) {
+            if (n == 0) return "1.0";
+            unsigned long long m = static_cast<unsigned long long>(n < 0 ? -n : n);
+            string result;
+            string square = base;
+            while (true) {
+                if (m & 1) result = result.empty() ? square : helper(result + " * " + square);
+                m >>= 1;
+                if (!m) break;
+                square = helper(square + " * " + square);
+            }
+            return n < 0 ? "1.0 / " + result : result;
+        }
+
+        void statement(size_t i) {
+            const TapeInstr& in = tape.code[i];
+            string a = value(in.a);
+            string b = isBinaryTapeOp(in.op) ? value(in.b) : string();
+            string expr;
+            switch (in.op) {
+                case TapeOp::Add: expr = a + " + " + b; break;
+                case TapeOp::Sub: expr = a + " - " + b; break;
+                case TapeOp::Mul: expr = a + " * " + b; break;
+                case TapeOp::Div: expr = b + " == 0 ? NAN : " + a + " / " + b; break;
+                case TapeOp::Pow: {
+                    // The exponent register is always a constant.
+                    double e = tape.consts[in.b - tape.firstConst()];
+                    if (isInt(e) && fabs(e) <= 64) {
+                        expr = integerPower(a, static_cast<long long>(llround(e)));
+                    } else {
+                        usesMath = true;
+                        expr = "std::pow(" + a + ", " + b + ")";
+                    }
+                    break;
+                }
+                case TapeOp::Recip: expr = "1.0 / " + a; break;
+                case TapeOp::Square: expr = a + " * " + a; break;
+                case TapeOp::Sqrt: expr = call("sqrt", a); break;
+                case TapeOp::Exp: expr = call("exp", a); break;
+                case TapeOp::Sin: expr = call("sin", a); break;
+                case TapeOp::Cos: expr = call("cos", a); break;
+                case TapeOp::Tan: expr = call("tan", a); break;
+                case TapeOp::Asin: expr = call("asin", a); break;
+                case TapeOp::Acos: expr = call("acos", a); break;
+                case TapeOp::Atan: expr = call("atan", a); break;
+            }
+            // A bare name or number, as an integer power can come out, needs no statement.
+            if (expr.find_first_of(" (") == string::npos) {
+                names.push_back(expr);
+            } else {
+                names.push_back(declare("t" + to_string(i), expr));
+            }
+        }
+};
+
+string orderName(const string& name, size_t k) {
+    return k == 0 ? name : name + "_d" + to_string(k);
+}
+
+string guardOf(const CodegenOptions& options) {
+    string guard;
+    for (char c : options.nameSpace.empty() ? options.name : options.nameSpace + "_" + options.name) {
+        guard += isalnum(static_cast<unsigned char>(c)) ? static_cast<char>(toupper(static_cast<unsigned char>(c))) : '_';
+    }
+    return guard + "_GENERATED_HPP";
+}
+
+string beginHeader(const CodegenOptions& options, const string& source) {
+    string guard = guardOf(options);
+    string out = "// Generated by codegen from: " + describe(source) + "\n";
+    out += "#ifndef " + guard + "\n#define " + guard + "\n\n#include <cmath>\n#include <cstddef>\n\n";
+    if (!options.nameSpace.empty()) out += "namespace " + options.nameSpace + " {\n\n";
+    return out;
+}
+
+string endHeader(const CodegenOptions& options) {
+    string out;
+    if (!options.nameSpace.empty()) out += "}  // namespace " + options.nameSpace + "\n\n";
+    return out + "#endif\n";
+}
+
+string qualifier(const TapeWriter& w) {
+    return w.usesMath ? "inline" : "constexpr";
+}
+
+// Silences unused-parameter warnings in functions that turned out constant.
+string unused(const TapeWriter& w, bool y) {
+    string out;
+    if (!w.usesX) out += "    (void)x;\n";
+    if (y && !w.usesY) out += "    (void)y;\n";
+    return out;
+}
+}
+
+string emitHeader(const shared_ptr<Exp>& expr, const CodegenOptions& options) {
+    vector<shared_ptr<Exp>> exprs{expr};
+    for (size_t k = 0; k < options.orders; ++k) exprs.push_back(shareNode(exprs.back()->derivative()));
+
+    string out = beginHeader(options, expr->toString());
+    for (size_t k = 0; k < exprs.size(); ++k) {
+        CompiledExp tape = compile(*exprs[k]);
+        TapeWriter w(tape, false);
+        out += "// f" + (k == 0 ? string() : k <= 3 ? string(k, '\'') : "^(" + to_string(k) + ")") + "(x) = " +
+               describe(exprs[k]->toString()) + "\n";
+        out += qualifier(w) + " double " + orderName(options.name, k) + "(double x) {\n" + w.body;
+        string result = w.value(tape.result);
+        out += unused(w, false) + "    return " + result + ";\n}\n\n";
+    }
+
+    if (exprs.size() > 1) {
+        vector<const Exp*> all;
+        for (const auto& e : exprs) all.push_back(e.get());
+        vector<uint32_t> results;
+        CompiledExp tape = compile(all, results);
+        TapeWriter w(tape, false);
+        out += "// f through f^(" + to_string(options.orders) + ") at x into out[0.." + to_string(options.orders) +
+               "], each shared subexpression computed once.\n";
+        string stores;
+        for (size_t k = 0; k < results.size(); ++k) {
+            stores += "    out[" + to_string(k) + "] = " + w.value(results[k]) + ";\n";
+        }
+        out += qualifier(w) + " void " + options.name + "_all(double x, double* out) {\n" + w.body;
+        out += unused(w, false) + stores + "}\n\n";
+    }
+
+    if (options.arrays) {
+        for (size_t k = 0; k < exprs.size(); ++k) {
+            string fn = orderName(options.name, k);
+            out += "inline void " + fn + "_array(const double* xs, double* out, std::size_t n) {\n";
+            out += "    for (std::size_t i = 0; i < n; ++i) out[i] = " + fn + "(xs[i]);\n}\n\n";
+        }
+        if (exprs.size() > 1) {
+            out += "// out[k * n + i] = f^(k)(xs[i]).\n";
+            out += "inline void " + options.name + "_all_array(const double* xs, double* out, std::size_t n) {\n";
+            out += "    for (std::size_t i = 0; i < n; ++i) {\n";
+            out += "        double v[" + to_string(exprs.size()) + "];\n";
+            out += "        " + options.name + "_all(xs[i], v);\n";
+            out += "        for (std::size_t k = 0; k < " + to_string(exprs.size()) + "; ++k) out[k * n + i] = v[k];\n";
+            out += "    }\n}\n\n";
+        }
+    }
+    return out + endHeader(options);
+}
+
+string emitHeader(const ImplicitEquation& equation, const CodegenOptions& options) {
+    shared_ptr<Exp> dydx = shareNode(equation.derivative());
+    CompiledExp tape = compile(*dydx);
+    TapeWriter w(tape, true);
+
+    string fn = options.name + "_dydx";
+    string out = beginHeader(options, equation.toString());
+    out += "// dy/dx = " + describe(dydx->toString()) + "\n";
+    out += qualifier(w) + " double " + fn + "(double x, double y) {\n" + w.body;
+    string result = w.value(tape.result);
+    out += unused(w, true) + "    return " + result + ";\n}\n\n";
+    if (options.arrays) {
+        out += "inline void " + fn + "_array(const double* xs, const double* ys, double* out, std::size_t n) {\n";
+        out += "    for (std::size_t i = 0; i < n; ++i) out[i] = " + fn + "(xs[i], ys[i]);\n}\n\n";
+    }
+    return out + endHeader(options);
+}
+
+#endif
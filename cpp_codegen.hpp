@@ -0,0 +1,36 @@
+#ifndef CPP_CODEGEN_HPP
+#define CPP_CODEGEN_HPP
+
+#include "expression.hpp"
+#include "implicit_differentiation.hpp"
+
+#include <string>
+
+using namespace std;
+
+struct CodegenOptions {
+    string name = "f";   // prefix of every generated function
+    string nameSpace;    // empty: the functions go in the global namespace
+    size_t orders = 2;   // f through f^(orders); ignored for implicit equations
+    bool arrays = true;  // also emit the array-loop variants
+};
+
+// Self-contained C++17 headers with no interpreter or virtual calls left in them. For an
+// expression f and options.orders = 2 (NAME stands for options.name):
+//
+//   double NAME(double x), NAME_d1(double x), NAME_d2(double x)
+//   void NAME_all(double x, double* out)      out[k] = f^(k)(x), temporaries shared
+//   void NAME_array(const double* xs, double* out, size_t n), and so on per function;
+//   NAME_all_array writes out[k * n + i]
+//
+// For an implicit equation, NAME_dydx(double x, double y) and NAME_dydx_array.
+//
+// Each function is the CompiledExp tape of its expressions written out as straight-line
+// code, so repeated subexpressions are temporaries computed once. Integer exponents up
+// to 64 become multiplications by repeated squaring instead of pow(), which can move
+// the last bit against Exp::evaluate. Functions that make no <cmath> calls are
+// constexpr; the rest are inline.
+string emitHeader(const shared_ptr<Exp>& expr, const CodegenOptions& options = CodegenOptions());
+string emitHeader(const ImplicitEquation& equation, const CodegenOptions& options = CodegenOptions());
+
+#endif
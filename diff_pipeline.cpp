@@ -0,0 +1,286 @@
+#ifndef DIFF_PIPELINE_CPP
+#define DIFF_PIPELINE_CPP
+
+#include "diff_pipeline.hpp"
+
+#include "expression_parser.hpp"
+#include "expression_writer.hpp"
+#include "node_arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+using Clock = chrono::steady_clock;
+
+struct PipelineItem {
+    shared_ptr<Exp> expr; // the parsed expression, then its derivative
+    unique_ptr<ImplicitEquation> equation;
+    string error;
+    Clock::time_point started;
+    bool blank = false;
+};
+
+struct Batch {
+    size_t sequence = 0;
+    unique_ptr<string> storage; // owns the text behind lines when it came from a stream
+    vector<string_view> lines;
+    vector<PipelineItem> items;
+    string output;
+    vector<float> latencies; // microseconds, one per non-blank line
+    size_t errors = 0;
+};
+
+using BatchQueue = BoundedQueue<unique_ptr<Batch>>;
+
+// Appends up to maxLines newline-terminated lines of text to lines and returns the
+// bytes they span. When last is set an unterminated tail counts as a line as well.
+size_t splitLines(string_view text, size_t maxLines, bool last, vector<string_view>& lines) {
+    size_t pos = 0;
+    while (lines.size() < maxLines && pos < text.size()) {
+        const void* newline = memchr(text.data() + pos, '\n', text.size() - pos);
+        if (!newline) {
+            if (!last) break;
+            lines.push_back(text.substr(pos));
+            pos = text.size();
+            break;
+        }
+        size_t end = static_cast<size_t>(static_cast<const char*>(newline) - text.data());
+        lines.push_back(text.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return pos;
+}
+
+bool isBlank(string_view line) {
+    for (char c : line) {
+        if (c != ' ' && c != '\t' && c != '\r') return false;
+    }
+    return true;
+}
+
+class DiffPipeline {
+    public:
+        DiffPipeline(ostream& out, const PipelineOptions& options)
+            : out(out),
+              workers(options.threads ? options.threads : max<size_t>(1, thread::hardware_concurrency())),
+              depth(options.queueDepth ? options.queueDepth : 2 * workers),
+              toParse(depth), toDifferentiate(depth), toPrint(depth), toWrite(depth),
+              parseLive(workers), differentiateLive(workers), printLive(workers),
+              window(4 * depth + 3 * workers),
+              begin(Clock::now()) {
+            for (size_t i = 0; i < workers; ++i) {
+                threads.emplace_back([this] {
+                    ExpParser parser;
+                    runStage(toParse, toDifferentiate, parseLive, [&](Batch& b) { parse(parser, b); });
+                });
+                threads.emplace_back([this] {
+                    runStage(toDifferentiate, toPrint, differentiateLive, [](Batch& b) { differentiate(b); });
+                });
+                threads.emplace_back([this] {
+                    runStage(toPrint, toWrite, printLive, [](Batch& b) { print(b); });
+                });
+            }
+            threads.emplace_back([this] { write(); });
+        }
+
+        // Called from one thread. Waits while too many batches are between here and the
+        // writer, so one slow batch cannot make the reorder buffer grow without bound.
+        void submit(unique_ptr<Batch> batch) {
+            {
+                unique_lock<mutex> lk(windowLock);
+                windowOpen.wait(lk, [&] { return submitted - written < window; });
+            }
+            batch->sequence = submitted++;
+            toParse.push(move(batch));
+        }
+
+        PipelineStats finish() {
+            toParse.close();
+            for (auto& t : threads) t.join();
+            out.flush();
+
+            PipelineStats stats;
+            stats.expressions = latencies.size();
+            stats.errors = errors;
+            stats.seconds = chrono::duration<double>(Clock::now() - begin).count();
+            if (!latencies.empty()) {
+                stats.p50Us = percentile(0.50);
+                stats.p99Us = percentile(0.99);
+            }
+            return stats;
+        }
+
+    private:
+        ostream& out;
+        size_t workers;
+        size_t depth;
+        BatchQueue toParse, toDifferentiate, toPrint, toWrite;
+        atomic<size_t> parseLive, differentiateLive, printLive;
+        vector<thread> threads;
+
+        mutex windowLock;
+        condition_variable windowOpen;
+        size_t submitted = 0; // only the submitting thread writes this
+        size_t written = 0;
+        size_t window;
+
+        // Owned by the writer thread until finish() joins it.
+        vector<float> latencies;
+        size_t errors = 0;
+        Clock::time_point begin;
+
+        // The last worker of a stage to run dry closes the next queue.
+        template <class F>
+        static void runStage(BatchQueue& in, BatchQueue& next, atomic<size_t>& live, F work) {
+            NodeArena arena;
+            unique_ptr<Batch> batch;
+            while (in.pop(batch)) {
+                work(*batch);
+                next.push(move(batch));
+            }
+            if (live.fetch_sub(1) == 1) next.close();
+        }
+
+        static void parse(ExpParser& parser, Batch& b) {
+            b.items.resize(b.lines.size());
+            for (size_t i = 0; i < b.lines.size(); ++i) {
+                string_view line = b.lines[i];
+                PipelineItem& item = b.items[i];
+                if (isBlank(line)) {
+                    item.blank = true;
+                    continue;
+                }
+                if (line.back() == '\r') line.remove_suffix(1);
+                item.started = Clock::now();
+                ParseError error;
+                if (line.find('=') != string_view::npos) {
+                    item.equation = parser.parseEquation(line, &error);
+                    if (item.equation) continue;
+                } else {
+                    item.expr = parser.parse(line, &error);
+                    if (item.expr) continue;
+                }
+                item.error = "error at column " + to_string(error.offset + 1) + ": " + error.message;
+                ++b.errors;
+            }
+        }
+
+        // No MemoSession here: on printed input the repeated subtrees are separate
+        // nodes, and the lookups cost more than they save.
+        static void differentiate(Batch& b) {
+            for (PipelineItem& item : b.items) {
+                if (item.equation) {
+                    item.expr = shareNode(item.equation->derivative());
+                    item.equation.reset();
+                } else if (item.expr) {
+                    // derivative() already ends with simplify().
+                    item.expr = shareNode(item.expr->derivative());
+                }
+            }
+        }
+
+        static void print(Batch& b) {
+            b.latencies.reserve(b.items.size());
+            ExpWriter out;
+            for (PipelineItem& item : b.items) {
+                if (item.expr) {
+                    out << *item.expr;
+                } else {
+                    out << item.error;
+                }
+                out << '\n';
+                if (!item.blank) {
+                    b.latencies.push_back(chrono::duration<float, micro>(Clock::now() - item.started).count());
+                }
+            }
+            b.output = out.take();
+            // Free the trees here, in parallel, rather than in the writer.
+            b.items.clear();
+        }
+
+        void write() {
+            map<size_t, unique_ptr<Batch>> pending;
+            size_t next = 0;
+            unique_ptr<Batch> batch;
+            while (toWrite.pop(batch)) {
+                size_t sequence = batch->sequence;
+                pending.emplace(sequence, move(batch));
+                for (auto it = pending.begin(); it != pending.end() && it->first == next; it = pending.erase(it)) {
+                    Batch& b = *it->second;
+                    out.write(b.output.data(), static_cast<streamsize>(b.output.size()));
+                    latencies.insert(latencies.end(), b.latencies.begin(), b.latencies.end());
+                    errors += b.errors;
+                    ++next;
+                    {
+                        lock_guard<mutex> lk(windowLock);
+                        written = next;
+                    }
+                    windowOpen.notify_one();
+                }
+            }
+        }
+
+        double percentile(double q) {
+            size_t k = min(latencies.size() - 1, static_cast<size_t>(q * static_cast<double>(latencies.size())));
+            nth_element(latencies.begin(), latencies.begin() + static_cast<ptrdiff_t>(k), latencies.end());
+            return latencies[k];
+        }
+};
+}
+
+PipelineStats differentiateText(string_view text, ostream& out, const PipelineOptions& options) {
+    DiffPipeline pipeline(out, options);
+    size_t batchLines = max<size_t>(1, options.batchLines);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        auto batch = make_unique<Batch>();
+        pos += splitLines(text.substr(pos), batchLines, true, batch->lines);
+        pipeline.submit(move(batch));
+    }
+    return pipeline.finish();
+}
+
+PipelineStats differentiateStream(FILE* in, ostream& out, const PipelineOptions& options) {
+    DiffPipeline pipeline(out, options);
+    size_t batchLines = max<size_t>(1, options.batchLines);
+    vector<char> block(1 << 20);
+    vector<string_view> probe;
+    string pending;
+    size_t offset = 0;
+    bool eof = false;
+    while (true) {
+        // Hand over whole batches; a short one only once the input has ended.
+        while (true) {
+            probe.clear();
+            size_t used = splitLines(string_view(pending).substr(offset), batchLines, eof, probe);
+            if (probe.empty() || (!eof && probe.size() < batchLines)) break;
+            auto batch = make_unique<Batch>();
+            batch->storage = make_unique<string>(pending, offset, used);
+            splitLines(*batch->storage, batchLines, true, batch->lines);
+            offset += used;
+            pipeline.submit(move(batch));
+        }
+        if (eof) break;
+        pending.erase(0, offset);
+        offset = 0;
+        size_t n = fread(block.data(), 1, block.size(), in);
+        if (n == 0) {
+            eof = true;
+        } else {
+            pending.append(block.data(), n);
+        }
+    }
+    return pipeline.finish();
+}
+
+#endif
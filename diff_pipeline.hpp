@@ -0,0 +1,88 @@
+#ifndef DIFF_PIPELINE_HPP
+#define DIFF_PIPELINE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+
+using namespace std;
+
+// Fixed-capacity multi-producer/multi-consumer queue between pipeline stages.
+// push() blocks while the queue is full, so a slow stage holds back the ones before it.
+template <class T>
+class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity(capacity == 0 ? 1 : capacity) {}
+
+        void push(T item) {
+            unique_lock<mutex> lk(lock);
+            notFull.wait(lk, [&] { return items.size() < capacity; });
+            items.push_back(move(item));
+            lk.unlock();
+            notEmpty.notify_one();
+        }
+
+        // Blocks while empty; false once the queue is closed and has been drained.
+        bool pop(T& item) {
+            unique_lock<mutex> lk(lock);
+            notEmpty.wait(lk, [&] { return !items.empty() || closed; });
+            if (items.empty()) return false;
+            item = move(items.front());
+            items.pop_front();
+            lk.unlock();
+            notFull.notify_one();
+            return true;
+        }
+
+        // No more pushes will come; wakes every consumer waiting in pop().
+        void close() {
+            {
+                lock_guard<mutex> lk(lock);
+                closed = true;
+            }
+            notEmpty.notify_all();
+        }
+
+    private:
+        mutex lock;
+        condition_variable notEmpty;
+        condition_variable notFull;
+        deque<T> items;
+        size_t capacity;
+        bool closed = false;
+};
+
+struct PipelineOptions {
+    size_t threads = 0;      // workers per stage; 0 uses every hardware thread
+    size_t batchLines = 256; // lines handed between stages at a time
+    size_t queueDepth = 0;   // batches each queue holds; 0 means twice the workers
+};
+
+struct PipelineStats {
+    size_t expressions = 0; // non-blank input lines
+    size_t errors = 0;      // lines that did not parse
+    double seconds = 0;
+    double p50Us = 0;       // per-expression latency, parse start to printed
+    double p99Us = 0;
+};
+
+// Differentiates newline-delimited input and writes one line per input line, in input
+// order: the simplified derivative, dy/dx for a line of the form "left = right", an
+// empty line for a blank one, or "error at column N: message".
+//
+// Parse, differentiate + simplify and print run as three stages, each on its own set
+// of worker threads, joined by BoundedQueues of line batches; a writer thread puts
+// the printed batches back in order. Every stage gets the full worker count: threads
+// blocked on a full or empty queue cost nothing, so whichever stage is the bottleneck
+// ends up with the cores.
+//
+// differentiateText() reads from memory that must stay valid until it returns (such
+// as a MappedFile) without copying the lines; differentiateStream() reads a FILE*.
+PipelineStats differentiateText(string_view text, ostream& out, const PipelineOptions& options = {});
+PipelineStats differentiateStream(FILE* in, ostream& out, const PipelineOptions& options = {});
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef EXP_STATS_CPP
+#define EXP_STATS_CPP
+
+#include "exp_stats.hpp"
+
+#include "expression.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+static_assert(expKindCount == static_cast<size_t>(ExpKind::Variable) + 1, "expKindCount is out of date");
+
+static const char* const kindNames[expKindCount] = {
+    "Constant", "VariableX", "VariableY", "DerivativeY", "Power", "Exponential", "AddSub",
+    "Multiply", "Divide", "Polynomial", "ChainRule", "SineComposed", "CosineComposed",
+    "PowerComposed", "ExponentialComposed", "Sine", "Cosine", "Tangent", "Cosecant", "Secant",
+    "Cotangent", "Sqrt", "ArcSine", "ArcCosine", "ArcTangent", "ArcCosecant", "ArcSecant",
+    "ArcCotangent", "Variable"
+};
+static const char* const ruleNames[simplifyRuleCount] = {
+    "poly_fast_path", "constant_fold", "zero_operand", "tan_sec_identity", "common_factor",
+    "variable_from_power"
+};
+
+const char* kindName(ExpKind kind) {
+    return kindNames[static_cast<size_t>(kind)];
+}
+const char* ruleName(SimplifyRule rule) {
+    return ruleNames[static_cast<size_t>(rule)];
+}
+
+static thread_local ExpStats stats;
+
+ExpStats& expStats() {
+    return stats;
+}
+void resetExpStats() {
+    stats = ExpStats();
+}
+
+size_t ExpStats::totalNodes() const {
+    size_t total = 0;
+    for (size_t n : nodes) total += n;
+    return total;
+}
+
+ExpStats& ExpStats::operator+=(const ExpStats& other) {
+    for (size_t k = 0; k < expKindCount; ++k) {
+        derivative[k].calls += other.derivative[k].calls;
+        derivative[k].totalNs += other.derivative[k].totalNs;
+        derivative[k].selfNs += other.derivative[k].selfNs;
+        simplify[k].calls += other.simplify[k].calls;
+        simplify[k].totalNs += other.simplify[k].totalNs;
+        simplify[k].selfNs += other.simplify[k].selfNs;
+        nodes[k] += other.nodes[k];
+    }
+    for (size_t r = 0; r < simplifyRuleCount; ++r) rules[r] += other.rules[r];
+    maxDepth = max(maxDepth, other.maxDepth);
+    return *this;
+}
+
+static void writeTiming(ostream& os, const KindTiming& t) {
+    os << "{\"calls\": " << t.calls << ", \"total_ns\": " << t.totalNs << ", \"self_ns\": " << t.selfNs << "}";
+}
+
+void ExpStats::writeJson(ostream& os) const {
+    os << "{\n  \"enabled\": " << (enabled ? "true" : "false") << ",\n";
+    os << "  \"nodes\": " << totalNodes() << ",\n";
+    os << "  \"max_depth\": " << maxDepth << ",\n";
+    os << "  \"rules\": {";
+    for (size_t r = 0; r < simplifyRuleCount; ++r) {
+        os << (r ? ", " : "") << '"' << ruleNames[r] << "\": " << rules[r];
+    }
+    os << "},\n  \"kinds\": {";
+    bool first = true;
+    for (size_t k = 0; k < expKindCount; ++k) {
+        if (!derivative[k].calls && !simplify[k].calls && !nodes[k]) continue;
+        os << (first ? "\n" : ",\n") << "    \"" << kindNames[k] << "\": {\"nodes\": " << nodes[k] << ", \"derivative\": ";
+        writeTiming(os, derivative[k]);
+        os << ", \"simplify\": ";
+        writeTiming(os, simplify[k]);
+        os << "}";
+        first = false;
+    }
+    os << (first ? "}\n}\n" : "\n  }\n}\n");
+}
+
+#ifdef CALCULUS_STATS
+static thread_local StatsScope* activeScope = nullptr;
+static thread_local size_t depth = 0;
+
+StatsScope::StatsScope(KindTiming& timing) : timing(timing), parent(activeScope), start(chrono::steady_clock::now()) {
+    activeScope = this;
+    if (++depth > stats.maxDepth) stats.maxDepth = depth;
+}
+StatsScope::~StatsScope() {
+    uint64_t elapsed = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    ++timing.calls;
+    timing.totalNs += elapsed;
+    timing.selfNs += elapsed - min(elapsed, childNs);
+    if (parent) parent->childNs += elapsed;
+    activeScope = parent;
+    --depth;
+}
+#endif
+
+#endif
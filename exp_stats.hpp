@@ -0,0 +1,98 @@
+#ifndef EXP_STATS_HPP
+#define EXP_STATS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+using namespace std;
+
+enum class ExpKind : uint8_t;
+const size_t expKindCount = 29;
+const char* kindName(ExpKind kind);
+
+// The rewrites of AddSub::simplifyNode that the stats count each time one fires.
+enum class SimplifyRule : uint8_t {
+    PolyFastPath,      // both sides fold into one polynomial through toPoly
+    ConstantFold,      // constant +/- constant
+    ZeroOperand,       // e + 0, 0 + e, e - 0, 0 - e
+    TanSecIdentity,    // tan(x)(1 + tan(x)) - sec(x)sec(x), and the mirrored form
+    CommonFactor,      // a*b +/- a*c -> a*(b +/- c)
+    VariableFromPower  // x*a +/- x^n*b -> x*(a +/- x^(n-1)*b)
+};
+const size_t simplifyRuleCount = 6;
+const char* ruleName(SimplifyRule rule);
+
+struct KindTiming {
+    size_t calls = 0;
+    uint64_t totalNs = 0; // children included
+    uint64_t selfNs = 0;  // children excluded
+};
+
+// Per-thread counters and timers for derivative() and simplify(). They are filled in
+// only when the library is built with -DCALCULUS_STATS; without it the hooks below are
+// empty inline functions, the instrumented paths compile to what they were before, and
+// expStats() stays all zeros.
+struct ExpStats {
+    static constexpr bool enabled =
+#ifdef CALCULUS_STATS
+        true;
+#else
+        false;
+#endif
+
+    KindTiming derivative[expKindCount];
+    // Runs of simplifyNode(); nodes the simplified shortcut returned as they were are
+    // counted in SimplifyCounters instead.
+    KindTiming simplify[expKindCount];
+    size_t nodes[expKindCount] = {}; // nodes constructed, clones included
+    size_t rules[simplifyRuleCount] = {};
+    size_t maxDepth = 0; // deepest nesting of derivative() and simplify() calls
+
+    size_t totalNodes() const;
+    // Adds another thread's stats into these.
+    ExpStats& operator+=(const ExpStats& other);
+    // One JSON object; kinds that saw no calls and made no nodes are left out.
+    void writeJson(ostream& os) const;
+};
+
+// This thread's stats.
+ExpStats& expStats();
+void resetExpStats();
+
+inline void countNode(ExpKind kind) {
+#ifdef CALCULUS_STATS
+    ++expStats().nodes[static_cast<size_t>(kind)];
+#else
+    (void)kind;
+#endif
+}
+
+inline void countRule(SimplifyRule rule) {
+#ifdef CALCULUS_STATS
+    ++expStats().rules[static_cast<size_t>(rule)];
+#else
+    (void)rule;
+#endif
+}
+
+#ifdef CALCULUS_STATS
+// Times one derivative() or simplify() call on the stack. Scopes nest per thread, so a
+// scope's self time is its elapsed time less that of the scopes opened inside it.
+class StatsScope {
+    public:
+        explicit StatsScope(KindTiming& timing);
+        ~StatsScope();
+        StatsScope(const StatsScope&) = delete;
+        StatsScope& operator=(const StatsScope&) = delete;
+
+    private:
+        KindTiming& timing;
+        StatsScope* parent;
+        chrono::steady_clock::time_point start;
+        uint64_t childNs = 0;
+};
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef EXP_TRACE_CPP
+#define EXP_TRACE_CPP
+
+#include "exp_trace.hpp"
+
+#include "chain_rule.hpp"
+#include "exp_stats.hpp"
+#include "inverse_trigonometric_functions.hpp"
+#include "polynomials_and_exponential_functions.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+using namespace std;
+
+size_t treeSize(const Exp& expr) {
+    if (uint32_t cached = expr.cachedSize.load(memory_order_relaxed)) return cached;
+    uint64_t total = 1;
+    auto add = [&](const shared_ptr<Exp>& child) { total += treeSize(*child); };
+    switch (expr.kind()) {
+        case ExpKind::AddSub: add(static_cast<const AddSub&>(expr).left); add(static_cast<const AddSub&>(expr).right); break;
+        case ExpKind::Multiply: add(static_cast<const Multiply&>(expr).left); add(static_cast<const Multiply&>(expr).right); break;
+        case ExpKind::Divide: add(static_cast<const Divide&>(expr).left); add(static_cast<const Divide&>(expr).right); break;
+        case ExpKind::ChainRule: add(static_cast<const ChainRule&>(expr).outer); add(static_cast<const ChainRule&>(expr).inner); break;
+        case ExpKind::SineComposed: add(static_cast<const SineComposed&>(expr).arg); break;
+        case ExpKind::CosineComposed: add(static_cast<const CosineComposed&>(expr).arg); break;
+        case ExpKind::PowerComposed: add(static_cast<const PowerComposed&>(expr).arg); break;
+        case ExpKind::ExponentialComposed: add(static_cast<const ExponentialComposed&>(expr).arg); break;
+        case ExpKind::Sqrt: add(static_cast<const Sqrt&>(expr).arg); break;
+        default: break;
+    }
+    uint32_t size = static_cast<uint32_t>(min<uint64_t>(total, UINT32_MAX));
+    expr.cachedSize.store(size, memory_order_relaxed);
+    return size;
+}
+
+namespace {
+struct TraceEvent {
+    uint8_t op;
+    uint8_t kind;
+    uint32_t size;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+// Filled by one thread; count is stored after the event it covers, so a reader that
+// loads it with acquire sees complete events only.
+struct TraceBlock {
+    static const size_t capacity = 4096;
+    TraceEvent events[capacity];
+    atomic<size_t> count{0};
+    atomic<TraceBlock*> next{nullptr};
+};
+
+struct TraceBuffer {
+    uint32_t tid;
+    TraceBlock* first;
+    TraceBlock* last;  // only the owning thread touches last and recorded
+    size_t recorded = 0;
+    atomic<size_t> dropped{0};
+    TraceBuffer* nextBuffer = nullptr;
+};
+
+atomic<TraceBuffer*> buffers{nullptr};
+atomic<uint32_t> nextTid{1};
+atomic<uint64_t> generation{1};
+atomic<size_t> minTreeSize{64};
+atomic<size_t> maxEventsPerThread{1u << 20};
+atomic<int64_t> epochNs{0};
+// The generation is kept beside the pointer rather than read through it, because
+// clearTrace() frees the buffer the pointer may still name.
+thread_local TraceBuffer* localBuffer = nullptr;
+thread_local uint64_t localGeneration = 0;
+
+const char* const opNames[] = {"derivative", "simplify", "substitute"};
+
+uint64_t nowNs() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// This thread's buffer for the current trace, made and linked in on first use.
+TraceBuffer* threadBuffer() {
+    uint64_t current = generation.load(memory_order_acquire);
+    if (localBuffer && localGeneration == current) return localBuffer;
+    auto b = new TraceBuffer;
+    b->tid = nextTid.fetch_add(1, memory_order_relaxed);
+    b->first = b->last = new TraceBlock;
+    b->nextBuffer = buffers.load(memory_order_relaxed);
+    while (!buffers.compare_exchange_weak(b->nextBuffer, b, memory_order_release, memory_order_relaxed)) {
+    }
+    localBuffer = b;
+    localGeneration = current;
+    return b;
+}
+
+template <class F>
+void forEachEvent(const TraceBuffer& b, F f) {
+    for (const TraceBlock* block = b.first; block; block = block->next.load(memory_order_acquire)) {
+        size_t n = block->count.load(memory_order_acquire);
+        for (size_t i = 0; i < n; ++i) f(block->events[i]);
+    }
+}
+}
+
+atomic<bool> traceRunning{false};
+
+void startTrace(const TraceOptions& options) {
+    minTreeSize.store(max<size_t>(1, options.minTreeSize), memory_order_relaxed);
+    maxEventsPerThread.store(options.maxEventsPerThread, memory_order_relaxed);
+    if (!epochNs.load(memory_order_relaxed)) epochNs.store(static_cast<int64_t>(nowNs()), memory_order_relaxed);
+    traceRunning.store(true, memory_order_release);
+}
+void stopTrace() {
+    traceRunning.store(false, memory_order_release);
+}
+
+void clearTrace() {
+    generation.fetch_add(1, memory_order_acq_rel);
+    TraceBuffer* b = buffers.exchange(nullptr, memory_order_acq_rel);
+    while (b) {
+        TraceBlock* block = b->first;
+        while (block) {
+            TraceBlock* next = block->next.load(memory_order_relaxed);
+            delete block;
+            block = next;
+        }
+        TraceBuffer* next = b->nextBuffer;
+        delete b;
+        b = next;
+    }
+    nextTid.store(1, memory_order_relaxed);
+    epochNs.store(traceRunning.load(memory_order_relaxed) ? static_cast<int64_t>(nowNs()) : 0, memory_order_relaxed);
+}
+
+size_t traceEvents() {
+    size_t n = 0;
+    for (TraceBuffer* b = buffers.load(memory_order_acquire); b; b = b->nextBuffer) {
+        forEachEvent(*b, [&](const TraceEvent&) { ++n; });
+    }
+    return n;
+}
+size_t traceDropped() {
+    size_t n = 0;
+    for (TraceBuffer* b = buffers.load(memory_order_acquire); b; b = b->nextBuffer) {
+        n += b->dropped.load(memory_order_relaxed);
+    }
+    return n;
+}
+
+void TraceSpan::begin(TraceOp op, const Exp& node) {
+    size_t n = treeSize(node);
+    if (n < minTreeSize.load(memory_order_relaxed)) return;
+    open = true;
+    this->op = static_cast<uint8_t>(op);
+    kind = static_cast<uint8_t>(node.kind());
+    size = static_cast<uint32_t>(n);
+    startNs = nowNs();
+}
+
+void TraceSpan::end() {
+    uint64_t finished = nowNs();
+    TraceBuffer* b = threadBuffer();
+    if (b->recorded >= maxEventsPerThread.load(memory_order_relaxed)) {
+        b->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    TraceBlock* block = b->last;
+    size_t n = block->count.load(memory_order_relaxed);
+    if (n == TraceBlock::capacity) {
+        auto fresh = new TraceBlock;
+        block->next.store(fresh, memory_order_release);
+        b->last = block = fresh;
+        n = 0;
+    }
+    block->events[n] = TraceEvent{op, kind, size, startNs, finished - startNs};
+    block->count.store(n + 1, memory_order_release);
+    ++b->recorded;
+}
+
+void writeChromeTrace(ostream& os) {
+    uint64_t epoch = static_cast<uint64_t>(epochNs.load(memory_order_relaxed));
+    char buf[64];
+    auto micros = [&](uint64_t ns) {
+        snprintf(buf, sizeof buf, "%.3f", static_cast<double>(ns) / 1000.0);
+        return buf;
+    };
+    os << "{\"traceEvents\": [";
+    const char* separator = "\n";
+    size_t dropped = 0;
+    for (TraceBuffer* b = buffers.load(memory_order_acquire); b; b = b->nextBuffer) {
+        dropped += b->dropped.load(memory_order_relaxed);
+        os << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << b->tid
+           << ", \"args\": {\"name\": \"thread " << b->tid << "\"}}";
+        separator = ",\n";
+        forEachEvent(*b, [&](const TraceEvent& e) {
+            const char* kind = kindName(static_cast<ExpKind>(e.kind));
+            os << ",\n{\"name\": \"" << opNames[e.op] << ' ' << kind << "\", \"cat\": \"" << opNames[e.op]
+               << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << b->tid << ", \"ts\": "
+               << micros(e.startNs - min(epoch, e.startNs));
+            os << ", \"dur\": " << micros(e.durationNs) << ", \"args\": {\"kind\": \"" << kind
+               << "\", \"size\": " << e.size << "}}";
+        });
+    }
+    os << "\n], \"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped\": " << dropped << "}}\n";
+}
+
+bool saveChromeTrace(const string& path, string* error) {
+    ofstream out(path, ios::binary);
+    if (out) writeChromeTrace(out);
+    if (!out) {
+        if (error) *error = path + ": cannot write the trace";
+        return false;
+    }
+    return true;
+}
+
+#endif
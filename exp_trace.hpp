@@ -0,0 +1,75 @@
+#ifndef EXP_TRACE_HPP
+#define EXP_TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+class Exp;
+
+// Nodes in expr counted as a tree, so a node reached through two parents counts twice;
+// capped at UINT32_MAX. Cached on each node after the first call.
+size_t treeSize(const Exp& expr);
+
+enum class TraceOp : uint8_t {
+    Derivative,
+    Simplify,
+    Substitute
+};
+
+struct TraceOptions {
+    size_t minTreeSize = 64;               // calls on smaller trees leave no span
+    size_t maxEventsPerThread = 1u << 20;  // later spans on a full thread are dropped
+};
+
+// Span tracing of derivative(), simplify() and substitute() for a trace viewer. While a
+// trace runs, every such call whose node heads a tree of at least minTreeSize nodes
+// records a span with the node kind, the tree size and the elapsed time. Calls nest, so
+// the spans show which subtree the time went to.
+//
+// Each thread appends to its own buffer without locks; a buffer only ever grows, and
+// every event is published with a release store, so writeChromeTrace() may run while
+// other threads are still recording. With no trace running a call pays one relaxed
+// load.
+void startTrace(const TraceOptions& options = TraceOptions());
+void stopTrace();
+// Drops every recorded span. No thread may be inside a traced call at the time.
+void clearTrace();
+size_t traceEvents();
+size_t traceDropped();
+
+// Chrome Trace Event JSON: one complete ("X") event per span, timestamps in
+// microseconds from startTrace(), one tid per recording thread.
+void writeChromeTrace(ostream& os);
+// False (with the reason in error when given) when the file cannot be written.
+bool saveChromeTrace(const string& path, string* error = nullptr);
+
+extern atomic<bool> traceRunning;
+
+class TraceSpan {
+    public:
+        TraceSpan(TraceOp op, const Exp& node) {
+            if (traceRunning.load(memory_order_relaxed)) begin(op, node);
+        }
+        ~TraceSpan() {
+            if (open) end();
+        }
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+
+    private:
+        bool open = false;
+        uint8_t op;
+        uint8_t kind;
+        uint32_t size;
+        uint64_t startNs;
+
+        void begin(TraceOp op, const Exp& node);
+        void end();
+};
+
+#endif
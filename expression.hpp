@@ -1,22 +1,170 @@
 #ifndef EXPRESSION_HPP
 #define EXPRESSION_HPP
 
+#include "exp_stats.hpp"
+#include "node_arena.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <ostream>
 #include <string>
 
 using namespace std;
 
+class ExpWriter;
+
+// A value and its first derivative with respect to x.
+struct Dual {
+    double value;
+    double deriv;
+};
+
+// One tag per concrete node class, stored on every node so analyses can switch on it
+// instead of probing with dynamic_cast.
+enum class ExpKind : uint8_t {
+    Constant,
+    VariableX,
+    VariableY,
+    DerivativeY,
+    Power,
+    Exponential,
+    AddSub,
+    Multiply,
+    Divide,
+    Polynomial,
+    ChainRule,
+    SineComposed,
+    CosineComposed,
+    PowerComposed,
+    ExponentialComposed,
+    Sine,
+    Cosine,
+    Tangent,
+    Cosecant,
+    Secant,
+    Cotangent,
+    Sqrt,
+    ArcSine,
+    ArcCosine,
+    ArcTangent,
+    ArcCosecant,
+    ArcSecant,
+    ArcCotangent,
+    Variable
+};
+
 class Exp {
     public:
+        explicit Exp(ExpKind k) : nodeKind(k) { countNode(k); }
+        Exp(const Exp& other)
+            : nodeKind(other.nodeKind), simplified(other.simplified),
+              cachedSize(other.cachedSize.load(memory_order_relaxed)),
+              cachedHash(other.cachedHash), hashed(other.hashed) {
+            countNode(nodeKind);
+        }
+        Exp& operator=(const Exp& other) {
+            nodeKind = other.nodeKind;
+            simplified = other.simplified;
+            cachedSize.store(other.cachedSize.load(memory_order_relaxed), memory_order_relaxed);
+            cachedHash = other.cachedHash;
+            hashed = other.hashed;
+            return *this;
+        }
         virtual ~Exp() = default;
-        virtual string toString() const = 0;
-        virtual unique_ptr<Exp> derivative() const = 0;
-        virtual unique_ptr<Exp> simplify() const = 0;
+        ExpKind kind() const { return nodeKind; }
+
+        // Nodes come from the thread's NodeArena while one is active.
+        static void* operator new(size_t bytes) { return NodeArena::allocate(bytes); }
+        static void operator delete(void* p) noexcept { NodeArena::deallocate(p); }
+        // Appends the printed form to out, children included, in one pass.
+        virtual void print(ExpWriter& out) const = 0;
+        string toString() const;
+        // Streams the printed form to os without building it as one string first.
+        void write(ostream& os) const;
+        // Runs derivativeNode(); timed per kind in a CALCULUS_STATS build.
+        unique_ptr<Exp> derivative() const;
+        // Partial derivative with respect to x_var (see multivariable.hpp); var 0 is x,
+        // where it is derivative().
+        unique_ptr<Exp> derivative(uint32_t var) const;
+        // The class's own differentiation rule; callers use derivative().
+        virtual unique_ptr<Exp> derivativeNode() const = 0;
+        // Returns a clone straight away when this node is itself the result of a
+        // simplify(); otherwise runs simplifyNode() and marks what it returns.
+        unique_ptr<Exp> simplify() const;
+        bool isSimplified() const { return simplified; }
+        // The class's own simplification rules; callers use simplify().
+        virtual unique_ptr<Exp> simplifyNode() const = 0;
         virtual double evaluate(double x) const = 0;
-        virtual unique_ptr<Exp> substitute(const shared_ptr<Exp>& replacement) const = 0;
+        // Evaluates n points at once; xs and out must not overlap.
+        virtual void evaluate(const double* xs, double* out, size_t n) const = 0;
+        // Forward-mode evaluation: f(x) and f'(x) in one pass, without building derivative().
+        virtual Dual evaluateWithDerivative(double x) const = 0;
+        // Replaces x with replacement throughout; traced like derivative() and simplify().
+        unique_ptr<Exp> substitute(const shared_ptr<Exp>& replacement) const;
+        // The class's own substitution; callers use substitute().
+        virtual unique_ptr<Exp> substituteNode(const shared_ptr<Exp>& replacement) const = 0;
+        virtual unique_ptr<Exp> clone() const = 0; // shallow: children stay shared
+
+        // Structural hash, computed on first use and cached on the node.
+        size_t hashCode() const {
+            if (!hashed) {
+                cachedHash = computeHashCode();
+                hashed = true;
+            }
+            return cachedHash;
+        }
+        // Structural equality; children are compared with sameExp.
+        virtual bool equals(const Exp& other) const {
+            return nodeKind == other.nodeKind;
+        }
+
+    protected:
+        virtual size_t computeHashCode() const {
+            return static_cast<size_t>(nodeKind);
+        }
+
+    private:
+        friend class ExpArchive; // restores the simplified mark on the nodes it rebuilds
+        friend size_t treeSize(const Exp& expr);
+        ExpKind nodeKind;
+        bool simplified = false;
+        // treeSize(), once computed. Atomic because shared leaves and subtrees are
+        // sized from every thread that traces through them; each writes the same value.
+        mutable atomic<uint32_t> cachedSize{0};
+        mutable size_t cachedHash = 0;
+        mutable bool hashed = false;
 };
 
 using dExp = unique_ptr<Exp>;
 
+// Checked downcast by kind tag: the node as a T, or nullptr when it is another class.
+template <class T>
+const T* as(const Exp* expr) {
+    return expr && expr->kind() == T::Kind ? static_cast<const T*>(expr) : nullptr;
+}
+
+template <class T>
+T* as(Exp* expr) {
+    return expr && expr->kind() == T::Kind ? static_cast<T*>(expr) : nullptr;
+}
+
+template <class T>
+T* as(const shared_ptr<Exp>& expr) {
+    return as<T>(expr.get());
+}
+
+// Pointer compare first, then hash, then a structural walk.
+inline bool sameExp(const Exp& a, const Exp& b) {
+    if (&a == &b) return true;
+    if (a.hashCode() != b.hashCode()) return false;
+    return a.equals(b);
+}
+
+inline bool sameExp(const shared_ptr<Exp>& a, const shared_ptr<Exp>& b) {
+    return sameExp(*a, *b);
+}
+
 
 #endif
@@ -0,0 +1,576 @@
+#ifndef EXPRESSION_ARCHIVE_CPP
+#define EXPRESSION_ARCHIVE_CPP
+
+#include "expression_archive.hpp"
+
+#include "chain_rule.hpp"
+#include "expression_utils.hpp"
+#include "implicit_differentiation.hpp"
+#include "inverse_trigonometric_functions.hpp"
+#include "multivariable.hpp"
+#include "polynomials_and_exponential_functions.hpp"
+#include "trigonometric_functions.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+static const char archiveMagic[8] = {'E', 'X', 'P', 'D', 'A', 'G', 0, 0};
+static const uint32_t archiveVersion = 1;
+static const uint32_t archiveByteOrder = 0x01020304;
+
+static uint64_t doubleBits(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+static size_t alignTo8(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+// The node indices a node points at: none for leaves and numbers, one for the
+// single-argument classes, two for AddSub, Multiply, Divide and ChainRule.
+static int childrenOf(const ArchiveNode& node, uint32_t (&child)[2]) {
+    switch (static_cast<ExpKind>(node.kind)) {
+        case ExpKind::AddSub:
+        case ExpKind::Multiply:
+        case ExpKind::Divide:
+        case ExpKind::ChainRule:
+            child[0] = node.a;
+            child[1] = node.b;
+            return 2;
+        case ExpKind::SineComposed:
+        case ExpKind::CosineComposed:
+        case ExpKind::PowerComposed:
+        case ExpKind::ExponentialComposed:
+        case ExpKind::Sqrt:
+            child[0] = node.a;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+size_t ExpArchiveWriter::KeyHash::operator()(const Key& k) const {
+    size_t h = hashCombine(k.kind, k.flags);
+    h = hashCombine(h, k.a);
+    h = hashCombine(h, k.b);
+    return hashCombine(h, hash<uint64_t>()(k.bits));
+}
+
+size_t ExpArchiveWriter::add(const shared_ptr<Exp>& expr) {
+    kept.push_back(expr);
+    rootTable.push_back(write(expr));
+    return rootTable.size() - 1;
+}
+
+uint32_t ExpArchiveWriter::fraction(const Rational& r, uint8_t& flags) {
+    if (!r.isSmall()) {
+        flags |= ArchiveExactBig;
+        string digits = r.toString();
+        auto it = bigIndex.find(digits);
+        if (it != bigIndex.end()) return it->second;
+        uint32_t index = static_cast<uint32_t>(bigTable.size());
+        bigTable.push_back(ArchiveBig{static_cast<uint32_t>(text.size()), static_cast<uint32_t>(digits.size())});
+        text += digits;
+        bigIndex.emplace(move(digits), index);
+        return index;
+    }
+    flags |= ArchiveExact;
+    auto key = make_pair(static_cast<int64_t>(r.num()), static_cast<int64_t>(r.den()));
+    auto it = fractionIndex.find(key);
+    if (it != fractionIndex.end()) return it->second;
+    uint32_t index = static_cast<uint32_t>(fractionTable.size());
+    fractionTable.push_back(ArchiveFraction{key.first, key.second});
+    fractionIndex.emplace(key, index);
+    return index;
+}
+
+// A run equal to one written before is shared, so equal polynomials key the same.
+uint32_t ExpArchiveWriter::terms(const Poly& poly, uint32_t& count) {
+    vector<ArchiveTerm> run;
+    size_t h = 0;
+    for (size_t i = 0; i < poly.size(); ++i) {
+        double c = poly.coefficientAt(i);
+        if (c == 0.0) continue;
+        run.push_back(ArchiveTerm{poly.degreeAt(i), c});
+        h = hashCombine(hashCombine(h, static_cast<size_t>(poly.degreeAt(i))), hash<uint64_t>()(doubleBits(c)));
+    }
+    count = static_cast<uint32_t>(run.size());
+    vector<pair<uint32_t, uint32_t>>& candidates = termRuns[h];
+    for (auto [first, length] : candidates) {
+        if (length == count && memcmp(&termTable[first], run.data(), run.size() * sizeof(ArchiveTerm)) == 0) {
+            return first;
+        }
+    }
+    uint32_t first = static_cast<uint32_t>(termTable.size());
+    termTable.insert(termTable.end(), run.begin(), run.end());
+    candidates.emplace_back(first, count);
+    return first;
+}
+
+uint32_t ExpArchiveWriter::write(const shared_ptr<Exp>& source) {
+    const Exp& expr = *source;
+    // A node only its parent points at cannot come round again, so it skips the
+    // pointer map; most nodes of a derivative are like that.
+    bool shared = source.use_count() > 1;
+    if (shared) {
+        auto seen = written.find(&expr);
+        if (seen != written.end()) return seen->second;
+    }
+
+    ArchiveNode node{};
+    node.kind = static_cast<uint8_t>(expr.kind());
+    if (expr.isSimplified()) node.flags |= ArchiveSimplified;
+    switch (expr.kind()) {
+        case ExpKind::Constant: {
+            auto c = static_cast<const Constant*>(&expr);
+            node.value = c->value;
+            if (c->hasFraction) node.a = fraction(c->fraction, node.flags);
+            break;
+        }
+        case ExpKind::Power: {
+            auto p = static_cast<const Power*>(&expr);
+            node.value = p->exponent;
+            if (p->hasFraction) node.a = fraction(p->fraction, node.flags);
+            break;
+        }
+        case ExpKind::Exponential:
+            node.value = static_cast<const Exponential*>(&expr)->coefficient;
+            break;
+        case ExpKind::AddSub: {
+            auto add = static_cast<const AddSub*>(&expr);
+            node.a = write(add->left);
+            node.b = write(add->right);
+            if (add->op == '-') node.flags |= ArchiveMinus;
+            break;
+        }
+        case ExpKind::Multiply: {
+            auto mul = static_cast<const Multiply*>(&expr);
+            node.a = write(mul->left);
+            node.b = write(mul->right);
+            break;
+        }
+        case ExpKind::Divide: {
+            auto div = static_cast<const Divide*>(&expr);
+            node.a = write(div->left);
+            node.b = write(div->right);
+            break;
+        }
+        case ExpKind::ChainRule: {
+            auto chain = static_cast<const ChainRule*>(&expr);
+            node.a = write(chain->outer);
+            node.b = write(chain->inner);
+            break;
+        }
+        case ExpKind::SineComposed: node.a = write(static_cast<const SineComposed*>(&expr)->arg); break;
+        case ExpKind::CosineComposed: node.a = write(static_cast<const CosineComposed*>(&expr)->arg); break;
+        case ExpKind::ExponentialComposed: node.a = write(static_cast<const ExponentialComposed*>(&expr)->arg); break;
+        case ExpKind::Sqrt: node.a = write(static_cast<const Sqrt*>(&expr)->arg); break;
+        case ExpKind::PowerComposed: {
+            auto p = static_cast<const PowerComposed*>(&expr);
+            node.a = write(p->arg);
+            node.value = p->exponent;
+            if (p->hasFraction) node.b = fraction(p->fraction, node.flags);
+            break;
+        }
+        case ExpKind::Polynomial: node.a = terms(static_cast<const Polynomial*>(&expr)->poly, node.b); break;
+        case ExpKind::Variable: node.a = static_cast<const Variable*>(&expr)->index; break;
+        default:
+            break;
+    }
+    Key key{node.kind, node.flags, node.a, node.b, doubleBits(node.value)};
+    auto it = numbered.find(key);
+    uint32_t index;
+    if (it != numbered.end()) {
+        index = it->second;
+    } else {
+        index = static_cast<uint32_t>(table.size());
+        table.push_back(node);
+        numbered.emplace(key, index);
+    }
+    if (shared) written.emplace(&expr, index);
+    return index;
+}
+
+string ExpArchiveWriter::bytes() const {
+    ArchiveHeader header{};
+    memcpy(header.magic, archiveMagic, sizeof(archiveMagic));
+    header.version = archiveVersion;
+    header.byteOrder = archiveByteOrder;
+    header.nodeCount = static_cast<uint32_t>(table.size());
+    header.rootCount = static_cast<uint32_t>(rootTable.size());
+    header.fractionCount = static_cast<uint32_t>(fractionTable.size());
+    header.bigCount = static_cast<uint32_t>(bigTable.size());
+    header.termCount = static_cast<uint32_t>(termTable.size());
+    header.textBytes = static_cast<uint32_t>(text.size());
+
+    size_t at = alignTo8(sizeof(ArchiveHeader));
+    header.nodesAt = at;
+    at = alignTo8(at + table.size() * sizeof(ArchiveNode));
+    header.rootsAt = at;
+    at = alignTo8(at + rootTable.size() * sizeof(uint32_t));
+    header.fractionsAt = at;
+    at = alignTo8(at + fractionTable.size() * sizeof(ArchiveFraction));
+    header.bigsAt = at;
+    at = alignTo8(at + bigTable.size() * sizeof(ArchiveBig));
+    header.termsAt = at;
+    at = alignTo8(at + termTable.size() * sizeof(ArchiveTerm));
+    header.textAt = at;
+    at += text.size();
+
+    string out(at, '\0');
+    memcpy(&out[0], &header, sizeof(header));
+    if (!table.empty()) memcpy(&out[header.nodesAt], table.data(), table.size() * sizeof(ArchiveNode));
+    if (!rootTable.empty()) memcpy(&out[header.rootsAt], rootTable.data(), rootTable.size() * sizeof(uint32_t));
+    if (!fractionTable.empty()) {
+        memcpy(&out[header.fractionsAt], fractionTable.data(), fractionTable.size() * sizeof(ArchiveFraction));
+    }
+    if (!bigTable.empty()) memcpy(&out[header.bigsAt], bigTable.data(), bigTable.size() * sizeof(ArchiveBig));
+    if (!termTable.empty()) memcpy(&out[header.termsAt], termTable.data(), termTable.size() * sizeof(ArchiveTerm));
+    if (!text.empty()) memcpy(&out[header.textAt], text.data(), text.size());
+    return out;
+}
+
+bool ExpArchiveWriter::save(const string& path, string* error) const {
+    string image = bytes();
+    FILE* f = fopen(path.c_str(), "wb");
+    bool ok = f && fwrite(image.data(), 1, image.size(), f) == image.size();
+    int code = errno;
+    if (f && fclose(f) != 0 && ok) {
+        ok = false;
+        code = errno;
+    }
+    if (!ok && error) *error = path + ": " + strerror(code);
+    return ok;
+}
+
+bool ExpArchive::fail(const string& message) {
+    reason = message;
+    table = nullptr;
+    rootTable = nullptr;
+    fractionTable = nullptr;
+    bigTable = nullptr;
+    termTable = nullptr;
+    text = nullptr;
+    nodeCount = 0;
+    rootCount = 0;
+    return false;
+}
+
+bool ExpArchive::open(const string& path) {
+    close();
+    if (!file.open(path)) return fail(file.error());
+    if (!validate(file.text())) {
+        file.close();
+        reason = path + ": " + reason;
+        return false;
+    }
+    return true;
+}
+
+bool ExpArchive::load(string_view bytes) {
+    close();
+    return validate(bytes);
+}
+
+void ExpArchive::close() {
+    file.close();
+    built.clear();
+    fail("");
+}
+
+bool ExpArchive::validate(string_view bytes) {
+    if (reinterpret_cast<uintptr_t>(bytes.data()) % 8 != 0) return fail("archive bytes are not 8-byte aligned");
+    if (bytes.size() < sizeof(ArchiveHeader)) return fail("too short for an archive header");
+    const ArchiveHeader& header = *reinterpret_cast<const ArchiveHeader*>(bytes.data());
+    if (memcmp(header.magic, archiveMagic, sizeof(archiveMagic)) != 0) return fail("not an expression archive");
+    if (header.byteOrder != archiveByteOrder) return fail("archive was written with the other byte order");
+    if (header.version != archiveVersion) {
+        return fail("archive version " + to_string(header.version) + " is not supported");
+    }
+    auto section = [&](uint64_t at, uint64_t count, uint64_t recordSize) {
+        return at % 8 == 0 && at <= bytes.size() && count * recordSize <= bytes.size() - at;
+    };
+    if (!section(header.nodesAt, header.nodeCount, sizeof(ArchiveNode)) ||
+        !section(header.rootsAt, header.rootCount, sizeof(uint32_t)) ||
+        !section(header.fractionsAt, header.fractionCount, sizeof(ArchiveFraction)) ||
+        !section(header.bigsAt, header.bigCount, sizeof(ArchiveBig)) ||
+        !section(header.termsAt, header.termCount, sizeof(ArchiveTerm)) ||
+        !section(header.textAt, header.textBytes, 1)) {
+        return fail("archive section out of bounds");
+    }
+
+    const ArchiveNode* nodes = reinterpret_cast<const ArchiveNode*>(bytes.data() + header.nodesAt);
+    const uint32_t* roots = reinterpret_cast<const uint32_t*>(bytes.data() + header.rootsAt);
+    const ArchiveFraction* fractions = reinterpret_cast<const ArchiveFraction*>(bytes.data() + header.fractionsAt);
+    const ArchiveBig* bigs = reinterpret_cast<const ArchiveBig*>(bytes.data() + header.bigsAt);
+    const ArchiveTerm* terms = reinterpret_cast<const ArchiveTerm*>(bytes.data() + header.termsAt);
+    const char* chars = bytes.data() + header.textAt;
+
+    for (uint32_t i = 0; i < header.fractionCount; ++i) {
+        if (fractions[i].den <= 0) return fail("fraction " + to_string(i) + ": denominator below 1");
+    }
+    for (uint32_t i = 0; i < header.bigCount; ++i) {
+        Rational r;
+        if (static_cast<uint64_t>(bigs[i].at) + bigs[i].length > header.textBytes ||
+            !Rational::parse(string_view(chars + bigs[i].at, bigs[i].length), r)) {
+            return fail("big fraction " + to_string(i) + " is not a fraction");
+        }
+    }
+
+    for (uint32_t i = 0; i < header.nodeCount; ++i) {
+        const ArchiveNode& node = nodes[i];
+        string where = "node " + to_string(i) + ": ";
+        if (node.kind > static_cast<uint8_t>(ExpKind::Variable)) return fail(where + "unknown kind");
+        ExpKind kind = static_cast<ExpKind>(node.kind);
+        uint32_t child[2];
+        int count = childrenOf(node, child);
+        for (int c = 0; c < count; ++c) {
+            // Children before parents also rules out cycles.
+            if (child[c] >= i) return fail(where + "child does not come before it");
+        }
+        if (node.flags & (ArchiveExact | ArchiveExactBig)) {
+            uint32_t f = kind == ExpKind::PowerComposed ? node.b : node.a;
+            bool numeric = kind == ExpKind::Constant || kind == ExpKind::Power || kind == ExpKind::PowerComposed;
+            uint32_t count = (node.flags & ArchiveExactBig) ? header.bigCount : header.fractionCount;
+            bool both = (node.flags & ArchiveExact) && (node.flags & ArchiveExactBig);
+            if (!numeric || both || f >= count) return fail(where + "bad fraction");
+        }
+        if (kind == ExpKind::Variable && node.a == 0) return fail(where + "variable 0 is x");
+        if (kind == ExpKind::Polynomial) {
+            if (static_cast<uint64_t>(node.a) + node.b > header.termCount) return fail(where + "terms out of bounds");
+            for (uint32_t t = node.a; t < node.a + node.b; ++t) {
+                if (terms[t].degree < 0 || terms[t].degree > INT32_MAX) return fail(where + "bad degree");
+            }
+        }
+    }
+    for (uint32_t r = 0; r < header.rootCount; ++r) {
+        if (roots[r] >= header.nodeCount) return fail("root " + to_string(r) + " out of bounds");
+    }
+
+    table = nodes;
+    rootTable = roots;
+    fractionTable = fractions;
+    bigTable = bigs;
+    termTable = terms;
+    text = chars;
+    nodeCount = header.nodeCount;
+    rootCount = header.rootCount;
+    built.assign(nodeCount, nullptr);
+    reason.clear();
+    return true;
+}
+
+shared_ptr<Exp> ExpArchive::root(size_t index) {
+    if (index >= rootCount) return nullptr;
+    return build(rootTable[index]);
+}
+
+shared_ptr<Exp> ExpArchive::build(uint32_t index) {
+    if (built[index]) return built[index];
+    const ArchiveNode& node = table[index];
+    bool exact = (node.flags & (ArchiveExact | ArchiveExactBig)) != 0;
+    shared_ptr<Exp> e;
+    switch (static_cast<ExpKind>(node.kind)) {
+        case ExpKind::Constant:
+            e = exact ? makeNode<Constant>(fraction(node, node.a)) : makeNode<Constant>(node.value);
+            break;
+        case ExpKind::VariableX: e = makeNode<VariableX>(); break;
+        case ExpKind::VariableY: e = makeNode<VariableY>(); break;
+        case ExpKind::DerivativeY: e = makeNode<DerivativeY>(); break;
+        case ExpKind::Power:
+            e = exact ? makeNode<Power>(fraction(node, node.a)) : makeNode<Power>(node.value);
+            break;
+        case ExpKind::Exponential: e = makeNode<Exponential>(node.value); break;
+        case ExpKind::AddSub:
+            e = makeNode<AddSub>(build(node.a), build(node.b), (node.flags & ArchiveMinus) ? '-' : '+');
+            break;
+        case ExpKind::Multiply: e = makeNode<Multiply>(build(node.a), build(node.b)); break;
+        case ExpKind::Divide: e = makeNode<Divide>(build(node.a), build(node.b)); break;
+        case ExpKind::Polynomial: {
+            vector<pair<int, double>> terms;
+            terms.reserve(node.b);
+            for (uint32_t t = node.a; t < node.a + node.b; ++t) {
+                terms.emplace_back(static_cast<int>(termTable[t].degree), termTable[t].coefficient);
+            }
+            e = makeNode<Polynomial>(Poly::fromTerms(move(terms)));
+            break;
+        }
+        case ExpKind::ChainRule: e = makeNode<ChainRule>(build(node.a), build(node.b)); break;
+        case ExpKind::SineComposed: e = makeNode<SineComposed>(build(node.a)); break;
+        case ExpKind::CosineComposed: e = makeNode<CosineComposed>(build(node.a)); break;
+        case ExpKind::PowerComposed:
+            if (exact) {
+                e = makeNode<PowerComposed>(build(node.a), fraction(node, node.b));
+            } else {
+                e = makeNode<PowerComposed>(build(node.a), node.value);
+            }
+            break;
+        case ExpKind::ExponentialComposed: e = makeNode<ExponentialComposed>(build(node.a)); break;
+        case ExpKind::Sine: e = makeNode<Sine>(); break;
+        case ExpKind::Cosine: e = makeNode<Cosine>(); break;
+        case ExpKind::Tangent: e = makeNode<Tangent>(); break;
+        case ExpKind::Cosecant: e = makeNode<Cosecant>(); break;
+        case ExpKind::Secant: e = makeNode<Secant>(); break;
+        case ExpKind::Cotangent: e = makeNode<Cotangent>(); break;
+        case ExpKind::Sqrt: e = makeNode<Sqrt>(build(node.a)); break;
+        case ExpKind::ArcSine: e = makeNode<ArcSine>(); break;
+        case ExpKind::ArcCosine: e = makeNode<ArcCosine>(); break;
+        case ExpKind::ArcTangent: e = makeNode<ArcTangent>(); break;
+        case ExpKind::ArcCosecant: e = makeNode<ArcCosecant>(); break;
+        case ExpKind::ArcSecant: e = makeNode<ArcSecant>(); break;
+        case ExpKind::ArcCotangent: e = makeNode<ArcCotangent>(); break;
+        case ExpKind::Variable: e = makeVariable(node.a); break;
+    }
+    e->simplified = (node.flags & ArchiveSimplified) != 0;
+    built[index] = e;
+    return e;
+}
+
+Rational ExpArchive::fraction(const ArchiveNode& node, uint32_t index) const {
+    if (node.flags & ArchiveExact) return Rational(fractionTable[index].num, fractionTable[index].den);
+    Rational r;
+    Rational::parse(string_view(text + bigTable[index].at, bigTable[index].length), r);
+    return r;
+}
+
+// Same order of operations as Polynomial::evaluate.
+double ExpArchive::polynomialAt(const ArchiveNode& node, double x) const {
+    double acc = 0.0;
+    int prev = -1;
+    for (uint32_t t = node.a + node.b; t-- > node.a;) {
+        double c = termTable[t].coefficient;
+        if (c == 0.0) continue;
+        int d = static_cast<int>(termTable[t].degree);
+        if (prev >= 0) acc *= prev - d == 1 ? x : pow(x, prev - d);
+        acc += c;
+        prev = d;
+    }
+    if (prev > 0) acc *= prev == 1 ? x : pow(x, prev);
+    return acc;
+}
+
+// The value of a node other than ChainRule, given its children's values a and b; each
+// case is the matching class's evaluate(double).
+static double nodeValue(const ArchiveNode& node, double x, double a, double b) {
+    switch (static_cast<ExpKind>(node.kind)) {
+        case ExpKind::Constant: return node.value;
+        case ExpKind::VariableX: return x;
+        case ExpKind::VariableY: return NAN;
+        case ExpKind::DerivativeY: return NAN;
+        case ExpKind::Power: return pow(x, node.value);
+        case ExpKind::Exponential: return exp(node.value * x);
+        case ExpKind::AddSub: return (node.flags & ArchiveMinus) ? a - b : a + b;
+        case ExpKind::Multiply: return a * b;
+        case ExpKind::Divide: return b == 0 ? NAN : a / b;
+        case ExpKind::SineComposed: return sin(a);
+        case ExpKind::CosineComposed: return cos(a);
+        case ExpKind::PowerComposed: return pow(a, node.value);
+        case ExpKind::ExponentialComposed: return exp(a);
+        case ExpKind::Sqrt: return sqrt(a);
+        case ExpKind::Sine: return sin(x);
+        case ExpKind::Cosine: return cos(x);
+        case ExpKind::Tangent: return tan(x);
+        case ExpKind::Cosecant: return 1.0 / sin(x);
+        case ExpKind::Secant: return 1.0 / cos(x);
+        case ExpKind::Cotangent: return 1.0 / tan(x);
+        case ExpKind::ArcSine: return asin(x);
+        case ExpKind::ArcCosine: return acos(x);
+        case ExpKind::ArcTangent: return atan(x);
+        case ExpKind::ArcCosecant: return asin(1.0 / x);
+        case ExpKind::ArcSecant: return acos(1.0 / x);
+        case ExpKind::ArcCotangent: return atan(1.0 / x);
+        case ExpKind::Variable: return variableValue(node.a);
+        case ExpKind::Polynomial:
+        case ExpKind::ChainRule:
+            break;
+    }
+    return NAN;
+}
+
+// Plain recursion for the outer function of a ChainRule, which sees a different x
+// from the rest of the walk; in practice it is a single leaf such as sin(x).
+double ExpArchive::evaluateAt(uint32_t index, double x) const {
+    const ArchiveNode& node = table[index];
+    ExpKind kind = static_cast<ExpKind>(node.kind);
+    if (kind == ExpKind::ChainRule) return evaluateAt(node.a, evaluateAt(node.b, x));
+    if (kind == ExpKind::Polynomial) return polynomialAt(node, x);
+    uint32_t child[2];
+    int count = childrenOf(node, child);
+    double a = count > 0 ? evaluateAt(child[0], x) : 0.0;
+    double b = count > 1 ? evaluateAt(child[1], x) : 0.0;
+    return nodeValue(node, x, a, b);
+}
+
+// Every node the root reaches at the root's x, once each and children first. A
+// ChainRule's outer function is left out; run() evaluates it at the inner value.
+vector<ExpArchive::Step> ExpArchive::plan(uint32_t index) const {
+    vector<char> reached(index + 1, 0);
+    reached[index] = 1;
+    for (uint32_t i = index + 1; i-- > 0;) {
+        if (!reached[i]) continue;
+        const ArchiveNode& node = table[i];
+        if (static_cast<ExpKind>(node.kind) == ExpKind::ChainRule) {
+            reached[node.b] = 1;
+            continue;
+        }
+        uint32_t child[2];
+        int count = childrenOf(node, child);
+        for (int c = 0; c < count; ++c) reached[child[c]] = 1;
+    }
+    vector<uint32_t> stepOf(index + 1, 0);
+    vector<Step> steps;
+    for (uint32_t i = 0; i <= index; ++i) {
+        if (!reached[i]) continue;
+        const ArchiveNode& node = table[i];
+        Step step{i, 0, 0};
+        if (static_cast<ExpKind>(node.kind) == ExpKind::ChainRule) {
+            step.b = stepOf[node.b];
+        } else {
+            uint32_t child[2];
+            int count = childrenOf(node, child);
+            if (count > 0) step.a = stepOf[child[0]];
+            if (count > 1) step.b = stepOf[child[1]];
+        }
+        stepOf[i] = static_cast<uint32_t>(steps.size());
+        steps.push_back(step);
+    }
+    return steps;
+}
+
+double ExpArchive::run(const vector<Step>& steps, vector<double>& values, double x) const {
+    for (size_t k = 0; k < steps.size(); ++k) {
+        const Step& step = steps[k];
+        const ArchiveNode& node = table[step.node];
+        switch (static_cast<ExpKind>(node.kind)) {
+            case ExpKind::ChainRule: values[k] = evaluateAt(node.a, values[step.b]); break;
+            case ExpKind::Polynomial: values[k] = polynomialAt(node, x); break;
+            default: values[k] = nodeValue(node, x, values[step.a], values[step.b]); break;
+        }
+    }
+    return values.back();
+}
+
+double ExpArchive::evaluate(size_t index, double x) const {
+    if (index >= rootCount) return NAN;
+    vector<Step> steps = plan(rootTable[index]);
+    vector<double> values(steps.size(), 0.0);
+    return run(steps, values, x);
+}
+
+void ExpArchive::evaluate(size_t index, const double* xs, double* out, size_t n) const {
+    if (index >= rootCount) {
+        fill(out, out + n, NAN);
+        return;
+    }
+    vector<Step> steps = plan(rootTable[index]);
+    vector<double> values(steps.size(), 0.0);
+    for (size_t i = 0; i < n; ++i) out[i] = run(steps, values, xs[i]);
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef EXPRESSION_ARCHIVE_HPP
+#define EXPRESSION_ARCHIVE_HPP
+
+#include "expression.hpp"
+#include "mapped_file.hpp"
+#include "poly_kernel.hpp"
+#include "rational.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// On-disk layout, version 1. Every section starts on an 8-byte boundary and is read in
+// place, so the file is meant for the machine byte order it was written in (byteOrder
+// tells the reader when it was not).
+//
+//   ArchiveHeader
+//   ArchiveNode     nodes[nodeCount]      children always come before their parents
+//   uint32_t        roots[rootCount]      one node index per added expression
+//   ArchiveFraction fractions[fractionCount]
+//   ArchiveBig      bigs[bigCount]        fractions past 64 bits, as Rational::toString() text
+//   ArchiveTerm     terms[termCount]      Polynomial coefficients, in runs
+//   char            text[textBytes]       what the bigs point into
+struct ArchiveHeader {
+    char magic[8];     // "EXPDAG\0\0"
+    uint32_t version;
+    uint32_t byteOrder; // 0x01020304 as the writer stored it
+    uint32_t nodeCount;
+    uint32_t rootCount;
+    uint32_t fractionCount;
+    uint32_t bigCount;
+    uint32_t termCount;
+    uint32_t textBytes;
+    uint32_t reserved;
+    uint64_t nodesAt;   // byte offsets from the start of the file
+    uint64_t rootsAt;
+    uint64_t fractionsAt;
+    uint64_t bigsAt;
+    uint64_t termsAt;
+    uint64_t textAt;
+};
+
+// One node, by kind:
+//   Constant, Power             value; a = fraction (or big) index when exact
+//   Exponential                 value = coefficient
+//   AddSub, Multiply, Divide    a = left, b = right
+//   ChainRule                   a = outer, b = inner
+//   *Composed, Sqrt             a = argument; PowerComposed: value = exponent, b = fraction
+//   Polynomial                  a = first term, b = number of terms
+//   Variable                    a = index
+//   the leaves of x and y       nothing
+struct ArchiveNode {
+    uint8_t kind;       // ExpKind
+    uint8_t flags;      // ArchiveExact | ArchiveExactBig | ArchiveMinus | ArchiveSimplified
+    uint16_t reserved;
+    uint32_t a;
+    uint32_t b;
+    uint32_t padding;
+    double value;
+};
+
+enum : uint8_t {
+    ArchiveExact = 1,      // the number is also held exactly in fractions
+    ArchiveExactBig = 2,   // the number is also held exactly in bigs
+    ArchiveMinus = 4,      // AddSub with op '-'
+    ArchiveSimplified = 8  // the node came out of simplify()
+};
+
+struct ArchiveFraction {
+    int64_t num;
+    int64_t den;
+};
+
+struct ArchiveBig {
+    uint32_t at; // offset into text
+    uint32_t length;
+};
+
+struct ArchiveTerm {
+    int64_t degree;
+    double coefficient;
+};
+
+// Collects expressions into an archive image. Equal subtrees, whether they are one
+// shared node or separate copies, are written once: a node goes in only after its
+// children, so two nodes with the same kind, flags, children and numbers are the same
+// subtree and the second one reuses the first one's index.
+class ExpArchiveWriter {
+    public:
+        // Adds expr as the next root and returns its root index.
+        size_t add(const shared_ptr<Exp>& expr);
+
+        size_t roots() const { return rootTable.size(); }
+        size_t nodes() const { return table.size(); }
+
+        string bytes() const;
+        // False (with the reason in error when given) when the file cannot be written.
+        bool save(const string& path, string* error = nullptr) const;
+
+    private:
+        struct Key {
+            uint8_t kind;
+            uint8_t flags;
+            uint32_t a;
+            uint32_t b;
+            uint64_t bits;
+            bool operator==(const Key& o) const {
+                return kind == o.kind && flags == o.flags && a == o.a && b == o.b && bits == o.bits;
+            }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& k) const;
+        };
+
+        vector<ArchiveNode> table;
+        vector<uint32_t> rootTable;
+        vector<ArchiveFraction> fractionTable;
+        vector<ArchiveBig> bigTable;
+        vector<ArchiveTerm> termTable;
+        string text;
+        vector<shared_ptr<Exp>> kept; // the added roots, so the keys of written stay valid
+        unordered_map<const Exp*, uint32_t> written;
+        unordered_map<Key, uint32_t, KeyHash> numbered;
+        map<pair<int64_t, int64_t>, uint32_t> fractionIndex;
+        unordered_map<string, uint32_t> bigIndex;
+        unordered_map<size_t, vector<pair<uint32_t, uint32_t>>> termRuns; // run hash -> (first, count)
+
+        uint32_t write(const shared_ptr<Exp>& source);
+        uint32_t fraction(const Rational& r, uint8_t& flags);
+        uint32_t terms(const Poly& poly, uint32_t& count);
+};
+
+// Read-only view of an archive image. open() maps the file and checks every record up
+// front, so nothing after it reads out of bounds or loops; the tables are then used in
+// place without copying.
+//
+// root() rebuilds Exp objects on first use, only for the nodes that root reaches, and
+// hands the same node to every root that shares it. evaluate() works straight off the
+// node table and never builds an Exp; it gives the same values as Exp::evaluate on the
+// rebuilt tree. root() is not thread-safe; evaluate() is const and may run concurrently.
+class ExpArchive {
+    public:
+        ExpArchive() = default;
+        ExpArchive(const ExpArchive&) = delete;
+        ExpArchive& operator=(const ExpArchive&) = delete;
+
+        // False (with the reason in error()) when the file cannot be mapped or is not a
+        // valid archive.
+        bool open(const string& path);
+        // The same over bytes the caller keeps alive, which must be 8-byte aligned.
+        bool load(string_view bytes);
+        void close();
+        const string& error() const { return reason; }
+
+        size_t roots() const { return rootCount; }
+        size_t nodes() const { return nodeCount; }
+
+        shared_ptr<Exp> root(size_t index);
+
+        double evaluate(size_t index, double x) const;
+        // Evaluates n points; the walk over the table is planned once for all of them.
+        void evaluate(size_t index, const double* xs, double* out, size_t n) const;
+
+    private:
+        // One node of the walk; a and b index earlier steps, not nodes.
+        struct Step {
+            uint32_t node;
+            uint32_t a;
+            uint32_t b;
+        };
+
+        MappedFile file;
+        const ArchiveNode* table = nullptr;
+        const uint32_t* rootTable = nullptr;
+        const ArchiveFraction* fractionTable = nullptr;
+        const ArchiveBig* bigTable = nullptr;
+        const ArchiveTerm* termTable = nullptr;
+        const char* text = nullptr;
+        size_t nodeCount = 0;
+        size_t rootCount = 0;
+        vector<shared_ptr<Exp>> built;
+        string reason;
+
+        bool fail(const string& message);
+        bool validate(string_view bytes);
+        shared_ptr<Exp> build(uint32_t index);
+        Rational fraction(const ArchiveNode& node, uint32_t index) const;
+        vector<Step> plan(uint32_t index) const;
+        double run(const vector<Step>& steps, vector<double>& values, double x) const;
+        double evaluateAt(uint32_t index, double x) const;
+        double polynomialAt(const ArchiveNode& node, double x) const;
+};
+
+#endif
@@ -0,0 +1,391 @@
+#ifndef EXPRESSION_PARSER_CPP
+#define EXPRESSION_PARSER_CPP
+
+#include "expression_parser.hpp"
+
+#include "chain_rule.hpp"
+#include "inverse_trigonometric_functions.hpp"
+#include "multivariable.hpp"
+#include "polynomials_and_exponential_functions.hpp"
+#include "trigonometric_functions.hpp"
+
+#include <charconv>
+#include <cmath>
+
+using namespace std;
+
+// Index order matches ExpParser::leaves: the six trig names, the same six with
+// "arc" in front, then sqrt.
+static const char trigNames[6][4] = {"sin", "cos", "tan", "csc", "sec", "cot"};
+static const int sqrtIndex = 12;
+
+static int functionIndex(string_view name) {
+    int offset = 0;
+    if (name.size() == 6 && name.compare(0, 3, "arc") == 0) {
+        name.remove_prefix(3);
+        offset = 6;
+    }
+    if (name.size() == 3) {
+        for (int i = 0; i < 6; ++i) {
+            if (name[0] == trigNames[i][0] && name[1] == trigNames[i][1] && name[2] == trigNames[i][2]) {
+                return offset + i;
+            }
+        }
+    }
+    if (offset == 0 && name == "sqrt") return sqrtIndex;
+    return -1;
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+static inline bool isLetter(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+ExpParser::ExpParser()
+    : x(makeNode<VariableX>()), y(makeNode<VariableY>()), yPrime(makeNode<DerivativeY>()) {
+    leaves[0] = makeNode<Sine>();
+    leaves[1] = makeNode<Cosine>();
+    leaves[2] = makeNode<Tangent>();
+    leaves[3] = makeNode<Cosecant>();
+    leaves[4] = makeNode<Secant>();
+    leaves[5] = makeNode<Cotangent>();
+    leaves[6] = makeNode<ArcSine>();
+    leaves[7] = makeNode<ArcCosine>();
+    leaves[8] = makeNode<ArcTangent>();
+    leaves[9] = makeNode<ArcCosecant>();
+    leaves[10] = makeNode<ArcSecant>();
+    leaves[11] = makeNode<ArcCotangent>();
+}
+
+shared_ptr<Exp> ExpParser::parse(string_view input, ParseError* error) {
+    start(input);
+    shared_ptr<Exp> e = expr(1);
+    skipSpace();
+    if (!failure && pos < text.size()) {
+        fail(text[pos] == '=' ? "'=' in an expression; parse it as an equation" : "unexpected character");
+    }
+    if (!finish(error)) return nullptr;
+    return e;
+}
+
+unique_ptr<ImplicitEquation> ExpParser::parseEquation(string_view input, ParseError* error) {
+    start(input);
+    shared_ptr<Exp> left = expr(1);
+    skipSpace();
+    if (!failure && !accept('=')) fail("expected '='");
+    shared_ptr<Exp> right;
+    if (!failure) right = expr(1);
+    skipSpace();
+    if (!failure && pos < text.size()) fail("unexpected character");
+    if (!finish(error)) return nullptr;
+    return make_unique<ImplicitEquation>(move(left), move(right));
+}
+
+void ExpParser::start(string_view input) {
+    text = input;
+    pos = 0;
+    errorAt = 0;
+    depth = 0;
+    failure = nullptr;
+}
+
+bool ExpParser::finish(ParseError* error) {
+    if (!failure) return true;
+    if (error) {
+        error->offset = errorAt;
+        error->message = failure;
+    }
+    return false;
+}
+
+shared_ptr<Exp> ExpParser::fail(const char* message) {
+    if (!failure) {
+        failure = message;
+        errorAt = pos;
+    }
+    return nullptr;
+}
+
+void ExpParser::skipSpace() {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+        ++pos;
+    }
+}
+
+bool ExpParser::accept(char c) {
+    skipSpace();
+    if (pos < text.size() && text[pos] == c) {
+        ++pos;
+        return true;
+    }
+    return false;
+}
+
+// An integer literal's value: held exactly, or as a double when that is exact.
+static Rational exactValue(const Constant& c) {
+    return c.hasFraction ? c.fraction : Rational(llround(c.value));
+}
+
+static inline int precedence(char c) {
+    if (c == '+' || c == '-') return 1;
+    if (c == '*' || c == '/') return 2;
+    return 0;
+}
+
+// Precedence climbing over expr and term: a sum reads each of its terms with
+// minPrecedence 2, so a product never calls back in here for its factors.
+shared_ptr<Exp> ExpParser::expr(int minPrecedence) {
+    bool integerLiteral = false;
+    shared_ptr<Exp> left = operand(integerLiteral);
+    while (!failure) {
+        skipSpace();
+        if (pos == text.size()) break;
+        char op = text[pos];
+        int level = precedence(op);
+        if (level < minPrecedence || level == 0) break;
+        ++pos;
+        if (level == 1) {
+            shared_ptr<Exp> right = expr(2);
+            if (failure) break;
+            left = makeNode<AddSub>(move(left), move(right), op);
+            integerLiteral = false;
+            continue;
+        }
+        bool rightInteger = false;
+        shared_ptr<Exp> right = operand(rightInteger);
+        if (failure) break;
+        if (op == '*') {
+            left = makeNode<Multiply>(move(left), move(right));
+        } else if (integerLiteral && rightInteger && !exactValue(*as<Constant>(right)).isZero()) {
+            // "n/d" between integer literals is one exact fraction, as Constant prints it.
+            left = makeNode<Constant>(exactValue(*as<Constant>(left)) / exactValue(*as<Constant>(right)));
+        } else {
+            left = makeNode<Divide>(move(left), move(right));
+        }
+        integerLiteral = false;
+    }
+    if (failure) return nullptr;
+    return left;
+}
+
+// unary and power: leading minus signs, then a primary with an optional exponent.
+// Every level of nesting passes through here, so this is where depth is counted.
+shared_ptr<Exp> ExpParser::operand(bool& integerLiteral) {
+    if (depth == maxDepth) return fail("expression nested too deeply");
+    struct Nesting {
+        size_t& depth;
+        explicit Nesting(size_t& d) : depth(d) { ++depth; }
+        ~Nesting() { --depth; }
+    } nesting(depth);
+    if (accept('-')) {
+        shared_ptr<Exp> inner = operand(integerLiteral);
+        if (failure) return nullptr;
+        auto c = as<Constant>(inner);
+        if (c && !c->hasFraction) return makeNode<Constant>(-c->value);
+        if (c) return makeNode<Constant>(-c->fraction);
+        integerLiteral = false;
+        return makeNode<Multiply>(makeNode<Constant>(-1.0), move(inner));
+    }
+    shared_ptr<Exp> base = primary(integerLiteral);
+    if (failure) return nullptr;
+    size_t basePos = pos;
+    if (!accept('^')) return base;
+    integerLiteral = false;
+    double value = 0;
+    Rational fraction;
+    bool isFraction = false;
+    if (!exponent(value, fraction, isFraction)) return nullptr;
+    // Only a bare x is Power; "(x)^n" is how PowerComposed prints with x inside.
+    if (base == x && text[basePos - 1] == 'x') return isFraction ? makeNode<Power>(fraction) : makeNode<Power>(value);
+    if (isFraction) return makeNode<PowerComposed>(move(base), fraction);
+    return makeNode<PowerComposed>(move(base), value);
+}
+
+shared_ptr<Exp> ExpParser::primary(bool& integerLiteral) {
+    integerLiteral = false;
+    skipSpace();
+    if (pos == text.size()) return fail("unexpected end of input");
+    char c = text[pos];
+    if (isDigit(c) || c == '.') {
+        double value = 0;
+        Rational exact;
+        if (!number(value, exact, integerLiteral)) return nullptr;
+        // An integer a double cannot hold stays exact, as Constant printed it.
+        if (integerLiteral && !exact.isExactDouble()) return makeNode<Constant>(exact);
+        return makeNode<Constant>(value);
+    }
+    if (c == '(') {
+        ++pos;
+        shared_ptr<Exp> inner = expr(1);
+        if (failure) return nullptr;
+        if (!accept(')')) return fail("expected ')'");
+        return inner;
+    }
+    if (!isLetter(c)) return fail("expected a number, a variable, a function or '('");
+
+    size_t begin = pos;
+    while (pos < text.size() && isLetter(text[pos])) ++pos;
+    string_view name = text.substr(begin, pos - begin);
+    if (name.size() == 1) {
+        switch (name[0]) {
+            case 'x': return pos < text.size() && text[pos] == '_' ? variable() : x;
+            case 'y':
+                if (pos < text.size() && text[pos] == '\'') {
+                    ++pos;
+                    return yPrime;
+                }
+                return y;
+            case 'e': return exponential();
+            default: break;
+        }
+    }
+    // Constant prints non-finite values as C++ streams them.
+    if (name == "nan") return makeNode<Constant>(nan(""));
+    if (name == "inf") return makeNode<Constant>(HUGE_VAL);
+    int index = functionIndex(name);
+    if (index >= 0) return function(index);
+    pos = begin;
+    return fail("unknown name");
+}
+
+// Called after "x" with '_' next: x_<digits>, and x_0 is x itself.
+shared_ptr<Exp> ExpParser::variable() {
+    ++pos;
+    size_t begin = pos;
+    uint64_t index = 0;
+    while (pos < text.size() && isDigit(text[pos]) && index <= UINT32_MAX) {
+        index = index * 10 + static_cast<uint64_t>(text[pos] - '0');
+        ++pos;
+    }
+    if (pos == begin) return fail("expected a variable index after x_");
+    if (index > UINT32_MAX) return fail("variable index out of range");
+    if (index == 0) return x;
+    return makeVariable(static_cast<uint32_t>(index));
+}
+
+// Called after "e"; the printed forms are e^x, e^(a*x) and e^(u). "e^(x)" is how
+// ExponentialComposed prints with x inside, so it stays one.
+shared_ptr<Exp> ExpParser::exponential() {
+    if (!accept('^')) return makeNode<Constant>(exp(1.0));
+    skipSpace();
+    if (pos < text.size() && text[pos] == 'x' &&
+        (pos + 1 == text.size() || (!isLetter(text[pos + 1]) && text[pos + 1] != '_'))) {
+        ++pos;
+        return makeNode<Exponential>(1.0);
+    }
+    if (!accept('(')) return fail("expected x or '(' after e^");
+    shared_ptr<Exp> arg = expr(1);
+    if (failure) return nullptr;
+    if (!accept(')')) return fail("expected ')'");
+    if (auto mul = as<Multiply>(arg)) {
+        auto c = as<Constant>(mul->left);
+        if (c && mul->right == x) return makeNode<Exponential>(c->value);
+    }
+    return makeNode<ExponentialComposed>(move(arg));
+}
+
+shared_ptr<Exp> ExpParser::function(int index) {
+    double squared = 0;
+    if (accept('^')) {
+        bool integral = false;
+        Rational exact;
+        skipSpace();
+        if (!number(squared, exact, integral) || squared != 2) return fail("only name^2(...) is supported");
+    }
+    if (!accept('(')) return fail("expected '(' after a function name");
+    shared_ptr<Exp> arg = expr(1);
+    if (failure) return nullptr;
+    if (!accept(')')) return fail("expected ')'");
+    shared_ptr<Exp> f = applyFunction(index, arg);
+    if (squared == 0) return f;
+    return makeNode<Multiply>(f, applyFunction(index, arg));
+}
+
+shared_ptr<Exp> ExpParser::applyFunction(int index, const shared_ptr<Exp>& arg) {
+    if (index == sqrtIndex) return makeNode<Sqrt>(arg);
+    if (arg == x) return leaves[index];
+    if (index == 0) return makeNode<SineComposed>(arg);
+    if (index == 1) return makeNode<CosineComposed>(arg);
+    return makeNode<ChainRule>(leaves[index], arg);
+}
+
+// Digits only, of any length, count as an integer literal; exact then holds its value,
+// and value the nearest double.
+bool ExpParser::number(double& value, Rational& exact, bool& integral) {
+    size_t begin = pos;
+    unsigned long long digits = 0;
+    while (pos < text.size() && isDigit(text[pos]) && pos - begin < 18) {
+        digits = digits * 10 + static_cast<unsigned long long>(text[pos] - '0');
+        ++pos;
+    }
+    size_t end = pos;
+    while (end < text.size() && isDigit(text[end])) ++end;
+    bool more = end < text.size() && (text[end] == '.' || text[end] == 'e' || text[end] == 'E');
+    if (end > begin && !more) {
+        if (end == pos) {
+            exact = Rational(static_cast<long long>(digits));
+        } else {
+            Rational::parse(text.substr(begin, end - begin), exact); // digits only, so it cannot fail
+        }
+        pos = end;
+        value = exact.toDouble();
+        integral = true;
+        return true;
+    }
+    pos = begin;
+    auto result = from_chars(text.data() + begin, text.data() + text.size(), value);
+    if (result.ec != errc()) {
+        fail("malformed number");
+        return false;
+    }
+    pos = static_cast<size_t>(result.ptr - text.data());
+    integral = false;
+    return true;
+}
+
+// An integer exponent a double cannot hold, and every n/d, comes back exact in fraction.
+bool ExpParser::exponent(double& value, Rational& fraction, bool& isFraction) {
+    isFraction = false;
+    bool integral = false;
+    bool parenthesised = accept('(');
+    bool negative = accept('-');
+    skipSpace();
+    if (pos == text.size() || !(isDigit(text[pos]) || text[pos] == '.')) {
+        fail("expected a number as the exponent");
+        return false;
+    }
+    Rational exact;
+    if (!number(value, exact, integral)) return false;
+    if (negative) {
+        value = -value;
+        exact = -exact;
+    }
+    if (integral && !exact.isExactDouble()) {
+        fraction = exact;
+        isFraction = true;
+    }
+    if (!parenthesised) return true;
+    if (accept('/')) {
+        double den = 0;
+        Rational exactDen;
+        bool denIntegral = false;
+        skipSpace();
+        if (!integral || pos == text.size() || !isDigit(text[pos]) || !number(den, exactDen, denIntegral) ||
+            !denIntegral || exactDen.isZero()) {
+            fail("expected an integer fraction n/d as the exponent");
+            return false;
+        }
+        fraction = exact / exactDen;
+        value = fraction.toDouble();
+        isFraction = true;
+    }
+    if (!accept(')')) {
+        fail("expected ')'");
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef EXPRESSION_PARSER_HPP
+#define EXPRESSION_PARSER_HPP
+
+#include "expression.hpp"
+#include "implicit_differentiation.hpp"
+#include "rational.hpp"
+
+#include <string>
+#include <string_view>
+
+struct ParseError {
+    size_t offset = 0; // byte offset into the text
+    string message;
+};
+
+// Recursive-descent parser for the notation toString() prints, straight off a
+// string_view: no tokens or substrings are copied, and the leaves that take no
+// argument (x, y, y', sin(x), arctan(x), ...) are made once per parser and shared
+// by every tree it returns.
+//
+//   equation := expr '=' expr
+//   expr     := term (('+' | '-') term)*
+//   term     := unary (('*' | '/') unary)*      integer '/' integer is one exact Constant
+//   unary    := '-' unary | power
+//   power    := primary ('^' exponent)?         x^n is Power, anything else PowerComposed
+//   exponent := number | '-' number | '(' ['-'] number ['/' integer] ')'
+//   primary  := number | nan | inf | x | x_<digits> | y | y' | '(' expr ')' | e | e^x | e^(expr)
+//             | name '(' expr ')' | name '^2(' expr ')'
+//
+// name is sin, cos, tan, csc, sec, cot, arcsin, arccos, arctan, arccsc, arcsec, arccot
+// or sqrt. Applied to x they give the leaf classes; applied to anything else, sin and
+// cos give SineComposed/CosineComposed and the others a ChainRule. e^(a*x) for a
+// number a is Exponential(a), and name^2(u) is name(u)*name(u), both as printed.
+// x_i is the indexed Variable i; x_0 is the same x as a bare x.
+class ExpParser {
+    public:
+        ExpParser();
+
+        // Brackets, function calls and unary minus signs nest at most this deep; deeper
+        // input fails instead of running the recursion off the stack.
+        static const size_t maxDepth = 10000;
+
+        // Null when text is not a single expression; error then says where and why.
+        shared_ptr<Exp> parse(string_view text, ParseError* error = nullptr);
+        // Null when text is not "left = right".
+        unique_ptr<ImplicitEquation> parseEquation(string_view text, ParseError* error = nullptr);
+
+    private:
+        string_view text;
+        size_t pos = 0;
+        size_t errorAt = 0;
+        size_t depth = 0; // operand() calls currently open
+        const char* failure = nullptr; // first error; parsing unwinds once it is set
+
+        shared_ptr<Exp> x, y, yPrime;
+        shared_ptr<Exp> leaves[12]; // sin, cos, tan, csc, sec, cot, then arcsin .. arccot, applied to x
+
+        void start(string_view input);
+        bool finish(ParseError* error);
+        shared_ptr<Exp> fail(const char* message);
+        void skipSpace();
+        bool accept(char c);
+
+        shared_ptr<Exp> expr(int minPrecedence);
+        shared_ptr<Exp> operand(bool& integerLiteral);
+        shared_ptr<Exp> primary(bool& integerLiteral);
+        shared_ptr<Exp> function(int index);
+        shared_ptr<Exp> applyFunction(int index, const shared_ptr<Exp>& arg);
+        shared_ptr<Exp> variable();
+        shared_ptr<Exp> exponential();
+        bool number(double& value, Rational& exact, bool& integral);
+        bool exponent(double& value, Rational& fraction, bool& isFraction);
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef EXPRESSION_STORE_CPP
+#define EXPRESSION_STORE_CPP
+
+#include "expression_store.hpp"
+
+#include "chain_rule.hpp"
+#include "inverse_trigonometric_functions.hpp"
+#include "polynomials_and_exponential_functions.hpp"
+
+using namespace std;
+
+static thread_local ExpStore* activeStore = nullptr;
+
+// Calls f on each child pointer of node, in a fixed order.
+template <class F>
+static void forEachChild(Exp& node, F f) {
+    switch (node.kind()) {
+        case ExpKind::AddSub: f(static_cast<AddSub&>(node).left); f(static_cast<AddSub&>(node).right); break;
+        case ExpKind::Multiply: f(static_cast<Multiply&>(node).left); f(static_cast<Multiply&>(node).right); break;
+        case ExpKind::Divide: f(static_cast<Divide&>(node).left); f(static_cast<Divide&>(node).right); break;
+        case ExpKind::ChainRule: f(static_cast<ChainRule&>(node).outer); f(static_cast<ChainRule&>(node).inner); break;
+        case ExpKind::SineComposed: f(static_cast<SineComposed&>(node).arg); break;
+        case ExpKind::CosineComposed: f(static_cast<CosineComposed&>(node).arg); break;
+        case ExpKind::PowerComposed: f(static_cast<PowerComposed&>(node).arg); break;
+        case ExpKind::ExponentialComposed: f(static_cast<ExponentialComposed&>(node).arg); break;
+        case ExpKind::Sqrt: f(static_cast<Sqrt&>(node).arg); break;
+        default: break;
+    }
+}
+
+// equals() lets an exact fraction match the double it equals (2/1 and 2); they print
+// differently, so the store keeps them apart.
+static bool sameForm(const Exp& a, const Exp& b) {
+    if (auto c = as<Constant>(&a)) return c->hasFraction == as<Constant>(&b)->hasFraction;
+    if (auto p = as<Power>(&a)) return p->hasFraction == as<Power>(&b)->hasFraction;
+    if (auto p = as<PowerComposed>(&a)) return p->hasFraction == as<PowerComposed>(&b)->hasFraction;
+    return true;
+}
+
+shared_ptr<Exp> ExpStore::find(const Exp& expr) const {
+    auto it = buckets.find(expr.hashCode());
+    if (it == buckets.end()) return nullptr;
+    for (const auto& candidate : it->second) {
+        if (candidate.get() == &expr) return candidate;
+    }
+    for (const auto& candidate : it->second) {
+        if (candidate->equals(expr) && sameForm(*candidate, expr)) return candidate;
+    }
+    return nullptr;
+}
+
+// expr on top of interned children. Leaves are returned as is, and a node whose
+// children are already canonical is not copied.
+shared_ptr<Exp> ExpStore::canonicalChildren(const shared_ptr<Exp>& expr) {
+    shared_ptr<Exp> children[2];
+    size_t n = 0;
+    bool canonical = true;
+    forEachChild(*expr, [&](shared_ptr<Exp>& child) {
+        children[n] = intern(child);
+        canonical = canonical && children[n] == child;
+        ++n;
+    });
+    if (canonical) return expr;
+    shared_ptr<Exp> copy = shareNode(expr->clone());
+    n = 0;
+    forEachChild(*copy, [&](shared_ptr<Exp>& child) { child = move(children[n++]); });
+    return copy;
+}
+
+void ExpStore::internChildren(Exp& node) {
+    forEachChild(node, [&](shared_ptr<Exp>& child) { child = intern(child); });
+}
+
+shared_ptr<Exp> ExpStore::intern(const shared_ptr<Exp>& expr) {
+    if (auto existing = find(*expr)) {
+        ++hitCount;
+        return existing;
+    }
+    auto node = canonicalChildren(expr);
+    if (node != expr) {
+        if (auto existing = find(*node)) {
+            ++hitCount;
+            return existing;
+        }
+    }
+    ++missCount;
+    buckets[node->hashCode()].push_back(node);
+    ++count;
+    return node;
+}
+
+shared_ptr<Exp> ExpStore::intern(dExp expr) {
+    return intern(shareNode(move(expr)));
+}
+
+void ExpStore::clear() {
+    buckets.clear();
+    count = 0;
+    hitCount = 0;
+    missCount = 0;
+}
+
+ExpStore* ExpStore::current() {
+    return activeStore;
+}
+
+InternScope::InternScope(ExpStore* store) : previous(activeStore) {
+    activeStore = store;
+}
+InternScope::~InternScope() {
+    activeStore = previous;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef EXPRESSION_STORE_HPP
+#define EXPRESSION_STORE_HPP
+
+#include "expression.hpp"
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Hash-consing node factory: structurally identical subtrees are interned to a
+// single shared node, so two interned expressions are equal iff their pointers are.
+// A store is not thread-safe; use one per differentiation session or per thread.
+//
+// Bound with an InternScope, a store also takes part in derivative() and simplify():
+// every node those build is made of interned children, and derivativeOf() and
+// simplifyOf() return interned nodes, so their output is a DAG with one node per
+// distinct subexpression. Interned nodes are kept alive by the store, so a store used
+// inside a NodeArena must not outlive it.
+class ExpStore {
+    public:
+        shared_ptr<Exp> intern(const shared_ptr<Exp>& expr);
+        shared_ptr<Exp> intern(dExp expr);
+        // Replaces the children of a node nobody else holds yet with their interned
+        // nodes; the node itself is left out of the store.
+        void internChildren(Exp& node);
+
+        template <class T, class... Args>
+        shared_ptr<Exp> make(Args&&... args) {
+            return intern(makeNode<T>(forward<Args>(args)...));
+        }
+
+        size_t size() const { return count; }
+        size_t hits() const { return hitCount; }
+        size_t misses() const { return missCount; }
+        void clear();
+
+        // The store bound on this thread, or nullptr.
+        static ExpStore* current();
+
+    private:
+        unordered_map<size_t, vector<shared_ptr<Exp>>> buckets;
+        size_t count = 0;
+        size_t hitCount = 0;
+        size_t missCount = 0;
+
+        shared_ptr<Exp> find(const Exp& expr) const;
+        shared_ptr<Exp> canonicalChildren(const shared_ptr<Exp>& expr);
+};
+
+// Binds store on this thread for as long as the scope lives. Scopes nest; nullptr
+// binds none, so derivative() and simplify() build plain trees inside it.
+class InternScope {
+    public:
+        explicit InternScope(ExpStore* store);
+        ~InternScope();
+        InternScope(const InternScope&) = delete;
+        InternScope& operator=(const InternScope&) = delete;
+
+    private:
+        ExpStore* previous;
+};
+
+#endif
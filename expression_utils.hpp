@@ -2,29 +2,45 @@
 #define EXPRESSION_UTILS_HPP
 
 #include <cmath>
-#include <iomanip>
-#include <sstream>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
 
 using namespace std;
 
-inline string formatNumber(double v) {
-    if (isnan(v)) return "nan";
-    if (isinf(v)) return (v > 0) ? "inf" : "-inf";
+// Writes formatNumber(v) into buf and returns its length: whole values as integers,
+// others with up to 8 decimals and no trailing zeros.
+inline size_t formatNumberInto(double v, char (&buf)[64]) {
+    if (isnan(v)) return static_cast<size_t>(snprintf(buf, sizeof buf, "nan"));
+    if (isinf(v)) return static_cast<size_t>(snprintf(buf, sizeof buf, v > 0 ? "inf" : "-inf"));
 
     double intpart;
     if (modf(v, &intpart) == 0.0) {
-        return to_string(static_cast<long long>(intpart));
+        // Past the range of long long the cast is undefined: the shortest %g that reads back
+        // as the same double instead.
+        if (fabs(intpart) >= 9223372036854775808.0) {
+            int n = 0;
+            for (int digits = 15; digits <= 17; ++digits) {
+                n = snprintf(buf, sizeof buf, "%.*g", digits, intpart);
+                if (strtod(buf, nullptr) == intpart) break;
+            }
+            return static_cast<size_t>(n);
+        }
+        return static_cast<size_t>(snprintf(buf, sizeof buf, "%lld", static_cast<long long>(intpart)));
     }
 
-    ostringstream ss;
-    ss << fixed << setprecision(8) << v;
-    string s = ss.str();
-    if (s.find('.') != string::npos) {
-        while (!s.empty() && s.back() == '0') s.pop_back();
-        if (!s.empty() && s.back() == '.') s.pop_back();
-    }
-    return s;
+    // Same digits as an ostream with fixed << setprecision(8).
+    size_t n = static_cast<size_t>(snprintf(buf, sizeof buf, "%.8f", v));
+    while (n > 0 && buf[n - 1] == '0') --n;
+    if (n > 0 && buf[n - 1] == '.') --n;
+    buf[n] = '\0';
+    return n;
+}
+
+inline string formatNumber(double v) {
+    char buf[64];
+    return string(buf, formatNumberInto(v, buf));
 }
 
 inline long long gcdll(long long a, long long b) {
@@ -53,6 +69,10 @@ inline string formatFraction(long long n, long long d) {
     return to_string(n) + "/" + to_string(d);
 }
 
+inline size_t hashCombine(size_t seed, size_t v) {
+    return seed ^ (v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
 inline bool isIntegerDouble(double v) {
     return fabs(v - round(v)) < 1e-9;
 }
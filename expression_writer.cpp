@@ -0,0 +1,46 @@
+#ifndef EXPRESSION_WRITER_CPP
+#define EXPRESSION_WRITER_CPP
+
+#include "expression_writer.hpp"
+
+#include "expression_utils.hpp"
+
+using namespace std;
+
+ExpWriter::ExpWriter(ostream& sink, size_t flushAt) : sink(&sink), flushAt(flushAt) {
+    buffer.reserve(flushAt + 256);
+}
+
+ExpWriter::~ExpWriter() {
+    flush();
+}
+
+ExpWriter& ExpWriter::number(double v) {
+    char buf[64];
+    return *this << string_view(buf, formatNumberInto(v, buf));
+}
+
+void ExpWriter::flush() {
+    if (!sink || buffer.empty()) return;
+    sink->write(buffer.data(), static_cast<streamsize>(buffer.size()));
+    buffer.clear();
+}
+
+string ExpWriter::take() {
+    string text = move(buffer);
+    buffer.clear();
+    return text;
+}
+
+string Exp::toString() const {
+    ExpWriter out;
+    print(out);
+    return out.take();
+}
+
+void Exp::write(ostream& os) const {
+    ExpWriter out(os);
+    print(out);
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef EXPRESSION_WRITER_HPP
+#define EXPRESSION_WRITER_HPP
+
+#include "expression.hpp"
+
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Append-only text buffer that Exp::print() writes into. A writer built without a sink
+// keeps the whole text for take(); one built on an ostream hands its buffer over every
+// time it grows past flushAt bytes, so printing a tree of any size holds only about
+// that much in memory.
+class ExpWriter {
+    public:
+        ExpWriter() = default;
+        explicit ExpWriter(ostream& sink, size_t flushAt = 64 * 1024);
+        ~ExpWriter();
+        ExpWriter(const ExpWriter&) = delete;
+        ExpWriter& operator=(const ExpWriter&) = delete;
+
+        ExpWriter& operator<<(char c) {
+            buffer.push_back(c);
+            return *this;
+        }
+        ExpWriter& operator<<(string_view text) {
+            buffer.append(text.data(), text.size());
+            if (sink && buffer.size() >= flushAt) flush();
+            return *this;
+        }
+        ExpWriter& operator<<(const Exp& expr) {
+            expr.print(*this);
+            return *this;
+        }
+        // Same text as formatNumber(v).
+        ExpWriter& number(double v);
+
+        // Sends what is buffered to the sink; does nothing without one.
+        void flush();
+        // The text so far, leaving the writer empty.
+        string take();
+
+    private:
+        string buffer;
+        ostream* sink = nullptr;
+        size_t flushAt = 0;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef GRADIENT_TAPE_CPP
+#define GRADIENT_TAPE_CPP
+
+#include "gradient_tape.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+GradientTape::GradientTape(const Exp& expr) : GradientTape(compile(expr)) {}
+
+GradientTape::GradientTape(CompiledExp compiled)
+    : tape(move(compiled)), values(tape.registers()), adjoints(tape.registers()) {}
+
+double GradientTape::gradient(const double* in, double* grad) {
+    double* r = values.data();
+    double* adj = adjoints.data();
+    memcpy(r, in, tape.inputs * sizeof(double));
+    tape.forward(r);
+
+    fill(adjoints.begin(), adjoints.end(), 0.0);
+    adj[tape.result] = 1.0;
+    for (size_t i = tape.code.size(); i-- > 0;) {
+        const TapeInstr& ins = tape.code[i];
+        const size_t o = tape.firstTemp() + i;
+        const double g = adj[o];
+        const double a = r[ins.a];
+        const double b = r[ins.b];
+        switch (ins.op) {
+            case TapeOp::Add: adj[ins.a] += g; adj[ins.b] += g; break;
+            case TapeOp::Sub: adj[ins.a] += g; adj[ins.b] -= g; break;
+            case TapeOp::Mul: adj[ins.a] += g * b; adj[ins.b] += g * a; break;
+            case TapeOp::Div:
+                // Matches the forward NaN for a zero denominator.
+                if (b == 0) {
+                    adj[ins.a] = NAN;
+                    adj[ins.b] = NAN;
+                } else {
+                    adj[ins.a] += g / b;
+                    adj[ins.b] -= g * r[o] / b;
+                }
+                break;
+            case TapeOp::Pow: adj[ins.a] += g * b * pow(a, b - 1); break; // b is a constant
+            case TapeOp::Recip: adj[ins.a] -= g * r[o] * r[o]; break;
+            case TapeOp::Square: adj[ins.a] += 2 * g * a; break;
+            case TapeOp::Sqrt: adj[ins.a] += g / (2 * r[o]); break;
+            case TapeOp::Exp: adj[ins.a] += g * r[o]; break;
+            case TapeOp::Sin: adj[ins.a] += g * cos(a); break;
+            case TapeOp::Cos: adj[ins.a] -= g * sin(a); break;
+            case TapeOp::Tan: adj[ins.a] += g * (1 + r[o] * r[o]); break;
+            case TapeOp::Asin: adj[ins.a] += g / sqrt(1 - a * a); break;
+            case TapeOp::Acos: adj[ins.a] -= g / sqrt(1 - a * a); break;
+            case TapeOp::Atan: adj[ins.a] += g / (1 + a * a); break;
+        }
+    }
+    memcpy(grad, adj, tape.inputs * sizeof(double));
+    return r[tape.result];
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef GRADIENT_TAPE_HPP
+#define GRADIENT_TAPE_HPP
+
+#include "compiled_expression.hpp"
+
+#include <vector>
+
+// Reverse-mode differentiation over a compiled tape. gradient() records one forward
+// evaluation (every register value is kept) and then sweeps the tape backwards once,
+// accumulating the adjoint of each register, so all partials cost about the same as
+// two or three evaluations however many inputs there are.
+//
+// Inputs are bound by register: in[CompiledExp::xReg] = x, in[yReg] = y,
+// in[yPrimeReg] = y', and so on for any further input registers.
+class GradientTape {
+    public:
+        explicit GradientTape(const Exp& expr);
+        explicit GradientTape(CompiledExp compiled);
+
+        size_t inputs() const { return tape.inputs; }
+        const CompiledExp& compiled() const { return tape; }
+
+        // Returns f(in) and writes the inputs() partials df/din[i] into grad.
+        double gradient(const double* in, double* grad);
+
+    private:
+        CompiledExp tape;
+        vector<double> values;
+        vector<double> adjoints;
+};
+
+#endif
@@ -4,67 +4,94 @@
 #include "implicit_differentiation.hpp"
 
 #include "chain_rule.hpp"
+#include "expression_writer.hpp"
+#include "memo.hpp"
 #include "polynomials_and_exponential_functions.hpp"
 #include "trigonometric_functions.hpp"
 #include "inverse_trigonometric_functions.hpp"
 
+#include <algorithm>
 #include <cmath>
 
 using namespace std;
 
-string VariableY::toString() const {
-    return "y"; 
+void VariableY::print(ExpWriter& out) const {
+    out << "y";
 }
-dExp VariableY::derivative() const {
+dExp VariableY::derivativeNode() const {
     return make_unique<DerivativeY>();
 }
-dExp VariableY::simplify() const {
+dExp VariableY::simplifyNode() const {
     return make_unique<VariableY>();
 }
 double VariableY::evaluate(double x) const {
     return NAN;
 }
-dExp VariableY::substitute(const shared_ptr<Exp>& replacement) const {
+void VariableY::evaluate(const double* xs, double* out, size_t n) const {
+    fill(out, out + n, NAN);
+}
+Dual VariableY::evaluateWithDerivative(double x) const {
+    return Dual{NAN, NAN};
+}
+dExp VariableY::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<VariableY>();
 }
 
-string DerivativeY::toString() const {
-    return "y'";
+void DerivativeY::print(ExpWriter& out) const {
+    out << "y'";
 }
-dExp DerivativeY::derivative() const {
+dExp DerivativeY::derivativeNode() const {
     return make_unique<DerivativeY>();
 }
-dExp DerivativeY::simplify() const {
+dExp DerivativeY::simplifyNode() const {
     return make_unique<DerivativeY>();
 }
 double DerivativeY::evaluate(double x) const { 
     return NAN;
 }
-dExp DerivativeY::substitute(const shared_ptr<Exp>& replacement) const {
+void DerivativeY::evaluate(const double* xs, double* out, size_t n) const {
+    fill(out, out + n, NAN);
+}
+Dual DerivativeY::evaluateWithDerivative(double x) const {
+    return Dual{NAN, NAN};
+}
+dExp DerivativeY::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<DerivativeY>();
 }
 
 ImplicitEquation::ImplicitEquation(shared_ptr<Exp> l, shared_ptr<Exp> r) : left(l), right(r) {}
 string ImplicitEquation::toString() const {
-    return left->toString() + " = " + right->toString();
+    ExpWriter out;
+    print(out);
+    return out.take();
+}
+void ImplicitEquation::print(ExpWriter& out) const {
+    out << *left << " = " << *right;
 }
 
 static bool containsYPrime(const Exp* expr) {
-    if (dynamic_cast<const DerivativeY*>(expr)) return true;
-    if (auto add = dynamic_cast<const AddSub*>(expr)) {
-        return containsYPrime(add->left.get()) || containsYPrime(add->right.get());
-    }
-    if (auto mul = dynamic_cast<const Multiply*>(expr)) {
-        return containsYPrime(mul->left.get()) || containsYPrime(mul->right.get());
-    }
-    if (auto div = dynamic_cast<const Divide*>(expr)) {
-        return containsYPrime(div->left.get()) || containsYPrime(div->right.get());
+    switch (expr->kind()) {
+        case ExpKind::DerivativeY:
+            return true;
+        case ExpKind::AddSub: {
+            auto add = static_cast<const AddSub*>(expr);
+            return containsYPrime(add->left.get()) || containsYPrime(add->right.get());
+        }
+        case ExpKind::Multiply: {
+            auto mul = static_cast<const Multiply*>(expr);
+            return containsYPrime(mul->left.get()) || containsYPrime(mul->right.get());
+        }
+        case ExpKind::Divide: {
+            auto div = static_cast<const Divide*>(expr);
+            return containsYPrime(div->left.get()) || containsYPrime(div->right.get());
+        }
+        default:
+            return false;
     }
-    return false;
 }
 
 static shared_ptr<Exp> asShared(dExp expr) {
-    return shared_ptr<Exp>(move(expr));
+    return shareNode(move(expr));
 }
 
 static dExp makeZero() { return make_unique<Constant>(0); }
@@ -80,26 +107,19 @@ static dExp divExpr(dExp a, dExp b) {
     return make_unique<Divide>(asShared(move(a)), asShared(move(b)))->simplify();
 }
 
-static bool isZeroConst(const dExp& expr) {
-    if (auto c = dynamic_cast<Constant*>(expr.get())) {
-        return c->value == 0.0;
-    }
-    return false;
-}
-
 // Split expr into a*Y' + b where a,b are expressions without Y'
 static bool splitLinearYPrime(const shared_ptr<Exp>& expr, dExp& coeff, dExp& rest) {
-    if (dynamic_cast<DerivativeY*>(expr.get())) {
+    if (as<DerivativeY>(expr.get())) {
         coeff = makeOne();
         rest = makeZero();
         return true;
     }
     if (!containsYPrime(expr.get())) {
         coeff = makeZero();
-        rest = expr->simplify();
+        rest = simplifyOf(expr)->clone();
         return true;
     }
-    if (auto add = dynamic_cast<AddSub*>(expr.get())) {
+    if (auto add = as<AddSub>(expr.get())) {
         dExp lc, lr, rc, rr;
         if (!splitLinearYPrime(add->left, lc, lr)) return false;
         if (!splitLinearYPrime(add->right, rc, rr)) return false;
@@ -107,7 +127,7 @@ static bool splitLinearYPrime(const shared_ptr<Exp>& expr, dExp& coeff, dExp& re
         rest = addExpr(move(lr), move(rr), add->op);
         return true;
     }
-    if (auto mul = dynamic_cast<Multiply*>(expr.get())) {
+    if (auto mul = as<Multiply>(expr.get())) {
         bool lHas = containsYPrime(mul->left.get());
         bool rHas = containsYPrime(mul->right.get());
         if (lHas && rHas) return false;
@@ -115,24 +135,22 @@ static bool splitLinearYPrime(const shared_ptr<Exp>& expr, dExp& coeff, dExp& re
         if (lHas) {
             dExp lc, lr;
             if (!splitLinearYPrime(mul->left, lc, lr)) return false;
-            if (!isZeroConst(lr)) return false;
-            coeff = mulExpr(move(lc), mul->right->simplify());
-            rest = makeZero();
+            coeff = mulExpr(move(lc), simplifyOf(mul->right)->clone());
+            rest = mulExpr(move(lr), simplifyOf(mul->right)->clone());
             return true;
         }
         dExp rc, rr;
         if (!splitLinearYPrime(mul->right, rc, rr)) return false;
-        if (!isZeroConst(rr)) return false;
-        coeff = mulExpr(move(rc), mul->left->simplify());
-        rest = makeZero();
+        coeff = mulExpr(move(rc), simplifyOf(mul->left)->clone());
+        rest = mulExpr(move(rr), simplifyOf(mul->left)->clone());
         return true;
     }
-    if (auto div = dynamic_cast<Divide*>(expr.get())) {
+    if (auto div = as<Divide>(expr.get())) {
         if (containsYPrime(div->right.get())) return false;
         dExp nc, nr;
         if (!splitLinearYPrime(div->left, nc, nr)) return false;
-        coeff = divExpr(move(nc), div->right->simplify());
-        rest = divExpr(move(nr), div->right->simplify());
+        coeff = divExpr(move(nc), simplifyOf(div->right)->clone());
+        rest = divExpr(move(nr), simplifyOf(div->right)->clone());
         return true;
     }
 
@@ -140,9 +158,7 @@ static bool splitLinearYPrime(const shared_ptr<Exp>& expr, dExp& coeff, dExp& re
 }
 
 dExp ImplicitEquation::derivative() const {
-    auto dl = left->derivative();
-    auto dr = right->derivative();
-    auto diff = make_unique<AddSub>(asShared(move(dl)), asShared(move(dr)), '-')->simplify();
+    auto diff = make_unique<AddSub>(derivativeOf(left), derivativeOf(right), '-')->simplify();
 
     dExp coeff;
     dExp rest;
@@ -155,4 +171,11 @@ dExp ImplicitEquation::derivative() const {
     return divExpr(move(negRest), move(coeff));
 }
 
+dExp VariableY::clone() const {
+    return make_unique<VariableY>(*this);
+}
+dExp DerivativeY::clone() const {
+    return make_unique<DerivativeY>(*this);
+}
+
 #endif
\ No newline at end of file
@@ -5,20 +5,30 @@
 
 class VariableY : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::VariableY;
+        VariableY() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class DerivativeY : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::DerivativeY;
+        DerivativeY() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class ImplicitEquation {
@@ -27,6 +37,7 @@ class ImplicitEquation {
         shared_ptr<Exp> right;
         ImplicitEquation(shared_ptr<Exp> l, shared_ptr<Exp> r);
         string toString() const;
+        void print(ExpWriter& out) const;
         dExp derivative() const;
 };
 
@@ -2,188 +2,269 @@
 #define INVERSE_TRIGONOMETRIC_FUNCTIONS_CPP
 
 #include "inverse_trigonometric_functions.hpp"
+#include "chain_rule.hpp"
 #include "polynomials_and_exponential_functions.hpp"
+#include "expression_utils.hpp"
+#include "expression_writer.hpp"
+#include "memo.hpp"
+#include "simd_math.hpp"
 
 #include <cmath>
 
 using namespace std;
 
-Sqrt::Sqrt(shared_ptr<Exp> a) : arg(a) {}
-string Sqrt::toString() const {
-    return "sqrt(" + arg->toString() + ")";
+Sqrt::Sqrt(shared_ptr<Exp> a) : Exp(Kind), arg(move(a)) {}
+void Sqrt::print(ExpWriter& out) const {
+    out << "sqrt(" << *arg << ')';
 }
-dExp Sqrt::derivative() const {
+dExp Sqrt::derivativeNode() const {
     return make_unique<Divide>(
-        arg->derivative(),
-        make_unique<Multiply>(
-            make_shared<Constant>(2),
-            make_shared<Sqrt>(arg)
+        derivativeOf(arg),
+        makeNode<Multiply>(
+            makeNode<Constant>(2),
+            makeNode<Sqrt>(arg)
         )
     )->simplify();
 }
-dExp Sqrt::simplify() const {
-    auto a = arg->simplify();
-    if (auto c = dynamic_cast<Constant*>(a.get())) {
+dExp Sqrt::simplifyNode() const {
+    auto a = simplifyOf(arg);
+    if (auto c = as<Constant>(a.get())) {
         if (c->value >= 0) return make_unique<Constant>(sqrt(c->value));
     }
-    return make_unique<Sqrt>(shared_ptr<Exp>(move(a)));
+    return make_unique<Sqrt>(a);
 }
 double Sqrt::evaluate(double x) const {
     return sqrt(arg->evaluate(x));
 }
+void Sqrt::evaluate(const double* xs, double* out, size_t n) const {
+    arg->evaluate(xs, out, n);
+    batchSqrt(out, out, n);
+}
+Dual Sqrt::evaluateWithDerivative(double x) const {
+    Dual a = arg->evaluateWithDerivative(x);
+    double s = sqrt(a.value);
+    return Dual{s, a.deriv / (2 * s)};
+}
 
-string ArcSine::toString() const {
-    return "arcsin(x)";
+void ArcSine::print(ExpWriter& out) const {
+    out << "arcsin(x)";
 }
-dExp ArcSine::derivative() const {
+dExp ArcSine::derivativeNode() const {
     return make_unique<Divide>(
-        make_unique<Constant>(1),
-        make_unique<Sqrt>(
-            make_shared<AddSub>(
-                make_shared<Constant>(1),
-                make_shared<Power>(2),
+        makeNode<Constant>(1),
+        makeNode<Sqrt>(
+            makeNode<AddSub>(
+                makeNode<Constant>(1),
+                makeNode<Power>(2),
                 '-'
             )
         )
     )->simplify();
 }
-dExp ArcSine::simplify() const {
+dExp ArcSine::simplifyNode() const {
     return make_unique<ArcSine>();
 }
 double ArcSine::evaluate(double x) const {
     return asin(x);
 }
+void ArcSine::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = asin(xs[i]);
+}
+Dual ArcSine::evaluateWithDerivative(double x) const {
+    return Dual{asin(x), 1.0 / sqrt(1 - x * x)};
+}
 
-string ArcCosine::toString() const {
-    return "arccos(x)";
+void ArcCosine::print(ExpWriter& out) const {
+    out << "arccos(x)";
 }
-dExp ArcCosine::derivative() const {
+dExp ArcCosine::derivativeNode() const {
     return make_unique<Divide>(
-        make_unique<Constant>(-1),
-        make_unique<Sqrt>(
-            make_shared<AddSub>(
-                make_shared<Constant>(1),
-                make_shared<Power>(2),
+        makeNode<Constant>(-1),
+        makeNode<Sqrt>(
+            makeNode<AddSub>(
+                makeNode<Constant>(1),
+                makeNode<Power>(2),
                 '-'
             )
         )
     )->simplify();
 }
-dExp ArcCosine::simplify() const {
+dExp ArcCosine::simplifyNode() const {
     return make_unique<ArcCosine>();
 }
 double ArcCosine::evaluate(double x) const {
     return acos(x);
 }
+void ArcCosine::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = acos(xs[i]);
+}
+Dual ArcCosine::evaluateWithDerivative(double x) const {
+    return Dual{acos(x), -1.0 / sqrt(1 - x * x)};
+}
 
-string ArcTangent::toString() const {
-    return "arctan(x)";
+void ArcTangent::print(ExpWriter& out) const {
+    out << "arctan(x)";
 }
-dExp ArcTangent::derivative() const {
+dExp ArcTangent::derivativeNode() const {
     return make_unique<Divide>(
-        make_unique<Constant>(1),
-        make_unique<AddSub>(
-            make_shared<Constant>(1),
-            make_shared<Power>(2),
+        makeNode<Constant>(1),
+        makeNode<AddSub>(
+            makeNode<Constant>(1),
+            makeNode<Power>(2),
             '+'
         )
     )->simplify();
 }
-dExp ArcTangent::simplify() const {
+dExp ArcTangent::simplifyNode() const {
     return make_unique<ArcTangent>();
 }
 double ArcTangent::evaluate(double x) const {
     return atan(x);
 }
+void ArcTangent::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = atan(xs[i]);
+}
+Dual ArcTangent::evaluateWithDerivative(double x) const {
+    return Dual{atan(x), 1.0 / (1 + x * x)};
+}
 
-string ArcCosecant::toString() const {
-    return "arccsc(x)";
-}
-dExp ArcCosecant::derivative() const {
-    auto absx = make_shared<Sqrt>(make_shared<Power>(2));
-    auto root = make_shared<Sqrt>(
-        make_shared<AddSub>(
-            make_shared<Power>(2),
-            make_shared<Constant>(1),
+void ArcCosecant::print(ExpWriter& out) const {
+    out << "arccsc(x)";
+}
+dExp ArcCosecant::derivativeNode() const {
+    auto absx = makeNode<Sqrt>(makeNode<Power>(2));
+    auto root = makeNode<Sqrt>(
+        makeNode<AddSub>(
+            makeNode<Power>(2),
+            makeNode<Constant>(1),
             '-'
         )
     );
     return make_unique<Divide>(
-        make_unique<Constant>(-1),
-        make_unique<Multiply>(absx, root)
+        makeNode<Constant>(-1),
+        makeNode<Multiply>(absx, root)
     )->simplify();
 }
-dExp ArcCosecant::simplify() const {
+dExp ArcCosecant::simplifyNode() const {
     return make_unique<ArcCosecant>();
 }
 double ArcCosecant::evaluate(double x) const {
     return asin(1.0 / x);
 }
+void ArcCosecant::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = asin(1.0 / xs[i]);
+}
+Dual ArcCosecant::evaluateWithDerivative(double x) const {
+    return Dual{asin(1.0 / x), -1.0 / (fabs(x) * sqrt(x * x - 1))};
+}
 
-string ArcSecant::toString() const {
-    return "arcsec(x)";
-}
-dExp ArcSecant::derivative() const {
-    auto absx = make_shared<Sqrt>(make_shared<Power>(2));
-    auto root = make_shared<Sqrt>(
-        make_shared<AddSub>(
-            make_shared<Power>(2),
-            make_shared<Constant>(1),
+void ArcSecant::print(ExpWriter& out) const {
+    out << "arcsec(x)";
+}
+dExp ArcSecant::derivativeNode() const {
+    auto absx = makeNode<Sqrt>(makeNode<Power>(2));
+    auto root = makeNode<Sqrt>(
+        makeNode<AddSub>(
+            makeNode<Power>(2),
+            makeNode<Constant>(1),
             '-'
         )
     );
     return make_unique<Divide>(
-        make_unique<Constant>(1),
-        make_unique<Multiply>(absx, root)
+        makeNode<Constant>(1),
+        makeNode<Multiply>(absx, root)
     )->simplify();
 }
-dExp ArcSecant::simplify() const {
+dExp ArcSecant::simplifyNode() const {
     return make_unique<ArcSecant>();
 }
 double ArcSecant::evaluate(double x) const {
     return acos(1.0 / x);
 }
+void ArcSecant::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = acos(1.0 / xs[i]);
+}
+Dual ArcSecant::evaluateWithDerivative(double x) const {
+    return Dual{acos(1.0 / x), 1.0 / (fabs(x) * sqrt(x * x - 1))};
+}
 
-string ArcCotangent::toString() const {
-    return "arccot(x)";
+void ArcCotangent::print(ExpWriter& out) const {
+    out << "arccot(x)";
 }
-dExp ArcCotangent::derivative() const {
+dExp ArcCotangent::derivativeNode() const {
     return make_unique<Divide>(
-        make_unique<Constant>(-1),
-        make_unique<AddSub>(
-            make_shared<Constant>(1),
-            make_shared<Power>(2),
+        makeNode<Constant>(-1),
+        makeNode<AddSub>(
+            makeNode<Constant>(1),
+            makeNode<Power>(2),
             '+'
         )
     )->simplify();
 }
-dExp ArcCotangent::simplify() const {
+dExp ArcCotangent::simplifyNode() const {
     return make_unique<ArcCotangent>();
 }
 double ArcCotangent::evaluate(double x) const {
     return atan(1.0 / x);
 }
+void ArcCotangent::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = atan(1.0 / xs[i]);
+}
+Dual ArcCotangent::evaluateWithDerivative(double x) const {
+    return Dual{atan(1.0 / x), -1.0 / (1 + x * x)};
+}
 
-dExp Sqrt::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Sqrt::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<Sqrt>(arg->substitute(replacement))->simplify();
 }
-dExp ArcSine::substitute(const shared_ptr<Exp>& replacement) const {
-    return make_unique<ArcSine>();
+dExp ArcSine::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return composeLeaf(*this, replacement);
 }
-dExp ArcCosine::substitute(const shared_ptr<Exp>& replacement) const {
-    return make_unique<ArcCosine>();
+dExp ArcCosine::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return composeLeaf(*this, replacement);
 }
-dExp ArcTangent::substitute(const shared_ptr<Exp>& replacement) const {
-    return make_unique<ArcTangent>();
+dExp ArcTangent::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return composeLeaf(*this, replacement);
 }
-dExp ArcCosecant::substitute(const shared_ptr<Exp>& replacement) const {
-    return make_unique<ArcCosecant>();
+dExp ArcCosecant::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return composeLeaf(*this, replacement);
 }
-dExp ArcSecant::substitute(const shared_ptr<Exp>& replacement) const {
-    return make_unique<ArcSecant>();
+dExp ArcSecant::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return composeLeaf(*this, replacement);
 }
-dExp ArcCotangent::substitute(const shared_ptr<Exp>& replacement) const {
-    return make_unique<ArcCotangent>();
+dExp ArcCotangent::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return composeLeaf(*this, replacement);
+}
+
+
+dExp Sqrt::clone() const {
+    return make_unique<Sqrt>(*this);
+}
+dExp ArcSine::clone() const {
+    return make_unique<ArcSine>(*this);
+}
+dExp ArcCosine::clone() const {
+    return make_unique<ArcCosine>(*this);
+}
+dExp ArcTangent::clone() const {
+    return make_unique<ArcTangent>(*this);
+}
+dExp ArcCosecant::clone() const {
+    return make_unique<ArcCosecant>(*this);
+}
+dExp ArcSecant::clone() const {
+    return make_unique<ArcSecant>(*this);
+}
+dExp ArcCotangent::clone() const {
+    return make_unique<ArcCotangent>(*this);
+}
+
+bool Sqrt::equals(const Exp& other) const {
+    auto r = as<Sqrt>(&other);
+    return r && sameExp(arg, r->arg);
+}
+size_t Sqrt::computeHashCode() const {
+    return hashCombine(static_cast<size_t>(Kind), arg->hashCode());
 }
 
 #endif
\ No newline at end of file
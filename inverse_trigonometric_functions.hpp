@@ -5,67 +5,104 @@
 
 class Sqrt : public Exp {
     public:
+        static constexpr ExpKind Kind = ExpKind::Sqrt;
         shared_ptr<Exp> arg;
         explicit Sqrt(shared_ptr<Exp> a);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 class ArcSine : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::ArcSine;
+        ArcSine() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class ArcCosine : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::ArcCosine;
+        ArcCosine() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class ArcTangent : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::ArcTangent;
+        ArcTangent() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class ArcCosecant : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::ArcCosecant;
+        ArcCosecant() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class ArcSecant : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::ArcSecant;
+        ArcSecant() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class ArcCotangent : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::ArcCotangent;
+        ArcCotangent() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 #endif
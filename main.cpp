@@ -1,8 +1,23 @@
+#include "node_arena.cpp"
+#include "expression_writer.cpp"
 #include "chain_rule.cpp"
+#include "poly_kernel.cpp"
+#include "rational.cpp"
 #include "polynomials_and_exponential_functions.cpp"
 #include "trigonometric_functions.cpp"
 #include "inverse_trigonometric_functions.cpp"
 #include "implicit_differentiation.cpp"
+#include "expression_store.cpp"
+#include "memo.cpp"
+#include "exp_stats.cpp"
+#include "exp_trace.cpp"
+#include "compiled_expression.cpp"
+#include "multivariable.cpp"
+#include "simd_math.cpp"
+#include "parallel_evaluator.cpp"
+#include "gradient_tape.cpp"
+#include "taylor_tape.cpp"
+#include "expression_parser.cpp"
 #include "expression_utils.hpp"
 
 #ifndef MAIN_CPP
@@ -13,21 +28,10 @@ using namespace std;
 
 int main() {
     // Find y' if sin(x + y) = (y^2) * cos(x).
-    ImplicitEquation equation = ImplicitEquation(
-        make_unique<SineComposed>(
-            make_unique<AddSub>(
-                make_shared<VariableX>(),
-                make_shared<VariableY>(),
-                '+'
-            )
-        ),
-        make_unique<Multiply>(
-            make_unique<Power>(make_shared<VariableY>(), 2),
-            make_unique<CosineComposed>(make_shared<VariableX>())
-        )
-    );
-    cout << "The implicit equation is: " << equation.toString() << endl;
-    dExp derivative = equation.derivative();
+    ExpParser parser;
+    unique_ptr<ImplicitEquation> equation = parser.parseEquation("sin(x + y) = y^2*cos(x)");
+    cout << "The implicit equation is: " << equation->toString() << endl;
+    dExp derivative = equation->derivative();
     cout << "The derivative dy/dx is: " << derivative->toString() << endl;
 
     return 0;
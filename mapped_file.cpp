@@ -0,0 +1,58 @@
+#ifndef MAPPED_FILE_CPP
+#define MAPPED_FILE_CPP
+
+#include "mapped_file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        reason = path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        reason = path + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            reason = path + ": " + strerror(errno);
+            length = 0;
+            ::close(fd);
+            return false;
+        }
+        base = static_cast<char*>(p);
+        mapped = true;
+        // Readers walk the file front to back.
+        madvise(p, length, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    reason.clear();
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped) munmap(base, length);
+    base = nullptr;
+    length = 0;
+    mapped = false;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Read-only view of a whole file through mmap. The mapping lives as long as the
+// object; an empty file maps to an empty view.
+class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // False (with the reason in error()) when the file cannot be opened or mapped.
+        bool open(const string& path);
+        void close();
+
+        const char* data() const { return base; }
+        size_t size() const { return length; }
+        string_view text() const { return string_view(base, length); }
+        const string& error() const { return reason; }
+
+    private:
+        char* base = nullptr;
+        size_t length = 0;
+        bool mapped = false;
+        string reason;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef MEMO_CPP
+#define MEMO_CPP
+
+#include "memo.hpp"
+
+#include "exp_trace.hpp"
+#include "expression_store.hpp"
+
+#include <atomic>
+
+using namespace std;
+
+static thread_local MemoSession* activeSession = nullptr;
+static thread_local SimplifyCounters counters;
+// Process-wide switch, flipped from any thread while others simplify; nothing else is
+// published through it, so relaxed ordering is enough.
+static atomic<bool> simplifiedShortcut{true};
+
+SimplifyCounters& simplifyCounters() {
+    return counters;
+}
+void setSimplifiedShortcut(bool enabled) {
+    simplifiedShortcut.store(enabled, memory_order_relaxed);
+}
+
+// A result of derivative() or simplify(), with its children interned while a store is
+// bound, so the output is built as a DAG as it goes.
+static dExp internedChildren(dExp node) {
+    if (ExpStore* store = ExpStore::current()) store->internChildren(*node);
+    return node;
+}
+// The same for a result shared as a child: the node itself is interned too.
+static shared_ptr<Exp> interned(dExp node) {
+    if (ExpStore* store = ExpStore::current()) return store->intern(move(node));
+    return shareNode(move(node));
+}
+
+dExp Exp::derivative() const {
+    TraceSpan span(TraceOp::Derivative, *this);
+#ifdef CALCULUS_STATS
+    StatsScope scope(expStats().derivative[static_cast<size_t>(nodeKind)]);
+#endif
+    return internedChildren(derivativeNode());
+}
+
+dExp Exp::simplify() const {
+    if (simplified && simplifiedShortcut.load(memory_order_relaxed)) {
+        ++counters.skips;
+        return internedChildren(clone());
+    }
+    ++counters.visits;
+    TraceSpan span(TraceOp::Simplify, *this);
+#ifdef CALCULUS_STATS
+    StatsScope scope(expStats().simplify[static_cast<size_t>(nodeKind)]);
+#endif
+    dExp result = simplifyNode();
+    result->simplified = true;
+    return internedChildren(move(result));
+}
+
+dExp Exp::substitute(const shared_ptr<Exp>& replacement) const {
+    TraceSpan span(TraceOp::Substitute, *this);
+    return substituteNode(replacement);
+}
+
+MemoSession::MemoSession() : previous(activeSession) {
+    activeSession = this;
+}
+MemoSession::~MemoSession() {
+    activeSession = previous;
+}
+MemoSession* MemoSession::current() {
+    return activeSession;
+}
+
+shared_ptr<Exp> MemoSession::derivative(const shared_ptr<Exp>& expr) {
+    auto it = derivatives.find(expr.get());
+    if (it != derivatives.end()) {
+        ++dHits;
+        return it->second.value;
+    }
+    ++dMisses;
+    shared_ptr<Exp> result = interned(expr->derivative());
+    derivatives[expr.get()] = Entry{expr, result};
+    // derivative() always ends with simplify(), so the result is its own simplification.
+    simplified.emplace(result.get(), Entry{result, result});
+    return result;
+}
+shared_ptr<Exp> MemoSession::simplify(const shared_ptr<Exp>& expr) {
+    auto it = simplified.find(expr.get());
+    if (it != simplified.end()) {
+        ++sHits;
+        return it->second.value;
+    }
+    ++sMisses;
+    shared_ptr<Exp> result = interned(expr->simplify());
+    simplified[expr.get()] = Entry{expr, result};
+    simplified.emplace(result.get(), Entry{result, result});
+    return result;
+}
+
+void MemoSession::clear() {
+    derivatives.clear();
+    simplified.clear();
+    dHits = 0;
+    dMisses = 0;
+    sHits = 0;
+    sMisses = 0;
+}
+
+shared_ptr<Exp> derivativeOf(const shared_ptr<Exp>& expr) {
+    if (activeSession) return activeSession->derivative(expr);
+    return interned(expr->derivative());
+}
+shared_ptr<Exp> simplifyOf(const shared_ptr<Exp>& expr) {
+    if (activeSession) return activeSession->simplify(expr);
+    return interned(expr->simplify());
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+#include "expression.hpp"
+
+#include <unordered_map>
+
+// Memo layer for derivative() and simplify(), keyed by node identity.
+// Construct a session on the stack around a batch of differentiation work: while it
+// is alive, child calls made through derivativeOf/simplifyOf on the same thread are
+// served from its caches. Sessions nest; the innermost one is used.
+class MemoSession {
+    public:
+        MemoSession();
+        ~MemoSession();
+        MemoSession(const MemoSession&) = delete;
+        MemoSession& operator=(const MemoSession&) = delete;
+
+        shared_ptr<Exp> derivative(const shared_ptr<Exp>& expr);
+        shared_ptr<Exp> simplify(const shared_ptr<Exp>& expr);
+
+        size_t derivativeHits() const { return dHits; }
+        size_t derivativeMisses() const { return dMisses; }
+        size_t simplifyHits() const { return sHits; }
+        size_t simplifyMisses() const { return sMisses; }
+        void clear();
+
+        static MemoSession* current();
+
+    private:
+        // The key is kept alive so its address cannot be reused by another node.
+        struct Entry {
+            shared_ptr<Exp> key;
+            shared_ptr<Exp> value;
+        };
+        unordered_map<const Exp*, Entry> derivatives;
+        unordered_map<const Exp*, Entry> simplified;
+        size_t dHits = 0;
+        size_t dMisses = 0;
+        size_t sHits = 0;
+        size_t sMisses = 0;
+        MemoSession* previous;
+};
+
+// Per-thread simplify() counters. visits counts nodes whose simplifyNode() rules ran;
+// skips counts nodes returned as they were because they were already simplified.
+struct SimplifyCounters {
+    size_t visits = 0;
+    size_t skips = 0;
+};
+SimplifyCounters& simplifyCounters();
+// On by default; turning it off makes simplify() rerun the rules on simplified nodes.
+void setSimplifiedShortcut(bool enabled);
+
+// Differentiate/simplify a child node, going through the active session if there is one
+// and interning the result in the bound ExpStore if there is one.
+shared_ptr<Exp> derivativeOf(const shared_ptr<Exp>& expr);
+shared_ptr<Exp> simplifyOf(const shared_ptr<Exp>& expr);
+
+#endif
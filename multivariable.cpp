@@ -0,0 +1,366 @@
+#ifndef MULTIVARIABLE_CPP
+#define MULTIVARIABLE_CPP
+
+#include "multivariable.hpp"
+
+#include "chain_rule.hpp"
+#include "expression_utils.hpp"
+#include "expression_writer.hpp"
+#include "polynomials_and_exponential_functions.hpp"
+#include "trigonometric_functions.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+static thread_local const Environment* activeEnvironment = nullptr;
+static thread_local PartialSession* activePartials = nullptr;
+
+Variable::Variable(uint32_t i) : Exp(Kind), index(i) {}
+void Variable::print(ExpWriter& out) const {
+    out << "x_";
+    out.number(index);
+}
+dExp Variable::derivativeNode() const {
+    return make_unique<Constant>(0);
+}
+dExp Variable::simplifyNode() const {
+    return make_unique<Variable>(index);
+}
+double Variable::evaluate(double x) const {
+    return variableValue(index);
+}
+void Variable::evaluate(const double* xs, double* out, size_t n) const {
+    fill(out, out + n, variableValue(index));
+}
+Dual Variable::evaluateWithDerivative(double x) const {
+    return Dual{variableValue(index), 0.0};
+}
+dExp Variable::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return make_unique<Variable>(index);
+}
+dExp Variable::clone() const {
+    return make_unique<Variable>(*this);
+}
+bool Variable::equals(const Exp& other) const {
+    auto v = as<Variable>(&other);
+    return v && v->index == index;
+}
+size_t Variable::computeHashCode() const {
+    return hashCombine(static_cast<size_t>(Kind), index);
+}
+
+shared_ptr<Exp> makeVariable(uint32_t index) {
+    if (index == 0) return makeNode<VariableX>();
+    return makeNode<Variable>(index);
+}
+
+const Environment* Environment::current() {
+    return activeEnvironment;
+}
+
+EnvironmentScope::EnvironmentScope(const Environment* env) : previous(activeEnvironment) {
+    activeEnvironment = env;
+}
+EnvironmentScope::~EnvironmentScope() {
+    activeEnvironment = previous;
+}
+
+double variableValue(uint32_t index) {
+    return activeEnvironment ? activeEnvironment->value(index) : NAN;
+}
+
+double evaluate(const Exp& expr, const Environment& env) {
+    EnvironmentScope scope(&env);
+    return expr.evaluate(env.value(0));
+}
+
+dExp Exp::derivative(uint32_t var) const {
+    if (var == 0) return derivative();
+    if (activePartials) return activePartials->partialNode(*this, var)->clone();
+    PartialSession session;
+    return session.partialNode(*this, var)->clone();
+}
+
+size_t PartialSession::KeyHash::operator()(const Key& k) const {
+    return hashCombine(hash<const Exp*>()(k.node), k.var);
+}
+
+PartialSession::PartialSession()
+    : zero(makeNode<Constant>(0)), one(makeNode<Constant>(1)), previous(activePartials) {
+    activePartials = this;
+}
+PartialSession::~PartialSession() {
+    activePartials = previous;
+}
+PartialSession* PartialSession::current() {
+    return activePartials;
+}
+
+static bool contains(const vector<uint32_t>& vars, uint32_t var) {
+    return binary_search(vars.begin(), vars.end(), var);
+}
+
+static vector<uint32_t> merged(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+    vector<uint32_t> out;
+    out.reserve(a.size() + b.size());
+    set_union(a.begin(), a.end(), b.begin(), b.end(), back_inserter(out));
+    return out;
+}
+
+const vector<uint32_t>& PartialSession::variables(const shared_ptr<Exp>& expr) {
+    auto it = variableSets.find(expr.get());
+    if (it != variableSets.end()) return it->second.vars;
+    vector<uint32_t> vars = variablesOf(*expr);
+    return variableSets.emplace(expr.get(), VariablesEntry{expr, move(vars)}).first->second.vars;
+}
+
+bool PartialSession::dependsOn(const shared_ptr<Exp>& expr, uint32_t var) {
+    return contains(variables(expr), var);
+}
+
+vector<uint32_t> PartialSession::variablesOf(const Exp& expr) {
+    switch (expr.kind()) {
+        case ExpKind::Constant:
+        case ExpKind::VariableY:
+        case ExpKind::DerivativeY:
+            return {};
+        case ExpKind::Variable:
+            return {static_cast<const Variable&>(expr).index};
+        case ExpKind::AddSub: {
+            auto& add = static_cast<const AddSub&>(expr);
+            return merged(variables(add.left), variables(add.right));
+        }
+        case ExpKind::Multiply: {
+            auto& mul = static_cast<const Multiply&>(expr);
+            return merged(variables(mul.left), variables(mul.right));
+        }
+        case ExpKind::Divide: {
+            auto& div = static_cast<const Divide&>(expr);
+            return merged(variables(div.left), variables(div.right));
+        }
+        case ExpKind::ChainRule: {
+            // The inner value only matters where the outer function reads x.
+            auto& chain = static_cast<const ChainRule&>(expr);
+            vector<uint32_t> outer = variables(chain.outer);
+            if (outer.empty() || outer[0] != 0) return outer;
+            outer.erase(outer.begin());
+            return merged(outer, variables(chain.inner));
+        }
+        case ExpKind::SineComposed: return variables(static_cast<const SineComposed&>(expr).arg);
+        case ExpKind::CosineComposed: return variables(static_cast<const CosineComposed&>(expr).arg);
+        case ExpKind::PowerComposed: return variables(static_cast<const PowerComposed&>(expr).arg);
+        case ExpKind::ExponentialComposed: return variables(static_cast<const ExponentialComposed&>(expr).arg);
+        case ExpKind::Sqrt: return variables(static_cast<const Sqrt&>(expr).arg);
+        default:
+            return {0}; // the leaves of x and Polynomial
+    }
+}
+
+shared_ptr<Exp> PartialSession::partial(const shared_ptr<Exp>& expr, uint32_t var) {
+    Key key{expr.get(), var};
+    auto it = partials.find(key);
+    if (it != partials.end()) {
+        ++hits;
+        return it->second.value;
+    }
+    ++misses;
+    shared_ptr<Exp> result = partialNode(*expr, var);
+    partials.emplace(key, Entry{expr, result});
+    return result;
+}
+
+static shared_ptr<Exp> settle(dExp expr) {
+    return shareNode(expr->simplify());
+}
+
+// A one-argument node as a function of x, so its partials follow the chain rule.
+static shared_ptr<Exp> outerAtX(const Exp& expr) {
+    shared_ptr<Exp> x = makeNode<VariableX>();
+    switch (expr.kind()) {
+        case ExpKind::SineComposed: return makeNode<SineComposed>(x);
+        case ExpKind::CosineComposed: return makeNode<CosineComposed>(x);
+        case ExpKind::PowerComposed: {
+            auto& p = static_cast<const PowerComposed&>(expr);
+            if (p.hasFraction) return makeNode<PowerComposed>(x, p.fraction);
+            return makeNode<PowerComposed>(x, p.exponent);
+        }
+        case ExpKind::ExponentialComposed: return makeNode<ExponentialComposed>(x);
+        default: return makeNode<Sqrt>(x);
+    }
+}
+
+// ∂f(g)/∂x_var = f'(g) ∂g/∂x_var, plus (∂f/∂x_var)(g) when f holds x_var itself.
+shared_ptr<Exp> PartialSession::chain(const shared_ptr<Exp>& outer, const shared_ptr<Exp>& inner, uint32_t var) {
+    shared_ptr<Exp> result;
+    if (dependsOn(outer, 0) && dependsOn(inner, var)) {
+        shared_ptr<Exp> outerAtInner = shareNode(derivativeOf(outer)->substitute(inner));
+        result = settle(make_unique<Multiply>(outerAtInner, partial(inner, var)));
+    }
+    if (dependsOn(outer, var)) {
+        shared_ptr<Exp> direct = shareNode(partial(outer, var)->substitute(inner));
+        result = result ? settle(make_unique<AddSub>(result, direct, '+')) : direct;
+    }
+    return result ? result : zero;
+}
+
+shared_ptr<Exp> PartialSession::partialNode(const Exp& expr, uint32_t var) {
+    if (!contains(variablesOf(expr), var)) return zero;
+    if (var == 0) return shareNode(expr.derivative());
+    switch (expr.kind()) {
+        case ExpKind::Variable:
+            return one;
+        case ExpKind::AddSub: {
+            auto& add = static_cast<const AddSub&>(expr);
+            if (!dependsOn(add.right, var)) return partial(add.left, var);
+            if (!dependsOn(add.left, var)) {
+                if (add.op == '+') return partial(add.right, var);
+                return settle(make_unique<Multiply>(makeNode<Constant>(-1), partial(add.right, var)));
+            }
+            return settle(make_unique<AddSub>(partial(add.left, var), partial(add.right, var), add.op));
+        }
+        case ExpKind::Multiply: {
+            auto& mul = static_cast<const Multiply&>(expr);
+            if (!dependsOn(mul.right, var)) return settle(make_unique<Multiply>(partial(mul.left, var), mul.right));
+            if (!dependsOn(mul.left, var)) return settle(make_unique<Multiply>(mul.left, partial(mul.right, var)));
+            return settle(make_unique<AddSub>(
+                makeNode<Multiply>(partial(mul.left, var), mul.right),
+                makeNode<Multiply>(mul.left, partial(mul.right, var)),
+                '+'
+            ));
+        }
+        case ExpKind::Divide: {
+            auto& div = static_cast<const Divide&>(expr);
+            if (!dependsOn(div.right, var)) return settle(make_unique<Divide>(partial(div.left, var), div.right));
+            shared_ptr<Exp> numerator;
+            if (!dependsOn(div.left, var)) {
+                numerator = makeNode<Multiply>(makeNode<Constant>(-1), makeNode<Multiply>(div.left, partial(div.right, var)));
+            } else {
+                numerator = makeNode<AddSub>(
+                    makeNode<Multiply>(partial(div.left, var), div.right),
+                    makeNode<Multiply>(div.left, partial(div.right, var)),
+                    '-'
+                );
+            }
+            return settle(make_unique<Divide>(numerator, makeNode<Multiply>(div.right, div.right)));
+        }
+        case ExpKind::ChainRule: {
+            auto& c = static_cast<const ChainRule&>(expr);
+            return chain(c.outer, c.inner, var);
+        }
+        case ExpKind::SineComposed: return chain(outerAtX(expr), static_cast<const SineComposed&>(expr).arg, var);
+        case ExpKind::CosineComposed: return chain(outerAtX(expr), static_cast<const CosineComposed&>(expr).arg, var);
+        case ExpKind::PowerComposed: return chain(outerAtX(expr), static_cast<const PowerComposed&>(expr).arg, var);
+        case ExpKind::ExponentialComposed:
+            return chain(outerAtX(expr), static_cast<const ExponentialComposed&>(expr).arg, var);
+        case ExpKind::Sqrt: return chain(outerAtX(expr), static_cast<const Sqrt&>(expr).arg, var);
+        default:
+            return zero; // the leaves of x only hold variable 0
+    }
+}
+
+shared_ptr<Exp> ExpMatrix::at(size_t row, size_t col) const {
+    auto it = lower_bound(entries.begin(), entries.end(), make_pair(row, col), [](const Entry& e, const pair<size_t, size_t>& rc) {
+        return e.row != rc.first ? e.row < rc.first : e.col < rc.second;
+    });
+    if (it == entries.end() || it->row != row || it->col != col) return nullptr;
+    return it->value;
+}
+
+static bool isZero(const shared_ptr<Exp>& expr) {
+    auto c = as<Constant>(expr);
+    return c && c->value == 0.0;
+}
+
+// Runs build with the active PartialSession, opening one for the call if there is none.
+template <class Build>
+static ExpMatrix withPartials(Build build) {
+    if (activePartials) return build(*activePartials);
+    PartialSession session;
+    return build(session);
+}
+
+// Row row of a Jacobian: the partials of f that are not structurally zero.
+static void gradientRow(PartialSession& session, const shared_ptr<Exp>& f, const vector<uint32_t>& vars, uint32_t row,
+                        ExpMatrix& out) {
+    for (size_t j = 0; j < vars.size(); ++j) {
+        shared_ptr<Exp> d = session.partial(f, vars[j]);
+        if (!isZero(d)) out.entries.push_back(ExpMatrix::Entry{row, static_cast<uint32_t>(j), d});
+    }
+}
+
+ExpMatrix gradient(const shared_ptr<Exp>& f, const vector<uint32_t>& vars) {
+    return jacobian({f}, vars);
+}
+
+ExpMatrix jacobian(const vector<shared_ptr<Exp>>& fs, const vector<uint32_t>& vars) {
+    return withPartials([&](PartialSession& session) {
+        ExpMatrix out;
+        out.rows = fs.size();
+        out.cols = vars.size();
+        for (size_t i = 0; i < fs.size(); ++i) gradientRow(session, fs[i], vars, static_cast<uint32_t>(i), out);
+        return out;
+    });
+}
+
+ExpMatrix hessian(const shared_ptr<Exp>& f, const vector<uint32_t>& vars) {
+    return withPartials([&](PartialSession& session) {
+        ExpMatrix out;
+        out.rows = vars.size();
+        out.cols = vars.size();
+        ExpMatrix g;
+        gradientRow(session, f, vars, 0, g);
+        vector<shared_ptr<Exp>> first(vars.size());
+        for (const auto& e : g.entries) first[e.col] = e.value;
+
+        for (size_t i = 0; i < vars.size(); ++i) {
+            if (!first[i]) continue;
+            for (size_t j = 0; j <= i; ++j) {
+                // Structurally zero when either mixed partial's source lacks the other variable.
+                if (!first[j] || !session.dependsOn(first[i], vars[j]) || !session.dependsOn(first[j], vars[i])) continue;
+                bool fromJ = session.variables(first[j]).size() < session.variables(first[i]).size();
+                shared_ptr<Exp> h = fromJ ? session.partial(first[j], vars[i]) : session.partial(first[i], vars[j]);
+                if (isZero(h)) continue;
+                out.entries.push_back(ExpMatrix::Entry{static_cast<uint32_t>(i), static_cast<uint32_t>(j), h});
+                if (i != j) out.entries.push_back(ExpMatrix::Entry{static_cast<uint32_t>(j), static_cast<uint32_t>(i), h});
+            }
+        }
+        sort(out.entries.begin(), out.entries.end(), [](const ExpMatrix::Entry& a, const ExpMatrix::Entry& b) {
+            return a.row != b.row ? a.row < b.row : a.col < b.col;
+        });
+        return out;
+    });
+}
+
+MatrixTape::MatrixTape(const ExpMatrix& matrix) : rows(matrix.rows), cols(matrix.cols) {
+    vector<const Exp*> exprs;
+    for (const auto& e : matrix.entries) {
+        exprs.push_back(e.value.get());
+        offsets.push_back(e.row * cols + e.col);
+    }
+    tape = compile(exprs, results);
+    regs.resize(tape.registers());
+}
+
+void MatrixTape::run(const Environment& env) {
+    double* r = regs.data();
+    r[CompiledExp::xReg] = env.value(0);
+    r[CompiledExp::yReg] = NAN;
+    r[CompiledExp::yPrimeReg] = NAN;
+    for (uint32_t v = CompiledExp::yPrimeReg + 1; v < tape.inputs; ++v) r[v] = env.value(v - CompiledExp::yPrimeReg);
+    tape.forward(r);
+}
+
+void MatrixTape::evaluateEntries(const Environment& env, double* values) {
+    run(env);
+    for (size_t k = 0; k < results.size(); ++k) values[k] = regs[results[k]];
+}
+
+void MatrixTape::evaluate(const Environment& env, double* out) {
+    run(env);
+    fill(out, out + rows * cols, 0.0);
+    for (size_t k = 0; k < results.size(); ++k) out[offsets[k]] = regs[results[k]];
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef MULTIVARIABLE_HPP
+#define MULTIVARIABLE_HPP
+
+#include "compiled_expression.hpp"
+#include "expression.hpp"
+#include "memo.hpp"
+
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+// x_i, one more independent variable next to x. x_0 is x itself and stays a VariableX
+// (makeVariable(0) returns one), so every existing tree is already a function of
+// variable 0 and Variable nodes have index 1 and up. To derivative() and substitute(),
+// which work in x, an x_i is a constant. It evaluates to its value in the thread's
+// current Environment, and to NaN while none is bound, as y does.
+class Variable : public Exp {
+    public:
+        static constexpr ExpKind Kind = ExpKind::Variable;
+        uint32_t index;
+        explicit Variable(uint32_t i);
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
+        double evaluate(double x) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
+};
+
+// x_index: a VariableX for 0, a Variable otherwise.
+shared_ptr<Exp> makeVariable(uint32_t index);
+
+// Values for the variables: value(0) is x, value(i) is x_i.
+class Environment {
+    public:
+        Environment() = default;
+        explicit Environment(vector<double> values) : values(move(values)) {}
+
+        size_t size() const { return values.size(); }
+        double& operator[](size_t index) { return values[index]; }
+        double operator[](size_t index) const { return values[index]; }
+        // NaN for a variable past the end.
+        double value(uint32_t index) const { return index < values.size() ? values[index] : NAN; }
+
+        // The innermost environment bound on this thread, or nullptr.
+        static const Environment* current();
+
+    private:
+        vector<double> values;
+};
+
+// Binds env on this thread for as long as the scope lives, for Exp::evaluate,
+// CompiledExp::evaluate(x) and evaluateGrid() to read x_i from. Scopes nest; nullptr
+// binds nothing, so x_i is NaN inside it.
+class EnvironmentScope {
+    public:
+        explicit EnvironmentScope(const Environment* env);
+        ~EnvironmentScope();
+        EnvironmentScope(const EnvironmentScope&) = delete;
+        EnvironmentScope& operator=(const EnvironmentScope&) = delete;
+
+    private:
+        const Environment* previous;
+};
+
+// x_index in the current environment; NaN without one.
+double variableValue(uint32_t index);
+// expr at x = env.value(0) with env bound.
+double evaluate(const Exp& expr, const Environment& env);
+
+// Memo layer for partial derivatives, the multivariable counterpart of MemoSession
+// (which it also opens, so derivatives in x share its cache). While it is alive on
+// the stack, Exp::derivative(var), gradient(), jacobian() and hessian() on the same
+// thread use it, so ∂u/∂x_i is built once for every subtree u that the components
+// have in common, and the components share those nodes.
+//
+// Each node's variables are worked out once as well. A partial with respect to a
+// variable the subtree does not contain is 0 without being built, and the product,
+// quotient and chain rules leave out the terms whose factor is such a zero.
+class PartialSession {
+    public:
+        PartialSession();
+        ~PartialSession();
+        PartialSession(const PartialSession&) = delete;
+        PartialSession& operator=(const PartialSession&) = delete;
+
+        // ∂expr/∂x_var, simplified; ∂/∂x_0 is derivative().
+        shared_ptr<Exp> partial(const shared_ptr<Exp>& expr, uint32_t var);
+        // The same for a node not held by a shared_ptr: not cached itself, though its
+        // children are.
+        shared_ptr<Exp> partialNode(const Exp& expr, uint32_t var);
+        // The variables expr contains, ascending; 0 is x. y and y' are not variables.
+        const vector<uint32_t>& variables(const shared_ptr<Exp>& expr);
+        bool dependsOn(const shared_ptr<Exp>& expr, uint32_t var);
+
+        size_t partialHits() const { return hits; }
+        size_t partialMisses() const { return misses; }
+
+        static PartialSession* current();
+
+    private:
+        struct Key {
+            const Exp* node;
+            uint32_t var;
+            bool operator==(const Key& o) const { return node == o.node && var == o.var; }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& k) const;
+        };
+        // The key node is kept alive so its address cannot be reused by another node.
+        struct Entry {
+            shared_ptr<Exp> key;
+            shared_ptr<Exp> value;
+        };
+        struct VariablesEntry {
+            shared_ptr<Exp> key;
+            vector<uint32_t> vars;
+        };
+        MemoSession memo;
+        unordered_map<Key, Entry, KeyHash> partials;
+        unordered_map<const Exp*, VariablesEntry> variableSets;
+        shared_ptr<Exp> zero;
+        shared_ptr<Exp> one;
+        size_t hits = 0;
+        size_t misses = 0;
+        PartialSession* previous;
+
+        vector<uint32_t> variablesOf(const Exp& expr);
+        shared_ptr<Exp> chain(const shared_ptr<Exp>& outer, const shared_ptr<Exp>& inner, uint32_t var);
+};
+
+// A rows x cols matrix of expressions that holds only the entries that are not
+// structurally zero, in row-major order; at() is nullptr for every other entry.
+struct ExpMatrix {
+    struct Entry {
+        uint32_t row;
+        uint32_t col;
+        shared_ptr<Exp> value;
+    };
+    size_t rows = 0;
+    size_t cols = 0;
+    vector<Entry> entries;
+
+    shared_ptr<Exp> at(size_t row, size_t col) const;
+    size_t nonZeros() const { return entries.size(); }
+};
+
+// The partials of f with respect to vars, as a 1 x vars.size() matrix.
+ExpMatrix gradient(const shared_ptr<Exp>& f, const vector<uint32_t>& vars);
+// Row i is the gradient of fs[i].
+ExpMatrix jacobian(const vector<shared_ptr<Exp>>& fs, const vector<uint32_t>& vars);
+// The second partials of f. Each pair i > j is built once, from the gradient
+// component that depends on fewer variables, and (i, j) and (j, i) hold the same node.
+ExpMatrix hessian(const shared_ptr<Exp>& f, const vector<uint32_t>& vars);
+
+// Every entry of an ExpMatrix on one CompiledExp, so what the entries have in common
+// (Hessian entries differentiated from the same gradient component, say) is computed
+// once per point.
+class MatrixTape {
+    public:
+        explicit MatrixTape(const ExpMatrix& matrix);
+
+        const CompiledExp& compiled() const { return tape; }
+        // The stored entries at env, in the order of matrix.entries.
+        void evaluateEntries(const Environment& env, double* values);
+        // All rows * cols values at env, row-major, structural zeros included.
+        void evaluate(const Environment& env, double* out);
+
+    private:
+        size_t rows;
+        size_t cols;
+        vector<size_t> offsets; // row * cols + col per entry
+        vector<uint32_t> results;
+        CompiledExp tape;
+        vector<double> regs;
+
+        void run(const Environment& env);
+};
+
+#endif
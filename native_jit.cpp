@@ -0,0 +1,278 @@
+#ifndef NATIVE_JIT_CPP
+#define NATIVE_JIT_CPP
+
+#include "native_jit.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Hex float, so the constant in the object is the exact double of the tape.
+static string cLiteral(double v) {
+    if (std::isnan(v)) return "NAN";
+    if (std::isinf(v)) return v > 0 ? "INFINITY" : "(-INFINITY)";
+    char buf[64];
+    snprintf(buf, sizeof buf, v < 0 || (v == 0 && signbit(v)) ? "(%a)" : "%a", v);
+    return buf;
+}
+
+static void emitTape(string& out, const CompiledExp& tape, const string& name) {
+    auto reg = [&](uint32_t r) -> string {
+        if (r == CompiledExp::xReg) return "x";
+        if (r < tape.firstConst()) return "NAN"; // y, y' and x_i are not parameters here
+        if (r < tape.firstTemp()) return cLiteral(tape.consts[r - tape.firstConst()]);
+        return "t" + to_string(r - tape.firstTemp());
+    };
+    out += "static inline double " + name + "_at(double x) {\n";
+    for (size_t i = 0; i < tape.code.size(); ++i) {
+        const TapeInstr& in = tape.code[i];
+        string a = reg(in.a);
+        string b = isBinaryTapeOp(in.op) ? reg(in.b) : string();
+        out += "    const double t" + to_string(i) + " = ";
+        switch (in.op) {
+            case TapeOp::Add: out += a + " + " + b; break;
+            case TapeOp::Sub: out += a + " - " + b; break;
+            case TapeOp::Mul: out += a + " * " + b; break;
+            case TapeOp::Div: out += b + " == 0 ? NAN : " + a + " / " + b; break;
+            case TapeOp::Pow: out += "pow(" + a + ", " + b + ")"; break;
+            case TapeOp::Recip: out += "1.0 / " + a; break;
+            case TapeOp::Square: out += a + " * " + a; break;
+            case TapeOp::Sqrt: out += "sqrt(" + a + ")"; break;
+            case TapeOp::Exp: out += "exp(" + a + ")"; break;
+            case TapeOp::Sin: out += "sin(" + a + ")"; break;
+            case TapeOp::Cos: out += "cos(" + a + ")"; break;
+            case TapeOp::Tan: out += "tan(" + a + ")"; break;
+            case TapeOp::Asin: out += "asin(" + a + ")"; break;
+            case TapeOp::Acos: out += "acos(" + a + ")"; break;
+            case TapeOp::Atan: out += "atan(" + a + ")"; break;
+        }
+        out += ";\n";
+    }
+    out += "    return " + reg(tape.result) + ";\n}\n";
+    out += "double " + name + "(double x) {\n    return " + name + "_at(x);\n}\n";
+    out += "void " + name + "_batch(const double* restrict xs, double* restrict out, size_t n) {\n";
+    out += "    for (size_t i = 0; i < n; ++i) out[i] = " + name + "_at(xs[i]);\n}\n";
+}
+
+string emitC(const vector<CompiledExp>& tapes, const string& header) {
+    string out;
+    if (!header.empty()) out += "/* " + header + " */\n";
+    out += "#include <math.h>\n#include <stddef.h>\n";
+    for (size_t k = 0; k < tapes.size(); ++k) {
+        out += "\n";
+        emitTape(out, tapes[k], "calc_f" + to_string(k));
+    }
+    return out;
+}
+
+double NativeExp::evaluate(double x, size_t order) const {
+    if (handle) return scalar[order](x);
+    return exprs[order]->evaluate(x);
+}
+
+void NativeExp::evaluate(const double* xs, double* out, size_t n, size_t order) const {
+    if (handle) {
+        batch[order](xs, out, n);
+    } else {
+        exprs[order]->evaluate(xs, out, n);
+    }
+}
+
+namespace {
+uint64_t fnv1a(const string& text) {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+string cacheDirectory(const JitOptions& options) {
+    if (!options.cacheDir.empty()) return options.cacheDir;
+    if (const char* dir = getenv("CALCULUS_JIT_CACHE")) {
+        if (*dir) return dir;
+    }
+    if (const char* xdg = getenv("XDG_CACHE_HOME")) {
+        if (*xdg == '/') return string(xdg) + "/calculus-jit";
+    }
+    if (const char* home = getenv("HOME")) {
+        if (*home) return string(home) + "/.cache/calculus-jit";
+    }
+    // No home to cache under; a name of our own, which ownsPrivately() still checks.
+    return "/tmp/calculus-jit-" + to_string(geteuid());
+}
+
+// True when path is ours and no one else may write to it.
+bool ownsPrivately(const struct stat& st) {
+    return st.st_uid == geteuid() && !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+bool makeDirectories(const string& dir, string& error) {
+    for (size_t at = 1; at <= dir.size(); ++at) {
+        if (at < dir.size() && dir[at] != '/') continue;
+        string prefix = dir.substr(0, at);
+        if (mkdir(prefix.c_str(), 0700) != 0 && errno != EEXIST) {
+            error = prefix + ": " + strerror(errno);
+            return false;
+        }
+    }
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0) {
+        error = dir + ": " + strerror(errno);
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode) || !ownsPrivately(st)) {
+        error = dir + ": not a directory that only this user can write to";
+        return false;
+    }
+    return true;
+}
+
+// A cached file is trusted only when it is a regular file of ours that no one else
+// may write to.
+bool trustedFile(const string& path) {
+    struct stat st;
+    return lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && ownsPrivately(st);
+}
+
+bool readFile(const string& path, string& text) {
+    ifstream in(path, ios::binary);
+    if (!in) return false;
+    ostringstream s;
+    s << in.rdbuf();
+    text = s.str();
+    return true;
+}
+
+bool writeFile(const string& path, const string& text) {
+    ofstream out(path, ios::binary);
+    out << text;
+    return static_cast<bool>(out);
+}
+
+// Runs argv with stdout and stderr going to logPath; true when it exits with 0.
+bool run(const vector<string>& args, const string& logPath, string& error) {
+    vector<char*> argv;
+    for (const string& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        error = string("fork: ") + strerror(errno);
+        return false;
+    }
+    if (pid == 0) {
+        int log = ::open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (log >= 0) {
+            dup2(log, 1);
+            dup2(log, 2);
+        }
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) return true;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+        error = "cannot run " + args[0];
+        return false;
+    }
+    string log;
+    readFile(logPath, log);
+    error = args[0] + " failed" + (log.empty() ? string() : ": " + log.substr(0, log.find('\n')));
+    return false;
+}
+
+bool load(const string& path, size_t orders, shared_ptr<void>& handle, vector<NativeExp::Function>& scalar,
+          vector<NativeExp::BatchFunction>& batch, string& error) {
+    void* h = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!h) {
+        error = dlerror();
+        return false;
+    }
+    shared_ptr<void> owner(h, [](void* p) { dlclose(p); });
+    scalar.assign(orders, nullptr);
+    batch.assign(orders, nullptr);
+    for (size_t k = 0; k < orders; ++k) {
+        string name = "calc_f" + to_string(k);
+        scalar[k] = reinterpret_cast<NativeExp::Function>(dlsym(h, name.c_str()));
+        batch[k] = reinterpret_cast<NativeExp::BatchFunction>(dlsym(h, (name + "_batch").c_str()));
+        if (!scalar[k] || !batch[k]) {
+            error = path + ": " + name + " is missing";
+            return false;
+        }
+    }
+    handle = owner;
+    return true;
+}
+}
+
+NativeExp compileNative(const shared_ptr<Exp>& expr, size_t derivatives, const JitOptions& options) {
+    NativeExp out;
+    out.exprs.push_back(expr);
+    for (size_t k = 0; k < derivatives; ++k) out.exprs.push_back(shareNode(out.exprs.back()->derivative()));
+
+    vector<CompiledExp> tapes;
+    for (const auto& e : out.exprs) tapes.push_back(compile(*e));
+    string compiler = options.compiler;
+    if (compiler.empty()) {
+        const char* cc = getenv("CC");
+        compiler = cc && *cc ? cc : "cc";
+    }
+    string source = emitC(tapes, compiler + " " + options.flags);
+
+    string dir = cacheDirectory(options);
+    if (!makeDirectories(dir, out.reason)) return out;
+    char hash[17];
+    snprintf(hash, sizeof hash, "%016llx", static_cast<unsigned long long>(fnv1a(source)));
+    string stem = dir + "/calc_" + hash;
+    out.path = stem + ".so";
+
+    string stored;
+    if (options.useCache && trustedFile(stem + ".c") && trustedFile(out.path) && readFile(stem + ".c", stored) &&
+        stored == source && load(out.path, out.orders(), out.handle, out.scalar, out.batch, out.reason)) {
+        out.cached = true;
+        return out;
+    }
+    out.reason.clear();
+
+    // Build under names of our own, then rename into place, so concurrent processes
+    // never load a half-written object.
+    string tmp = stem + "." + to_string(getpid()) + ".tmp";
+    if (!writeFile(tmp + ".c", source)) {
+        out.reason = tmp + ".c: cannot write the source";
+        return out;
+    }
+    vector<string> args{compiler};
+    istringstream flags(options.flags);
+    for (string flag; flags >> flag;) args.push_back(flag);
+    for (const char* a : {"-shared", "-fPIC", "-x", "c", "-o"}) args.push_back(a);
+    args.push_back(tmp + ".so");
+    args.push_back(tmp + ".c");
+    args.push_back("-lm");
+    bool built = run(args, tmp + ".log", out.reason) && rename((tmp + ".so").c_str(), out.path.c_str()) == 0 &&
+                 rename((tmp + ".c").c_str(), (stem + ".c").c_str()) == 0;
+    unlink((tmp + ".c").c_str());
+    unlink((tmp + ".so").c_str());
+    unlink((tmp + ".log").c_str());
+    if (!built) {
+        if (out.reason.empty()) out.reason = out.path + ": " + strerror(errno);
+        return out;
+    }
+    load(out.path, out.orders(), out.handle, out.scalar, out.batch, out.reason);
+    return out;
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef NATIVE_JIT_HPP
+#define NATIVE_JIT_HPP
+
+#include "compiled_expression.hpp"
+#include "expression.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct JitOptions {
+    string compiler;          // empty: $CC, else "cc"
+    string flags = "-O3 -fno-math-errno -ffp-contract=off";
+    // empty: $CALCULUS_JIT_CACHE, else $XDG_CACHE_HOME/calculus-jit, else
+    // ~/.cache/calculus-jit. It must belong to this user and be writable by no one else.
+    string cacheDir;
+    bool useCache = true;     // false compiles every time, still under cacheDir
+};
+
+// C99 source for the tapes: per tape k, "double calc_f<k>(double x)" and a
+// "void calc_f<k>_batch(const double* xs, double* out, size_t n)" loop over it that
+// the C compiler can vectorise. Both compute what CompiledExp::evaluate(x) does.
+string emitC(const vector<CompiledExp>& tapes, const string& header = string());
+
+// An expression and its first few derivatives as native code. compileNative() emits C
+// for the tapes of f, f', ..., compiles it into a shared object with the system
+// compiler and dlopens it. Objects are cached on disk under a hash of the generated
+// source, compiler and flags; a hit is used only when the source stored beside it is
+// the same text, so a hash collision costs a recompile, never wrong code. Code that
+// someone else could have put there is never loaded: a cache directory that another
+// user owns or may write to is refused, and a cached object or source that is not this
+// user's own, or that others may write to, is rebuilt.
+//
+// When there is no compiler, it fails, or the object cannot be loaded, the result
+// falls back to Exp::evaluate on the same expressions: evaluate() works either way and
+// error() says why native code is missing. Copies share the loaded object.
+class NativeExp {
+    public:
+        using Function = double (*)(double);
+        using BatchFunction = void (*)(const double*, double*, size_t);
+
+        bool isNative() const { return handle != nullptr; }
+        // True when the object came from the cache without running the compiler.
+        bool fromCache() const { return cached; }
+        const string& error() const { return reason; }
+        const string& objectPath() const { return path; }
+
+        // f is order 0; orders() is one more than the highest derivative compiled.
+        size_t orders() const { return exprs.size(); }
+        const shared_ptr<Exp>& expression(size_t order = 0) const { return exprs[order]; }
+        // nullptr when falling back.
+        Function function(size_t order = 0) const { return isNative() ? scalar[order] : nullptr; }
+        BatchFunction batchFunction(size_t order = 0) const { return isNative() ? batch[order] : nullptr; }
+
+        double evaluate(double x, size_t order = 0) const;
+        void evaluate(const double* xs, double* out, size_t n, size_t order = 0) const;
+
+    private:
+        friend NativeExp compileNative(const shared_ptr<Exp>&, size_t, const JitOptions&);
+
+        vector<shared_ptr<Exp>> exprs;
+        shared_ptr<void> handle; // dlclose()d with the last copy
+        vector<Function> scalar;
+        vector<BatchFunction> batch;
+        string path;
+        string reason;
+        bool cached = false;
+};
+
+NativeExp compileNative(const shared_ptr<Exp>& expr, size_t derivatives = 0, const JitOptions& options = JitOptions());
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef NODE_ARENA_CPP
+#define NODE_ARENA_CPP
+
+#include "node_arena.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// Address space reserved for chunks; pages are only committed as chunks are first used.
+const size_t regionSize = size_t(1) << 32;
+// Start of the reserved range, or 0 before the first arena chunk.
+atomic<uintptr_t> regionBase{0};
+thread_local NodeArena* currentArena = nullptr;
+
+// Chunks handed back by every thread. Never destroyed: nodes held by statics can
+// release their chunk during static destruction.
+struct ChunkPool {
+    mutex lock;
+    char* base = nullptr;
+    bool reserved = false;
+    size_t fresh = 0;
+    vector<void*> released;
+};
+ChunkPool& chunkPool() {
+    static ChunkPool* pool = new ChunkPool();
+    return *pool;
+}
+
+void* takeChunk() {
+    ChunkPool& pool = chunkPool();
+    lock_guard<mutex> hold(pool.lock);
+    if (!pool.reserved) {
+        pool.reserved = true;
+        size_t span = regionSize + NodeArena::chunkSize;
+        void* p = mmap(nullptr, span, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p != MAP_FAILED) {
+            uintptr_t at = reinterpret_cast<uintptr_t>(p);
+            at = (at + NodeArena::chunkSize - 1) & ~static_cast<uintptr_t>(NodeArena::chunkSize - 1);
+            pool.base = reinterpret_cast<char*>(at);
+            regionBase.store(at, memory_order_release);
+        }
+    }
+    if (!pool.released.empty()) {
+        void* c = pool.released.back();
+        pool.released.pop_back();
+        return c;
+    }
+    if (!pool.base || pool.fresh == regionSize / NodeArena::chunkSize) return nullptr;
+    char* c = pool.base + pool.fresh * NodeArena::chunkSize;
+    if (mprotect(c, NodeArena::chunkSize, PROT_READ | PROT_WRITE) != 0) return nullptr;
+    ++pool.fresh;
+    return c;
+}
+
+void giveChunk(void* c) {
+    madvise(c, NodeArena::chunkSize, MADV_DONTNEED);
+    ChunkPool& pool = chunkPool();
+    lock_guard<mutex> hold(pool.lock);
+    pool.released.push_back(c);
+}
+
+// Nodes held by statics can die after this thread's cache; they skip the cache then.
+thread_local bool chunkCacheAlive = false;
+struct ChunkCache {
+    vector<void*> chunks;
+    ChunkCache() { chunkCacheAlive = true; }
+    ~ChunkCache() {
+        chunkCacheAlive = false;
+        for (void* c : chunks) giveChunk(c);
+    }
+};
+thread_local ChunkCache chunkCache;
+}
+
+NodeArena::NodeArena() : previous(currentArena) {
+    currentArena = this;
+}
+
+NodeArena::~NodeArena() {
+    currentArena = previous;
+    if (chunk) releaseChunk(chunk);
+}
+
+NodeArena* NodeArena::current() {
+    return currentArena;
+}
+
+NodeArena::Chunk* NodeArena::acquireChunk() {
+    void* raw;
+    if (chunkCacheAlive && !chunkCache.chunks.empty()) {
+        raw = chunkCache.chunks.back();
+        chunkCache.chunks.pop_back();
+    } else {
+        raw = takeChunk();
+        if (!raw) return nullptr;
+    }
+    return new (raw) Chunk{{1}};
+}
+
+void NodeArena::releaseChunk(Chunk* c) noexcept {
+    if (c->refs.fetch_sub(1) != 1) return;
+    c->~Chunk();
+    if (chunkCacheAlive && chunkCache.chunks.size() < 16) {
+        chunkCache.chunks.push_back(c);
+    } else {
+        giveChunk(c);
+    }
+}
+
+void* NodeArena::bump(size_t total) {
+    if (!chunk || offset + total > chunkSize) {
+        Chunk* next = acquireChunk();
+        if (!next) return nullptr;
+        if (chunk) releaseChunk(chunk);
+        chunk = next;
+        offset = sizeof(Chunk);
+        ++chunkCount;
+    }
+    char* block = reinterpret_cast<char*>(chunk) + offset;
+    offset += total;
+    chunk->refs.fetch_add(1, memory_order_relaxed);
+    ++allocationCount;
+    byteCount += total;
+    return block;
+}
+
+void* NodeArena::allocate(size_t bytes) {
+    NodeArena* arena = currentArena;
+    if (arena) {
+        size_t total = (bytes + 15) & ~static_cast<size_t>(15);
+        if (total <= chunkSize / 4) {
+            if (void* p = arena->bump(total)) return p;
+        }
+    }
+    return ::operator new(bytes);
+}
+
+// Chunks are aligned to their size inside the reserved range, so a block's chunk is its
+// address rounded down, and anything outside the range came from the heap.
+void NodeArena::deallocate(void* p) noexcept {
+    uintptr_t at = reinterpret_cast<uintptr_t>(p);
+    uintptr_t base = regionBase.load(memory_order_relaxed);
+    if (base && at - base < regionSize) {
+        releaseChunk(reinterpret_cast<Chunk*>(at & ~static_cast<uintptr_t>(chunkSize - 1)));
+    } else {
+        ::operator delete(p);
+    }
+}
+
+#endif
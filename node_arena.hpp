@@ -0,0 +1,91 @@
+#ifndef NODE_ARENA_HPP
+#define NODE_ARENA_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+using namespace std;
+
+// Bump allocator for expression nodes. While a NodeArena is alive on a thread, every
+// node created on that thread (Exp::operator new, makeNode, shareNode) is carved out
+// of 64 KB chunks instead of coming from the general heap, so a differentiation
+// session's nodes sit next to each other and go back in bulk.
+//
+// Chunks come from one reserved address range and are aligned to their size, so a
+// node's chunk is its address rounded down and a heap node is one outside the range:
+// neither path carries a header. A chunk is released once the arena has moved past it
+// and all of its nodes are gone. Nodes may safely outlive the arena that made them;
+// they only keep their chunk alive. Released chunks are cached per thread for the next
+// session. Arenas nest; the innermost one is used.
+class NodeArena {
+    public:
+        NodeArena();
+        ~NodeArena();
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+
+        size_t allocations() const { return allocationCount; }
+        size_t bytes() const { return byteCount; }
+        size_t chunks() const { return chunkCount; }
+
+        static NodeArena* current();
+        // Used for all node memory. Without an active arena, or once the reserved range is
+        // used up, these are plain ::operator new and delete.
+        static void* allocate(size_t bytes);
+        static void deallocate(void* p) noexcept;
+
+        static const size_t chunkSize = 64 * 1024;
+
+    private:
+        struct alignas(16) Chunk {
+            atomic<size_t> refs;
+        };
+        Chunk* chunk = nullptr;
+        size_t offset = 0;
+        NodeArena* previous;
+        size_t allocationCount = 0;
+        size_t byteCount = 0;
+        size_t chunkCount = 0;
+
+        void* bump(size_t total);
+        static Chunk* acquireChunk();
+        static void releaseChunk(Chunk* c) noexcept;
+};
+
+// std allocator over NodeArena, for allocate_shared and containers of nodes.
+template <class T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() = default;
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        static_assert(alignof(T) <= 16, "NodeArena hands out 16-byte aligned blocks");
+        return static_cast<T*>(NodeArena::allocate(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t) noexcept {
+        NodeArena::deallocate(p);
+    }
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) { return true; }
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) { return false; }
+
+// make_shared with the node and its control block in one arena allocation.
+template <class T, class... Args>
+shared_ptr<T> makeNode(Args&&... args) {
+    return allocate_shared<T>(ArenaAllocator<T>(), std::forward<Args>(args)...);
+}
+
+// unique_ptr -> shared_ptr with the control block taken from the arena as well.
+template <class T>
+shared_ptr<T> shareNode(unique_ptr<T> node) {
+    return shared_ptr<T>(node.release(), default_delete<T>(), ArenaAllocator<T>());
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef PARALLEL_EVALUATOR_CPP
+#define PARALLEL_EVALUATOR_CPP
+
+#include "parallel_evaluator.hpp"
+
+#include "compiled_expression.hpp"
+#include "memo.hpp"
+#include "multivariable.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+WorkStealingPool::WorkStealingPool(size_t threadCount) {
+    if (threadCount == 0) threadCount = max<size_t>(1, thread::hardware_concurrency());
+    for (size_t i = 0; i < threadCount; ++i) workers.push_back(make_unique<Worker>());
+    for (size_t i = 1; i < threadCount; ++i) threads.emplace_back(&WorkStealingPool::threadMain, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        lock_guard<mutex> lk(jobLock);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+bool WorkStealingPool::popOrSteal(size_t self, size_t& task) {
+    {
+        Worker& own = *workers[self];
+        lock_guard<mutex> lk(own.lock);
+        if (!own.queue.empty()) {
+            task = own.queue.back();
+            own.queue.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < workers.size(); ++k) {
+        Worker& victim = *workers[(self + k) % workers.size()];
+        lock_guard<mutex> lk(victim.lock);
+        if (!victim.queue.empty()) {
+            task = victim.queue.front();
+            victim.queue.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::drain(size_t self) {
+    size_t task;
+    while (popOrSteal(self, task)) {
+        (*job)(task);
+        if (remaining.fetch_sub(1) == 1) {
+            lock_guard<mutex> lk(jobLock);
+            jobDone.notify_all();
+        }
+    }
+}
+
+void WorkStealingPool::threadMain(size_t self) {
+    size_t seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lk(jobLock);
+            jobReady.wait(lk, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        drain(self);
+    }
+}
+
+void WorkStealingPool::run(size_t tasks, const function<void(size_t)>& body) {
+    if (tasks == 0) return;
+    {
+        lock_guard<mutex> lk(jobLock);
+        job = &body;
+        remaining = tasks;
+        // Contiguous ranges per worker keep neighbouring chunks on one core until stolen.
+        for (size_t w = 0; w < workers.size(); ++w) {
+            lock_guard<mutex> qlk(workers[w]->lock);
+            size_t begin = tasks * w / workers.size();
+            size_t end = tasks * (w + 1) / workers.size();
+            for (size_t t = end; t-- > begin;) workers[w]->queue.push_front(t);
+        }
+        ++generation;
+    }
+    jobReady.notify_all();
+    drain(0);
+
+    unique_lock<mutex> lk(jobLock);
+    jobDone.wait(lk, [&] { return remaining.load() == 0; });
+    job = nullptr;
+}
+
+namespace {
+struct GridChunk {
+    size_t expr;
+    size_t begin;
+    size_t end;
+};
+}
+
+void evaluateGrid(WorkStealingPool& pool, const vector<const Exp*>& exprs,
+                  double x0, double x1, size_t n, const vector<double*>& outs) {
+    const size_t chunk = 8192;
+    const size_t lineDoubles = 64 / sizeof(double);
+
+    vector<CompiledExp> tapes;
+    vector<GridChunk> chunks;
+    for (size_t k = 0; k < exprs.size(); ++k) {
+        tapes.push_back(compile(*exprs[k]));
+        // First index whose output address starts a cache line.
+        uintptr_t addr = reinterpret_cast<uintptr_t>(outs[k]);
+        size_t aligned = addr % sizeof(double) == 0 ? ((64 - addr % 64) % 64) / sizeof(double) : 0;
+        size_t begin = 0;
+        size_t end = min(n, aligned % lineDoubles + chunk);
+        while (begin < n) {
+            chunks.push_back(GridChunk{k, begin, end});
+            begin = end;
+            end = min(n, end + chunk);
+        }
+    }
+
+    const double step = n > 1 ? (x1 - x0) / static_cast<double>(n - 1) : 0.0;
+    // Workers see the caller's x_1, x_2, ... rather than their own thread's.
+    const Environment* env = Environment::current();
+    pool.run(chunks.size(), [&](size_t task) {
+        EnvironmentScope scope(env);
+        const GridChunk& c = chunks[task];
+        double xs[batchBlock];
+        for (size_t start = c.begin; start < c.end; start += batchBlock) {
+            size_t m = min(batchBlock, c.end - start);
+            for (size_t i = 0; i < m; ++i) xs[i] = x0 + step * static_cast<double>(start + i);
+            tapes[c.expr].evaluate(xs, outs[c.expr] + start, m);
+        }
+    });
+}
+
+void evaluateWithDerivatives(WorkStealingPool& pool, const shared_ptr<Exp>& f, int order,
+                             double x0, double x1, size_t n, const vector<double*>& outs) {
+    vector<shared_ptr<Exp>> derivs{f};
+    {
+        MemoSession session;
+        for (int k = 1; k <= order; ++k) derivs.push_back(session.derivative(derivs.back()));
+    }
+    vector<const Exp*> exprs;
+    for (const auto& d : derivs) exprs.push_back(d.get());
+    evaluateGrid(pool, exprs, x0, x1, n, outs);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef PARALLEL_EVALUATOR_HPP
+#define PARALLEL_EVALUATOR_HPP
+
+#include "expression.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads with one task deque per worker. Workers take
+// tasks from the back of their own deque and steal from the front of the others'.
+// The thread calling run() takes part as worker 0.
+class WorkStealingPool {
+    public:
+        // threads == 0 sizes the pool to the machine.
+        explicit WorkStealingPool(size_t threads = 0);
+        ~WorkStealingPool();
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        size_t size() const { return workers.size(); }
+        // Runs body(task) for every task in [0, tasks) and returns once all have finished.
+        void run(size_t tasks, const function<void(size_t)>& body);
+
+    private:
+        struct alignas(64) Worker {
+            mutex lock;
+            deque<size_t> queue;
+        };
+        vector<unique_ptr<Worker>> workers;
+        vector<thread> threads;
+
+        mutex jobLock;
+        condition_variable jobReady;
+        condition_variable jobDone;
+        const function<void(size_t)>* job = nullptr;
+        size_t generation = 0;
+        atomic<size_t> remaining{0};
+        bool stopping = false;
+
+        bool popOrSteal(size_t self, size_t& task);
+        void drain(size_t self);
+        void threadMain(size_t self);
+};
+
+// Evaluates each expression at n evenly spaced points from x0 to x1 (inclusive) into
+// outs[k], which must hold n doubles. Work is split into chunks per expression whose
+// boundaries fall on 64-byte lines of the output, so no two tasks share a cache line.
+// Variables x_i take their values from the calling thread's Environment.
+void evaluateGrid(WorkStealingPool& pool, const vector<const Exp*>& exprs,
+                  double x0, double x1, size_t n, const vector<double*>& outs);
+
+// Evaluates f, f', ..., f^(order) over the grid; outs[k] receives the k-th derivative.
+void evaluateWithDerivatives(WorkStealingPool& pool, const shared_ptr<Exp>& f, int order,
+                             double x0, double x1, size_t n, const vector<double*>& outs);
+
+#endif
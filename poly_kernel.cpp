@@ -0,0 +1,232 @@
+#ifndef POLY_KERNEL_CPP
+#define POLY_KERNEL_CPP
+
+#include "poly_kernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// Below this many coefficients per operand the schoolbook product wins.
+static const size_t karatsubaCutoff = 32;
+
+// Dense when the degree span is short, or when at least a quarter of it is used.
+static bool preferDense(size_t span, size_t nonZero) {
+    return span <= 16 || span <= 4 * nonZero;
+}
+
+Poly Poly::invalid() {
+    Poly p;
+    p.ok = false;
+    return p;
+}
+
+Poly Poly::monomial(int degree, double coefficient) {
+    return fromSparse({{degree, coefficient}});
+}
+
+Poly Poly::fromTerms(vector<pair<int, double>> terms) {
+    return fromSparse(move(terms));
+}
+
+size_t Poly::nonZero() const {
+    size_t n = 0;
+    for (size_t i = 0; i < size(); ++i) n += coefficientAt(i) != 0.0;
+    return n;
+}
+
+int Poly::degree() const {
+    return size() == 0 ? -1 : degreeAt(size() - 1);
+}
+
+Poly Poly::fromDense(vector<double> c) {
+    while (!c.empty() && c.back() == 0.0) c.pop_back();
+    Poly p;
+    size_t nz = 0;
+    for (double v : c) nz += v != 0.0;
+    if (preferDense(c.size(), nz)) {
+        p.coeffs = move(c);
+        return p;
+    }
+    p.isDense = false;
+    p.sparse.reserve(nz);
+    for (size_t i = 0; i < c.size(); ++i) {
+        if (c[i] != 0.0) p.sparse.emplace_back(static_cast<int>(i), c[i]);
+    }
+    return p;
+}
+
+// terms must be sorted by degree with no repeats.
+Poly Poly::fromSparse(vector<pair<int, double>> terms) {
+    terms.erase(remove_if(terms.begin(), terms.end(),
+                          [](const pair<int, double>& t) { return t.second == 0.0; }),
+                terms.end());
+    Poly p;
+    size_t span = terms.empty() ? 0 : static_cast<size_t>(terms.back().first) + 1;
+    if (preferDense(span, terms.size())) {
+        p.coeffs.assign(span, 0.0);
+        for (const auto& t : terms) p.coeffs[t.first] = t.second;
+        return p;
+    }
+    p.isDense = false;
+    p.sparse = move(terms);
+    return p;
+}
+
+Poly polyAdd(const Poly& a, const Poly& b, double sign) {
+    if (!a.ok || !b.ok) return Poly::invalid();
+    if (a.isDense && b.isDense) {
+        vector<double> out = a.coeffs;
+        if (out.size() < b.coeffs.size()) out.resize(b.coeffs.size(), 0.0);
+        for (size_t i = 0; i < b.coeffs.size(); ++i) out[i] += sign * b.coeffs[i];
+        return Poly::fromDense(move(out));
+    }
+
+    vector<pair<int, double>> out;
+    out.reserve(a.size() + b.size());
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (j == b.size() || (i < a.size() && a.degreeAt(i) < b.degreeAt(j))) {
+            out.emplace_back(a.degreeAt(i), a.coefficientAt(i));
+            ++i;
+        } else if (i == a.size() || b.degreeAt(j) < a.degreeAt(i)) {
+            out.emplace_back(b.degreeAt(j), 0.0 + sign * b.coefficientAt(j));
+            ++j;
+        } else {
+            out.emplace_back(a.degreeAt(i), a.coefficientAt(i) + sign * b.coefficientAt(j));
+            ++i;
+            ++j;
+        }
+    }
+    return Poly::fromSparse(move(out));
+}
+
+Poly polyDerivative(const Poly& p) {
+    if (!p.ok) return Poly::invalid();
+    if (p.isDense) {
+        vector<double> out(p.coeffs.size() > 1 ? p.coeffs.size() - 1 : 0);
+        for (size_t i = 1; i < p.coeffs.size(); ++i) out[i - 1] = p.coeffs[i] * static_cast<double>(i);
+        return Poly::fromDense(move(out));
+    }
+    vector<pair<int, double>> out;
+    out.reserve(p.sparse.size());
+    for (const auto& t : p.sparse) {
+        if (t.first > 0) out.emplace_back(t.first - 1, t.second * static_cast<double>(t.first));
+    }
+    return Poly::fromSparse(move(out));
+}
+
+// out[0 .. n + m - 1) += a * b, summing each degree in (i, j) order.
+static void mulSchoolbook(const double* a, size_t n, const double* b, size_t m, double* out) {
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i] == 0.0) continue;
+        for (size_t j = 0; j < m; ++j) out[i + j] += a[i] * b[j];
+    }
+}
+
+// out[0 .. 2n - 1) = a * b for two length-n operands. scratch holds at least 8n doubles.
+static void mulKaratsuba(const double* a, const double* b, size_t n, double* out, double* scratch) {
+    fill(out, out + 2 * n - 1, 0.0);
+    if (n <= karatsubaCutoff) {
+        mulSchoolbook(a, n, b, n, out);
+        return;
+    }
+    size_t h = n / 2;
+    size_t k = n - h;
+    double* sa = scratch;
+    double* sb = sa + k;
+    double* mid = sb + k;
+    double* rest = mid + 2 * k - 1;
+
+    mulKaratsuba(a, b, h, out, rest);                  // low halves -> out[0 .. 2h - 1)
+    mulKaratsuba(a + h, b + h, k, out + 2 * h, rest);  // high halves -> out[2h .. 2n - 1)
+    for (size_t i = 0; i < k; ++i) {
+        sa[i] = a[h + i] + (i < h ? a[i] : 0.0);
+        sb[i] = b[h + i] + (i < h ? b[i] : 0.0);
+    }
+    mulKaratsuba(sa, sb, k, mid, rest);
+    for (size_t i = 0; i < 2 * h - 1; ++i) mid[i] -= out[i];
+    for (size_t i = 0; i < 2 * k - 1; ++i) mid[i] -= out[2 * h + i];
+    for (size_t i = 0; i < 2 * k - 1; ++i) out[h + i] += mid[i];
+}
+
+// True when every coefficient is an integer and every partial sum of a Karatsuba
+// product stays below 2^53, so any summation order gives the same exact result.
+static bool exactIntegerProduct(const vector<double>& a, const vector<double>& b) {
+    double la = 0, lb = 0;
+    for (double v : a) {
+        if (!isfinite(v) || v != floor(v)) return false;
+        la += fabs(v);
+    }
+    for (double v : b) {
+        if (!isfinite(v) || v != floor(v)) return false;
+        lb += fabs(v);
+    }
+    return la * lb <= ldexp(1.0, 51);
+}
+
+Poly polyMul(const Poly& a, const Poly& b) {
+    if (!a.ok || !b.ok) return Poly::invalid();
+    if (a.size() == 0 || b.size() == 0) return Poly();
+    size_t span = static_cast<size_t>(a.degree() + b.degree()) + 1;
+
+    if (a.isDense && b.isDense && min(a.coeffs.size(), b.coeffs.size()) > karatsubaCutoff &&
+        exactIntegerProduct(a.coeffs, b.coeffs)) {
+        const vector<double>& longer = a.coeffs.size() >= b.coeffs.size() ? a.coeffs : b.coeffs;
+        const vector<double>& shorter = a.coeffs.size() >= b.coeffs.size() ? b.coeffs : a.coeffs;
+        size_t m = shorter.size();
+        vector<double> out(span, 0.0);
+        vector<double> chunk(m), part(2 * m - 1), scratch(8 * m);
+        for (size_t off = 0; off < longer.size(); off += m) {
+            size_t len = min(m, longer.size() - off);
+            copy(longer.begin() + off, longer.begin() + off + len, chunk.begin());
+            fill(chunk.begin() + len, chunk.end(), 0.0);
+            mulKaratsuba(chunk.data(), shorter.data(), m, part.data(), scratch.data());
+            size_t used = min(part.size(), span - off);
+            for (size_t i = 0; i < used; ++i) out[off + i] += part[i];
+        }
+        return Poly::fromDense(move(out));
+    }
+
+    size_t nzA = a.nonZero();
+    size_t nzB = b.nonZero();
+    if (preferDense(span, nzA * nzB)) {
+        vector<double> out(span, 0.0);
+        if (a.isDense && b.isDense) {
+            mulSchoolbook(a.coeffs.data(), a.coeffs.size(), b.coeffs.data(), b.coeffs.size(), out.data());
+        } else {
+            for (size_t i = 0; i < a.size(); ++i) {
+                double ca = a.coefficientAt(i);
+                if (ca == 0.0) continue;
+                for (size_t j = 0; j < b.size(); ++j) {
+                    out[a.degreeAt(i) + b.degreeAt(j)] += ca * b.coefficientAt(j);
+                }
+            }
+        }
+        return Poly::fromDense(move(out));
+    }
+
+    // Scattered result: collect the products in (i, j) order, then a stable sort keeps
+    // that order within each degree.
+    vector<pair<int, double>> products;
+    products.reserve(nzA * nzB);
+    for (size_t i = 0; i < a.size(); ++i) {
+        double ca = a.coefficientAt(i);
+        if (ca == 0.0) continue;
+        for (size_t j = 0; j < b.size(); ++j) {
+            double cb = b.coefficientAt(j);
+            if (cb != 0.0) products.emplace_back(a.degreeAt(i) + b.degreeAt(j), ca * cb);
+        }
+    }
+    stable_sort(products.begin(), products.end(),
+                [](const pair<int, double>& l, const pair<int, double>& r) { return l.first < r.first; });
+    vector<pair<int, double>> out;
+    for (const auto& t : products) {
+        if (out.empty() || out.back().first != t.first) out.emplace_back(t.first, 0.0);
+        out.back().second += t.second;
+    }
+    return Poly::fromSparse(move(out));
+}
+
+#endif
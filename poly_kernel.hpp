@@ -0,0 +1,55 @@
+#ifndef POLY_KERNEL_HPP
+#define POLY_KERNEL_HPP
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// A polynomial in x with double coefficients, stored contiguously. The dense layout
+// keeps one coefficient per degree from 0 up; the sparse layout keeps sorted
+// (degree, coefficient) pairs and is picked when most degrees are missing, so x^1000
+// stays one entry. polyAdd and polyMul choose the layout of their result.
+//
+// Coefficients come out exactly as the old map<int, double> accumulation produced
+// them: each output degree sums its products in the same order, and the Karatsuba
+// path only runs when every partial sum is an exact integer.
+class Poly {
+    public:
+        bool ok = true; // false when the source expression is not a polynomial in x
+
+        static Poly invalid();
+        static Poly monomial(int degree, double coefficient);
+        // terms sorted by degree with no repeats; zero coefficients are dropped.
+        static Poly fromTerms(vector<pair<int, double>> terms);
+
+        bool dense() const { return isDense; }
+        // Stored entries, ascending by degree. A dense polynomial stores every degree,
+        // so some coefficients may be zero.
+        size_t size() const { return isDense ? coeffs.size() : sparse.size(); }
+        int degreeAt(size_t i) const { return isDense ? static_cast<int>(i) : sparse[i].first; }
+        double coefficientAt(size_t i) const { return isDense ? coeffs[i] : sparse[i].second; }
+
+    private:
+        bool isDense = true;
+        vector<double> coeffs;
+        vector<pair<int, double>> sparse;
+
+        size_t nonZero() const;
+        int degree() const; // -1 when empty
+        static Poly fromDense(vector<double> c);
+        static Poly fromSparse(vector<pair<int, double>> terms);
+
+        friend Poly polyAdd(const Poly& a, const Poly& b, double sign);
+        friend Poly polyMul(const Poly& a, const Poly& b);
+        friend Poly polyDerivative(const Poly& p);
+};
+
+// a + sign * b
+Poly polyAdd(const Poly& a, const Poly& b, double sign);
+Poly polyMul(const Poly& a, const Poly& b);
+// d/dx: every coefficient moves down one degree, scaled by its old degree.
+Poly polyDerivative(const Poly& p);
+
+#endif
@@ -5,98 +5,104 @@
 
 #include "chain_rule.hpp"
 #include "expression_utils.hpp"
+#include "expression_writer.hpp"
 #include "inverse_trigonometric_functions.hpp"
+#include "memo.hpp"
+#include "simd_math.hpp"
 #include "trigonometric_functions.hpp"
 
-#include <map>
+#include <algorithm>
 #include <utility>
 #include <vector>
 
 using namespace std;
 
 static inline shared_ptr<Exp> toShared(dExp expr) {
-    return shared_ptr<Exp>(move(expr));
+    return shareNode(move(expr));
 }
 static inline Constant* asConst(const shared_ptr<Exp>& expr) {
-    return dynamic_cast<Constant*>(expr.get());
+    return as<Constant>(expr.get());
 }
-static inline bool getRational(const Constant* c, long long& n, long long& d) {
+// The constant as an exact fraction: its own when it has one, otherwise the nearest
+// integer when the value is within 1e-9 of one that fits in 64 bits.
+static inline bool getRational(const Constant* c, Rational& r) {
     if (c->hasFraction) {
-        n = c->num;
-        d = c->den;
-        normaliseFraction(n, d);
+        r = c->fraction;
         return true;
     }
-    if (isIntegerDouble(c->value)) {
-        n = llround(c->value);
-        d = 1;
+    if (isIntegerDouble(c->value) && fabs(c->value) < 9.2e18) {
+        r = Rational(llround(c->value));
         return true;
     }
     return false;
 }
-static inline dExp makeRationalConst(long long n, long long d) {
-    normaliseFraction(n, d);
-    return make_unique<Constant>(n, d);
+static inline dExp makeRationalConst(const Rational& r) {
+    return make_unique<Constant>(r);
 }
 static inline bool isConstValue(const Exp* expr, double v) {
-    if (auto c = dynamic_cast<const Constant*>(expr)) {
+    if (auto c = as<Constant>(expr)) {
         return fabs(c->value - v) < 1e-12;
     }
     return false;
 }
 static inline bool isTangentExpr(const Exp* expr) {
-    return dynamic_cast<const Tangent*>(expr) != nullptr;
+    return as<Tangent>(expr) != nullptr;
 }
 static inline bool isSecantExpr(const Exp* expr) {
-    return dynamic_cast<const Secant*>(expr) != nullptr;
+    return as<Secant>(expr) != nullptr;
 }
 static inline bool isAddOnePlusTangent(const Exp* expr) {
-    auto add = dynamic_cast<const AddSub*>(expr);
+    auto add = as<AddSub>(expr);
     if (!add || add->op != '+') return false;
     if (isConstValue(add->left.get(), 1.0) && isTangentExpr(add->right.get())) return true;
     if (isConstValue(add->right.get(), 1.0) && isTangentExpr(add->left.get())) return true;
     return false;
 }
 static inline bool isTanTimesOnePlusTan(const Exp* expr) {
-    auto mul = dynamic_cast<const Multiply*>(expr);
+    auto mul = as<Multiply>(expr);
     if (!mul) return false;
     return (isTangentExpr(mul->left.get()) && isAddOnePlusTangent(mul->right.get())) ||
            (isTangentExpr(mul->right.get()) && isAddOnePlusTangent(mul->left.get()));
 }
 static inline bool isSecSquaredExpr(const Exp* expr) {
-    auto mul = dynamic_cast<const Multiply*>(expr);
+    auto mul = as<Multiply>(expr);
     if (!mul) return false;
     return isSecantExpr(mul->left.get()) && isSecantExpr(mul->right.get());
 }
 static inline bool isAddSubOrDivideExpr(const Exp* expr) {
-    return dynamic_cast<const AddSub*>(expr) || dynamic_cast<const Divide*>(expr);
+    return expr->kind() == ExpKind::AddSub || expr->kind() == ExpKind::Divide ||
+           expr->kind() == ExpKind::Polynomial;
 }
 static inline bool isPowerLikeExpr(const Exp* expr) {
-    return dynamic_cast<const Power*>(expr) || dynamic_cast<const PowerComposed*>(expr);
+    return expr->kind() == ExpKind::Power || expr->kind() == ExpKind::PowerComposed;
 }
 static inline bool isTrigLikeExpr(const Exp* expr) {
-    return dynamic_cast<const Sine*>(expr) ||
-           dynamic_cast<const Cosine*>(expr) ||
-           dynamic_cast<const Tangent*>(expr) ||
-           dynamic_cast<const Cosecant*>(expr) ||
-           dynamic_cast<const Secant*>(expr) ||
-           dynamic_cast<const Cotangent*>(expr) ||
-           dynamic_cast<const SineComposed*>(expr) ||
-           dynamic_cast<const CosineComposed*>(expr) ||
-           dynamic_cast<const ArcSine*>(expr) ||
-           dynamic_cast<const ArcCosine*>(expr) ||
-           dynamic_cast<const ArcTangent*>(expr) ||
-           dynamic_cast<const ArcCosecant*>(expr) ||
-           dynamic_cast<const ArcSecant*>(expr) ||
-           dynamic_cast<const ArcCotangent*>(expr);
+    switch (expr->kind()) {
+        case ExpKind::Sine:
+        case ExpKind::Cosine:
+        case ExpKind::Tangent:
+        case ExpKind::Cosecant:
+        case ExpKind::Secant:
+        case ExpKind::Cotangent:
+        case ExpKind::SineComposed:
+        case ExpKind::CosineComposed:
+        case ExpKind::ArcSine:
+        case ExpKind::ArcCosine:
+        case ExpKind::ArcTangent:
+        case ExpKind::ArcCosecant:
+        case ExpKind::ArcSecant:
+        case ExpKind::ArcCotangent:
+            return true;
+        default:
+            return false;
+    }
 }
 static inline bool isExponentialLikeExpr(const Exp* expr) {
-    return dynamic_cast<const Exponential*>(expr) ||
-           dynamic_cast<const ExponentialComposed*>(expr);
+    return expr->kind() == ExpKind::Exponential || expr->kind() == ExpKind::ExponentialComposed;
 }
 
 static void collectFactors(const shared_ptr<Exp>& expr, vector<shared_ptr<Exp>>& out) {
-    if (auto mul = dynamic_cast<Multiply*>(expr.get())) {
+    if (auto mul = as<Multiply>(expr.get())) {
         collectFactors(mul->left, out);
         collectFactors(mul->right, out);
         return;
@@ -104,17 +110,39 @@ static void collectFactors(const shared_ptr<Exp>& expr, vector<shared_ptr<Exp>>&
     out.push_back(expr);
 }
 
+static void collectFactors(const Exp* expr, vector<const Exp*>& out) {
+    while (auto mul = as<Multiply>(expr)) {
+        collectFactors(mul->left.get(), out);
+        expr = mul->right.get();
+    }
+    out.push_back(expr);
+}
+// What buildProductUnique(consts)->simplify() folds to, left to right, without the
+// nodes: exact while both sides are rational, in doubles after that.
+static Constant constantProduct(const vector<const Constant*>& consts) {
+    Constant acc = consts[0]->hasFraction ? Constant(consts[0]->fraction) : Constant(consts[0]->value);
+    for (size_t i = 1; i < consts.size(); ++i) {
+        Rational lr, rr;
+        if (getRational(&acc, lr) && getRational(consts[i], rr)) {
+            acc = Constant(lr * rr);
+        } else {
+            acc = Constant(acc.value * consts[i]->value);
+        }
+    }
+    return acc;
+}
+
 static shared_ptr<Exp> buildProduct(const vector<shared_ptr<Exp>>& factors) {
-    if (factors.empty()) return make_shared<Constant>(1.0);
+    if (factors.empty()) return makeNode<Constant>(1.0);
     shared_ptr<Exp> acc = factors[0];
     for (size_t i = 1; i < factors.size(); ++i) {
-        acc = make_shared<Multiply>(acc, factors[i]);
+        acc = makeNode<Multiply>(acc, factors[i]);
     }
     return acc;
 }
 static dExp buildProductUnique(const vector<shared_ptr<Exp>>& factors) {
     if (factors.empty()) return make_unique<Constant>(1.0);
-    if (factors.size() == 1) return factors[0]->simplify();
+    if (factors.size() == 1) return simplifyOf(factors[0])->clone();
     dExp acc = make_unique<Multiply>(factors[0], factors[1]);
     for (size_t i = 2; i < factors.size(); ++i) {
         acc = make_unique<Multiply>(toShared(move(acc)), factors[i]);
@@ -126,9 +154,8 @@ static bool extractCommonFactor(vector<shared_ptr<Exp>>& a,
                                 vector<shared_ptr<Exp>>& b,
                                 shared_ptr<Exp>& common) {
     for (size_t i = 0; i < a.size(); ++i) {
-        const string aStr = a[i]->toString();
         for (size_t j = 0; j < b.size(); ++j) {
-            if (aStr == b[j]->toString()) {
+            if (sameExp(a[i], b[j])) {
                 common = a[i];
                 a.erase(a.begin() + static_cast<long long>(i));
                 b.erase(b.begin() + static_cast<long long>(j));
@@ -142,19 +169,19 @@ static bool extractVariableFromPower(vector<shared_ptr<Exp>>& a,
                                      vector<shared_ptr<Exp>>& b,
                                      shared_ptr<Exp>& common) {
     for (size_t i = 0; i < a.size(); ++i) {
-        if (!dynamic_cast<VariableX*>(a[i].get())) continue;
+        if (!as<VariableX>(a[i].get())) continue;
         for (size_t j = 0; j < b.size(); ++j) {
-            auto p = dynamic_cast<Power*>(b[j].get());
+            auto p = as<Power>(b[j].get());
             if (!p || p->hasFraction) continue;
             if (!isInt(p->exponent) || p->exponent < 1) continue;
 
-            common = make_shared<VariableX>();
+            common = makeNode<VariableX>();
             double nextExp = p->exponent - 1;
             a.erase(a.begin() + static_cast<long long>(i));
             b.erase(b.begin() + static_cast<long long>(j));
             if (nextExp > 0) {
-                if (nextExp == 1) b.insert(b.begin(), make_shared<VariableX>());
-                else b.insert(b.begin(), make_shared<Power>(nextExp));
+                if (nextExp == 1) b.insert(b.begin(), makeNode<VariableX>());
+                else b.insert(b.begin(), makeNode<Power>(nextExp));
             }
             return true;
         }
@@ -162,79 +189,45 @@ static bool extractVariableFromPower(vector<shared_ptr<Exp>>& a,
     return false;
 }
 
-struct Poly {
-    bool ok = true;
-    map<int, double> terms;
-};
-
-static Poly polyAdd(const Poly& a, const Poly& b, double sign) {
-    Poly out;
-    if (!a.ok || !b.ok) {
-        out.ok = false;
-        return out;
-    }
-    out.terms = a.terms;
-    for (const auto& kv : b.terms) {
-        out.terms[kv.first] += sign * kv.second;
-    }
-    return out;
-}
-
-static Poly polyMul(const Poly& a, const Poly& b) {
-    Poly out;
-    if (!a.ok || !b.ok) {
-        out.ok = false;
-        return out;
-    }
-    for (const auto& ka : a.terms) {
-        for (const auto& kb : b.terms) {
-            out.terms[ka.first + kb.first] += ka.second * kb.second;
-        }
-    }
-    return out;
-}
-
 static Poly toPoly(const Exp* expr) {
-    Poly out;
-    if (auto c = dynamic_cast<const Constant*>(expr)) {
-        out.terms[0] = c->value;
-        return out;
-    }
-    if (dynamic_cast<const VariableX*>(expr)) {
-        out.terms[1] = 1.0;
-        return out;
-    }
-    if (auto p = dynamic_cast<const Power*>(expr)) {
-        if (isInt(p->exponent) && p->exponent >= 0) {
-            out.terms[static_cast<int>(llround(p->exponent))] = 1.0;
-            return out;
+    switch (expr->kind()) {
+        case ExpKind::Constant:
+            return Poly::monomial(0, static_cast<const Constant*>(expr)->value);
+        case ExpKind::VariableX:
+            return Poly::monomial(1, 1.0);
+        case ExpKind::Power: {
+            auto p = static_cast<const Power*>(expr);
+            if (isInt(p->exponent) && p->exponent >= 0) {
+                return Poly::monomial(static_cast<int>(llround(p->exponent)), 1.0);
+            }
+            return Poly::invalid();
         }
-        out.ok = false;
-        return out;
-    }
-    if (auto add = dynamic_cast<const AddSub*>(expr)) {
-        auto l = toPoly(add->left.get());
-        auto r = toPoly(add->right.get());
-        return polyAdd(l, r, add->op == '+' ? 1.0 : -1.0);
-    }
-    if (auto mul = dynamic_cast<const Multiply*>(expr)) {
-        auto l = toPoly(mul->left.get());
-        auto r = toPoly(mul->right.get());
-        return polyMul(l, r);
+        case ExpKind::AddSub: {
+            auto add = static_cast<const AddSub*>(expr);
+            auto l = toPoly(add->left.get());
+            if (!l.ok) return l;
+            auto r = toPoly(add->right.get());
+            return polyAdd(l, r, add->op == '+' ? 1.0 : -1.0);
+        }
+        case ExpKind::Multiply: {
+            auto mul = static_cast<const Multiply*>(expr);
+            auto l = toPoly(mul->left.get());
+            if (!l.ok) return l;
+            auto r = toPoly(mul->right.get());
+            return polyMul(l, r);
+        }
+        case ExpKind::Polynomial:
+            return static_cast<const Polynomial*>(expr)->poly;
+        default:
+            return Poly::invalid();
     }
-    out.ok = false;
-    return out;
-}
-
-static Poly toPoly(const shared_ptr<Exp>& expr) {
-    return toPoly(expr.get());
 }
 
 static dExp polyToExpr(const Poly& p) {
     dExp acc;
-    for (auto it = p.terms.rbegin(); it != p.terms.rend(); ++it) {
-        double coeff = it->second;
-        int exp = it->first;
+    for (size_t i = p.size(); i-- > 0;) {
+        double coeff = p.coefficientAt(i);
+        int exp = p.degreeAt(i);
         if (fabs(coeff) < 1e-12) continue;
         bool negative = coeff < 0.0;
         double abscoeff = fabs(coeff);
@@ -247,13 +240,13 @@ static dExp polyToExpr(const Poly& p) {
             if (exp == 1) base = make_unique<VariableX>();
             else base = make_unique<Power>(exp);
             if (abscoeff == 1.0) term = move(base);
-            else term = make_unique<Multiply>(make_shared<Constant>(abscoeff), toShared(move(base)));
+            else term = make_unique<Multiply>(makeNode<Constant>(abscoeff), toShared(move(base)));
         }
 
         if (!acc) {
             if (negative) {
                 if (exp == 0) acc = make_unique<Constant>(-abscoeff);
-                else acc = make_unique<Multiply>(make_shared<Constant>(-1.0), toShared(move(term)));
+                else acc = make_unique<Multiply>(makeNode<Constant>(-1.0), toShared(move(term)));
             } else {
                 acc = move(term);
             }
@@ -270,77 +263,102 @@ static dExp polyToExpr(const Poly& p) {
     return acc;
 }
 
-Constant::Constant(double v) : value(v) {}
-Constant::Constant(long long n, long long d) : value(static_cast<double>(n) / static_cast<double>(d)) {
-    hasFraction = true;
-    num = n;
-    den = d;
-    normaliseFraction(num, den);
+// polyToExpr's tree when p has at most one term, otherwise a Polynomial node.
+static dExp polyResult(const Poly& p) {
+    size_t terms = 0;
+    for (size_t i = 0; i < p.size(); ++i) terms += !(fabs(p.coefficientAt(i)) < 1e-12);
+    if (terms < 2) return polyToExpr(p);
+    return make_unique<Polynomial>(p);
+}
+
+// x^k for one Horner step.
+static inline double powerStep(double x, int k) {
+    return k == 1 ? x : pow(x, k);
 }
-string Constant::toString() const {
+// (v, dv) *= (x^k, k*x^(k-1)) for one forward-mode Horner step.
+static inline void dualPowerStep(double x, int k, double& v, double& dv) {
+    double xk = k == 1 ? x : pow(x, k);
+    double dxk = k == 1 ? 1.0 : k * pow(x, k - 1);
+    dv = dv * xk + v * dxk;
+    v *= xk;
+}
+
+Constant::Constant(double v) : Exp(Kind), value(v) {}
+Constant::Constant(long long n, long long d) : Constant(Rational(n, d)) {}
+Constant::Constant(const Rational& r) : Exp(Kind), value(r.toDouble()), hasFraction(true), fraction(r) {}
+void Constant::print(ExpWriter& out) const {
     if (hasFraction) {
-        return formatFraction(num, den);
+        out << fraction.toString();
+        return;
     }
-    return formatNumber(value);
+    out.number(value);
 }
-dExp Constant::derivative() const {
+dExp Constant::derivativeNode() const {
     return make_unique<Constant>(0);
 }
-dExp Constant::simplify() const {
-    if (hasFraction) return make_unique<Constant>(num, den);
+dExp Constant::simplifyNode() const {
+    if (hasFraction) return make_unique<Constant>(fraction);
     return make_unique<Constant>(value);
 }
 double Constant::evaluate(double x) const {
     return value;
 }
+void Constant::evaluate(const double* xs, double* out, size_t n) const {
+    fill(out, out + n, value);
+}
+Dual Constant::evaluateWithDerivative(double x) const {
+    return Dual{value, 0.0};
+}
 
-string VariableX::toString() const {
-    return "x";
+void VariableX::print(ExpWriter& out) const {
+    out << "x";
 }
-dExp VariableX::derivative() const {
+dExp VariableX::derivativeNode() const {
     return make_unique<Constant>(1);
 }
-dExp VariableX::simplify() const {
+dExp VariableX::simplifyNode() const {
     return make_unique<VariableX>();
 }
 double VariableX::evaluate(double x) const {
     return x;
 }
-
-Power::Power(double n) : exponent(n) {}
-Power::Power(long long n, long long d) : exponent(static_cast<double>(n) / static_cast<double>(d)) {
-    hasFraction = true;
-    num = n;
-    den = d;
-    normaliseFraction(num, den);
+void VariableX::evaluate(const double* xs, double* out, size_t n) const {
+    copy(xs, xs + n, out);
 }
-string Power::toString() const {
-    if (hasFraction) {
-        if (den == 1) return "x^" + to_string(num);
-        return "x^(" + formatFraction(num, den) + ")";
+Dual VariableX::evaluateWithDerivative(double x) const {
+    return Dual{x, 1.0};
+}
+
+Power::Power(double n) : Exp(Kind), exponent(n) {}
+Power::Power(long long n, long long d) : Power(Rational(n, d)) {}
+Power::Power(const Rational& r) : Exp(Kind), exponent(r.toDouble()), hasFraction(true), fraction(r) {}
+void Power::print(ExpWriter& out) const {
+    out << "x^";
+    if (!hasFraction) {
+        out.number(exponent);
+    } else if (fraction.isInteger()) {
+        out << fraction.toString();
+    } else {
+        out << '(' << fraction.toString() << ')';
     }
-    return "x^" + formatNumber(exponent);
 }
-dExp Power::derivative() const {
+dExp Power::derivativeNode() const {
     if (hasFraction) {
-        long long n = num;
-        long long d = den;
-        long long n_minus = n - d;
         return make_unique<Multiply>(
-            make_unique<Constant>(n, d),
-            make_unique<Power>(n_minus, d)
+            makeNode<Constant>(fraction),
+            makeNode<Power>(fraction - 1)
         )->simplify();
     }
     return make_unique<Multiply>(
-        make_unique<Constant>(exponent),
-        make_unique<Power>(exponent - 1)
+        makeNode<Constant>(exponent),
+        makeNode<Power>(exponent - 1)
     )->simplify();
 }
-dExp Power::simplify() const {
+dExp Power::simplifyNode() const {
     if (hasFraction) {
-        if (num == 0) return make_unique<Constant>(1);
-        if (den == 1 && num == 1) return make_unique<VariableX>();
-        return make_unique<Power>(num, den);
+        if (fraction.isZero()) return make_unique<Constant>(1);
+        if (fraction.isOne()) return make_unique<VariableX>();
+        return make_unique<Power>(fraction);
     }
     if (exponent == 0) return make_unique<Constant>(1);
     if (exponent == 1) return make_unique<VariableX>();
@@ -349,82 +367,107 @@ dExp Power::simplify() const {
 double Power::evaluate(double x) const {
     return pow(x, exponent);
 }
+void Power::evaluate(const double* xs, double* out, size_t n) const {
+    batchPow(xs, exponent, out, n);
+}
+Dual Power::evaluateWithDerivative(double x) const {
+    if (exponent == 0) return Dual{1.0, 0.0};
+    return Dual{pow(x, exponent), exponent * pow(x, exponent - 1)};
+}
 
-Exponential::Exponential(double a) : coefficient(a) {}
-string Exponential::toString() const {
-    if (coefficient == 1) return "e^x";
-    return "e^(" + formatNumber(coefficient) + "*x)";
+Exponential::Exponential(double a) : Exp(Kind), coefficient(a) {}
+void Exponential::print(ExpWriter& out) const {
+    if (coefficient == 1) {
+        out << "e^x";
+        return;
+    }
+    out << "e^(";
+    out.number(coefficient) << "*x)";
 }
-dExp Exponential::derivative() const {
+dExp Exponential::derivativeNode() const {
     return make_unique<Multiply>(
-        make_unique<Constant>(coefficient),
-        make_unique<Exponential>(coefficient)
+        makeNode<Constant>(coefficient),
+        makeNode<Exponential>(coefficient)
     )->simplify();
 }
-dExp Exponential::simplify() const {
+dExp Exponential::simplifyNode() const {
     return make_unique<Exponential>(coefficient);
 }
 double Exponential::evaluate(double x) const {
     return exp(coefficient * x);
 }
+void Exponential::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = coefficient * xs[i];
+    batchExp(out, out, n);
+}
+Dual Exponential::evaluateWithDerivative(double x) const {
+    double e = exp(coefficient * x);
+    return Dual{e, coefficient * e};
+}
 
-AddSub::AddSub(shared_ptr<Exp> l, shared_ptr<Exp> r, char o) : left(l), right(r), op(o) {}
-string AddSub::toString() const {
-    return left->toString() + " " + op + " " + right->toString();
+AddSub::AddSub(shared_ptr<Exp> l, shared_ptr<Exp> r, char o) : Exp(Kind), left(move(l)), right(move(r)), op(o) {}
+void AddSub::print(ExpWriter& out) const {
+    out << *left << ' ' << op << ' ' << *right;
 }
-dExp AddSub::derivative() const {
-    return make_unique<AddSub>(left->derivative(), right->derivative(), op)->simplify();
+dExp AddSub::derivativeNode() const {
+    return make_unique<AddSub>(derivativeOf(left), derivativeOf(right), op)->simplify();
 }
-dExp AddSub::simplify() const {
-    auto l = left->simplify();
-    auto r = right->simplify();
-    auto p = polyAdd(toPoly(l.get()), toPoly(r.get()), op == '+' ? 1.0 : -1.0);
-    if (p.ok) return polyToExpr(p);
+dExp AddSub::simplifyNode() const {
+    auto lShared = simplifyOf(left);
+    auto rShared = simplifyOf(right);
+    auto lp = toPoly(lShared.get());
+    if (lp.ok) {
+        auto p = polyAdd(lp, toPoly(rShared.get()), op == '+' ? 1.0 : -1.0);
+        if (p.ok) {
+            countRule(SimplifyRule::PolyFastPath);
+            return polyResult(p);
+        }
+    }
 
-    auto lShared = toShared(move(l));
-    auto rShared = toShared(move(r));
     auto lc = asConst(lShared);
     auto rc = asConst(rShared);
 
     if (lc && rc) {
-        long long ln, ld, rn, rd;
-        if (getRational(lc, ln, ld) && getRational(rc, rn, rd)) {
-            long long num = (op == '+') ? (ln * rd + rn * ld) : (ln * rd - rn * ld);
-            long long den = ld * rd;
-            return makeRationalConst(num, den);
+        countRule(SimplifyRule::ConstantFold);
+        Rational lr, rr;
+        if (getRational(lc, lr) && getRational(rc, rr)) {
+            return makeRationalConst(op == '+' ? lr + rr : lr - rr);
         }
         double v = (op == '+') ? (lc->value + rc->value) : (lc->value - rc->value);
         return make_unique<Constant>(v);
     }
 
+    if ((lc && lc->value == 0.0) || (rc && rc->value == 0.0)) countRule(SimplifyRule::ZeroOperand);
     if (op == '+') {
-        if (lc && lc->value == 0.0) return move(r);
-        if (rc && rc->value == 0.0) return move(l);
+        if (lc && lc->value == 0.0) return rShared->clone();
+        if (rc && rc->value == 0.0) return lShared->clone();
     } else {
-        if (rc && rc->value == 0.0) return move(l);
+        if (rc && rc->value == 0.0) return lShared->clone();
         if (lc && lc->value == 0.0) {
             if (rc) {
-                long long rn, rd;
-                if (getRational(rc, rn, rd)) {
-                    return makeRationalConst(-rn, rd);
+                Rational rr;
+                if (getRational(rc, rr)) {
+                    return makeRationalConst(-rr);
                 }
                 return make_unique<Constant>(-rc->value);
             }
-            return make_unique<Multiply>(make_shared<Constant>(-1.0), rShared)->simplify();
+            return make_unique<Multiply>(makeNode<Constant>(-1.0), rShared)->simplify();
         }
     }
 
     if (op == '-' && isTanTimesOnePlusTan(lShared.get()) && isSecSquaredExpr(rShared.get())) {
+        countRule(SimplifyRule::TanSecIdentity);
         return make_unique<AddSub>(
-            make_unique<Tangent>(),
-            make_unique<Constant>(1),
+            makeNode<Tangent>(),
+            makeNode<Constant>(1),
             '-'
         )->simplify();
     }
     if (op == '-' && isSecSquaredExpr(lShared.get()) && isTanTimesOnePlusTan(rShared.get())) {
+        countRule(SimplifyRule::TanSecIdentity);
         return make_unique<AddSub>(
-            make_unique<Constant>(1),
-            make_unique<Tangent>(),
+            makeNode<Constant>(1),
+            makeNode<Tangent>(),
             '-'
         )->simplify();
     }
@@ -437,22 +480,25 @@ dExp AddSub::simplify() const {
     shared_ptr<Exp> common;
     if (extractCommonFactor(lf, rf, common)) {
         if (!isConstValue(common.get(), 1.0) && !isConstValue(common.get(), -1.0)) {
+            countRule(SimplifyRule::CommonFactor);
             auto restL = buildProduct(lf);
             auto restR = buildProduct(rf);
-            auto inner = make_shared<AddSub>(restL, restR, op);
+            auto inner = makeNode<AddSub>(restL, restR, op);
             return make_unique<Multiply>(common, inner)->simplify();
         }
     }
     if (extractVariableFromPower(lf, rf, common)) {
+        countRule(SimplifyRule::VariableFromPower);
         auto restL = buildProduct(lf);
         auto restR = buildProduct(rf);
-        auto inner = make_shared<AddSub>(restL, restR, op);
+        auto inner = makeNode<AddSub>(restL, restR, op);
         return make_unique<Multiply>(common, inner)->simplify();
     }
     if (extractVariableFromPower(rf, lf, common)) {
+        countRule(SimplifyRule::VariableFromPower);
         auto restL = buildProduct(rf);
         auto restR = buildProduct(lf);
-        auto inner = make_shared<AddSub>(restL, restR, op);
+        auto inner = makeNode<AddSub>(restL, restR, op);
         return make_unique<Multiply>(common, inner)->simplify();
     }
 
@@ -462,102 +508,118 @@ double AddSub::evaluate(double x) const {
     if (op == '+') return left->evaluate(x) + right->evaluate(x);
     return left->evaluate(x) - right->evaluate(x);
 }
-
-Multiply::Multiply(shared_ptr<Exp> l, shared_ptr<Exp> r) : left(l), right(r) {}
-string Multiply::toString() const {
-    vector<shared_ptr<Exp>> factors;
-    collectFactors(left, factors);
-    collectFactors(right, factors);
-
-    if (factors.size() == 2) {
-        if (dynamic_cast<Sine*>(factors[0].get()) && dynamic_cast<Sine*>(factors[1].get())) return "sin^2(x)";
-        if (dynamic_cast<Cosine*>(factors[0].get()) && dynamic_cast<Cosine*>(factors[1].get())) return "cos^2(x)";
-        if (dynamic_cast<Tangent*>(factors[0].get()) && dynamic_cast<Tangent*>(factors[1].get())) return "tan^2(x)";
-        if (dynamic_cast<Secant*>(factors[0].get()) && dynamic_cast<Secant*>(factors[1].get())) return "sec^2(x)";
-        if (dynamic_cast<Cosecant*>(factors[0].get()) && dynamic_cast<Cosecant*>(factors[1].get())) return "csc^2(x)";
-        if (dynamic_cast<Cotangent*>(factors[0].get()) && dynamic_cast<Cotangent*>(factors[1].get())) return "cot^2(x)";
+void AddSub::evaluate(const double* xs, double* out, size_t n) const {
+    double tmp[batchBlock];
+    for (size_t start = 0; start < n; start += batchBlock) {
+        size_t m = min(batchBlock, n - start);
+        double* o = out + start;
+        left->evaluate(xs + start, o, m);
+        right->evaluate(xs + start, tmp, m);
+        if (op == '+') {
+            for (size_t i = 0; i < m; ++i) o[i] += tmp[i];
+        } else {
+            for (size_t i = 0; i < m; ++i) o[i] -= tmp[i];
+        }
+    }
+}
+Dual AddSub::evaluateWithDerivative(double x) const {
+    Dual l = left->evaluateWithDerivative(x);
+    Dual r = right->evaluateWithDerivative(x);
+    if (op == '+') return Dual{l.value + r.value, l.deriv + r.deriv};
+    return Dual{l.value - r.value, l.deriv - r.deriv};
+}
+
+Multiply::Multiply(shared_ptr<Exp> l, shared_ptr<Exp> r) : Exp(Kind), left(move(l)), right(move(r)) {}
+void Multiply::print(ExpWriter& out) const {
+    vector<const Exp*> factors;
+    collectFactors(left.get(), factors);
+    collectFactors(right.get(), factors);
+
+    if (factors.size() == 2 && factors[0]->kind() == factors[1]->kind()) {
+        switch (factors[0]->kind()) {
+            case ExpKind::Sine: out << "sin^2(x)"; return;
+            case ExpKind::Cosine: out << "cos^2(x)"; return;
+            case ExpKind::Tangent: out << "tan^2(x)"; return;
+            case ExpKind::Secant: out << "sec^2(x)"; return;
+            case ExpKind::Cosecant: out << "csc^2(x)"; return;
+            case ExpKind::Cotangent: out << "cot^2(x)"; return;
+            default: break;
+        }
     }
 
     bool hasTrigOrExp = false;
-    for (const auto& f : factors) {
-        if (isTrigLikeExpr(f.get()) || isExponentialLikeExpr(f.get())) {
+    for (const Exp* f : factors) {
+        if (isTrigLikeExpr(f) || isExponentialLikeExpr(f)) {
             hasTrigOrExp = true;
             break;
         }
     }
 
-    vector<shared_ptr<Exp>> consts;
-    vector<shared_ptr<Exp>> addsubs;
-    vector<shared_ptr<Exp>> others;
-    for (const auto& f : factors) {
-        if (asConst(f)) {
-            consts.push_back(f);
-        } else if (isAddSubOrDivideExpr(f.get())) {
+    vector<const Constant*> consts;
+    vector<const Exp*> addsubs;
+    vector<const Exp*> others;
+    for (const Exp* f : factors) {
+        if (auto c = as<Constant>(f)) {
+            consts.push_back(c);
+        } else if (isAddSubOrDivideExpr(f)) {
             addsubs.push_back(f);
-        } else if (hasTrigOrExp && isPowerLikeExpr(f.get())) {
+        } else if (hasTrigOrExp && isPowerLikeExpr(f)) {
             addsubs.push_back(f);
         } else {
             others.push_back(f);
         }
     }
 
-    dExp constProd;
+    bool first = true;
+    auto separate = [&] {
+        if (!first) out << '*';
+        first = false;
+    };
     if (!consts.empty()) {
-        constProd = buildProductUnique(consts);
-        constProd = constProd->simplify();
-        if (auto c = asConst(toShared(move(constProd)))) {
-            if (c->value == 0.0) return "0";
-            if (c->value == 1.0) {
-                constProd.reset();
-            }
+        Constant product = constantProduct(consts);
+        if (product.value == 0.0) {
+            out << '0';
+            return;
+        }
+        if (product.value != 1.0) {
+            separate();
+            out << product;
         }
     }
-
-    vector<string> parts;
-    if (constProd) parts.push_back(constProd->toString());
-    for (const auto& o : others) parts.push_back(o->toString());
-    for (const auto& a : addsubs) parts.push_back("(" + a->toString() + ")");
-
-    if (parts.empty()) return "1";
-    string out = parts[0];
-    for (size_t i = 1; i < parts.size(); ++i) {
-        out += "*" + parts[i];
+    for (const Exp* o : others) {
+        separate();
+        out << *o;
+    }
+    for (const Exp* a : addsubs) {
+        separate();
+        out << '(' << *a << ')';
     }
-    return out;
+    if (first) out << '1';
 }
-dExp Multiply::derivative() const {
+dExp Multiply::derivativeNode() const {
     return make_unique<AddSub>(
-        make_unique<Multiply>(left->derivative(), right),
-        make_unique<Multiply>(left, right->derivative()),
+        makeNode<Multiply>(derivativeOf(left), right),
+        makeNode<Multiply>(left, derivativeOf(right)),
         '+'
     )->simplify();
 }
-dExp Multiply::simplify() const {
-    auto l = left->simplify();
-    auto r = right->simplify();
-
-    auto lShared = toShared(move(l));
-    auto rShared = toShared(move(r));
+dExp Multiply::simplifyNode() const {
+    auto lShared = simplifyOf(left);
+    auto rShared = simplifyOf(right);
     auto lc = asConst(lShared);
     auto rc = asConst(rShared);
 
     if (lc && rc) {
-        long long ln, ld, rn, rd;
-        if (getRational(lc, ln, ld) && getRational(rc, rn, rd)) {
-            return makeRationalConst(ln * rn, ld * rd);
+        Rational lr, rr;
+        if (getRational(lc, lr) && getRational(rc, rr)) {
+            return makeRationalConst(lr * rr);
         }
         return make_unique<Constant>(lc->value * rc->value);
     }
     if (lc && lc->value == 0.0) return make_unique<Constant>(0);
     if (rc && rc->value == 0.0) return make_unique<Constant>(0);
-    if (lc && lc->value == 1.0) return rShared->simplify();
-    if (rc && rc->value == 1.0) return lShared->simplify();
-    if (lc && lc->value == -1.0) {
-        return make_unique<Multiply>(make_shared<Constant>(-1.0), rShared)->simplify();
-    }
-    if (rc && rc->value == -1.0) {
-        return make_unique<Multiply>(make_shared<Constant>(-1.0), lShared)->simplify();
-    }
+    if (lc && lc->value == 1.0) return rShared->clone();
+    if (rc && rc->value == 1.0) return lShared->clone();
 
     vector<shared_ptr<Exp>> lf;
     vector<shared_ptr<Exp>> rf;
@@ -574,18 +636,17 @@ dExp Multiply::simplify() const {
         else nonconsts.push_back(f);
     }
 
-    dExp constProd;
+    shared_ptr<Exp> constProd;
     if (!consts.empty()) {
-        constProd = buildProductUnique(consts);
-        constProd = constProd->simplify();
-        if (auto c = asConst(toShared(move(constProd)))) {
+        constProd = toShared(buildProductUnique(consts)->simplify());
+        if (auto c = asConst(constProd)) {
             if (c->value == 0.0) return make_unique<Constant>(0);
             if (c->value == 1.0) constProd.reset();
         }
     }
 
     vector<shared_ptr<Exp>> merged;
-    if (constProd) merged.push_back(toShared(move(constProd)));
+    if (constProd) merged.push_back(constProd);
     for (auto& f : nonconsts) merged.push_back(f);
 
     return buildProductUnique(merged);
@@ -593,40 +654,53 @@ dExp Multiply::simplify() const {
 double Multiply::evaluate(double x) const {
     return left->evaluate(x) * right->evaluate(x);
 }
+void Multiply::evaluate(const double* xs, double* out, size_t n) const {
+    double tmp[batchBlock];
+    for (size_t start = 0; start < n; start += batchBlock) {
+        size_t m = min(batchBlock, n - start);
+        double* o = out + start;
+        left->evaluate(xs + start, o, m);
+        right->evaluate(xs + start, tmp, m);
+        for (size_t i = 0; i < m; ++i) o[i] *= tmp[i];
+    }
+}
+Dual Multiply::evaluateWithDerivative(double x) const {
+    Dual l = left->evaluateWithDerivative(x);
+    Dual r = right->evaluateWithDerivative(x);
+    return Dual{l.value * r.value, l.deriv * r.value + l.value * r.deriv};
+}
 
-Divide::Divide(shared_ptr<Exp> l, shared_ptr<Exp> r) : left(l), right(r) {}
-string Divide::toString() const {
-    return "(" + left->toString() + ")/(" + right->toString() + ")";
+Divide::Divide(shared_ptr<Exp> l, shared_ptr<Exp> r) : Exp(Kind), left(move(l)), right(move(r)) {}
+void Divide::print(ExpWriter& out) const {
+    out << '(' << *left << ")/(" << *right << ')';
 }
-dExp Divide::derivative() const {
+dExp Divide::derivativeNode() const {
     return make_unique<Divide>(
-        make_unique<AddSub>(
-            make_unique<Multiply>(left->derivative(), right),
-            make_unique<Multiply>(left, right->derivative()),
+        makeNode<AddSub>(
+            makeNode<Multiply>(derivativeOf(left), right),
+            makeNode<Multiply>(left, derivativeOf(right)),
             '-'
         ),
-        make_unique<Multiply>(right, right)
+        makeNode<Multiply>(right, right)
     )->simplify();
 }
-dExp Divide::simplify() const {
-    auto l = left->simplify();
-    auto r = right->simplify();
-    auto lShared = toShared(move(l));
-    auto rShared = toShared(move(r));
+dExp Divide::simplifyNode() const {
+    auto lShared = simplifyOf(left);
+    auto rShared = simplifyOf(right);
     auto lc = asConst(lShared);
     auto rc = asConst(rShared);
 
     if (lc && rc) {
-        long long ln, ld, rn, rd;
-        if (getRational(lc, ln, ld) && getRational(rc, rn, rd) && rn != 0) {
-            return makeRationalConst(ln * rd, ld * rn);
+        Rational lr, rr;
+        if (getRational(lc, lr) && getRational(rc, rr) && !rr.isZero()) {
+            return makeRationalConst(lr / rr);
         }
         return make_unique<Constant>(lc->value / rc->value);
     }
     if (lc && lc->value == 0.0) return make_unique<Constant>(0);
-    if (rc && rc->value == 1.0) return move(lShared)->simplify();
+    if (rc && rc->value == 1.0) return lShared->clone();
     if (rc && rc->value == -1.0) {
-        return make_unique<Multiply>(make_shared<Constant>(-1.0), lShared)->simplify();
+        return make_unique<Multiply>(makeNode<Constant>(-1.0), lShared)->simplify();
     }
 
     return make_unique<Divide>(lShared, rShared);
@@ -636,41 +710,264 @@ double Divide::evaluate(double x) const {
     if (denom == 0) return NAN;
     return left->evaluate(x) / denom;
 }
+void Divide::evaluate(const double* xs, double* out, size_t n) const {
+    double tmp[batchBlock];
+    for (size_t start = 0; start < n; start += batchBlock) {
+        size_t m = min(batchBlock, n - start);
+        double* o = out + start;
+        left->evaluate(xs + start, o, m);
+        right->evaluate(xs + start, tmp, m);
+        for (size_t i = 0; i < m; ++i) o[i] = tmp[i] == 0 ? NAN : o[i] / tmp[i];
+    }
+}
+Dual Divide::evaluateWithDerivative(double x) const {
+    Dual r = right->evaluateWithDerivative(x);
+    if (r.value == 0) return Dual{NAN, NAN};
+    Dual l = left->evaluateWithDerivative(x);
+    return Dual{l.value / r.value, (l.deriv * r.value - l.value * r.deriv) / (r.value * r.value)};
+}
+
+Polynomial::Polynomial(const Poly& p) : Exp(Kind) {
+    vector<pair<int, double>> terms;
+    terms.reserve(p.size());
+    for (size_t i = 0; i < p.size(); ++i) {
+        double c = p.coefficientAt(i);
+        if (!(fabs(c) < 1e-12)) terms.emplace_back(p.degreeAt(i), c);
+    }
+    poly = Poly::fromTerms(move(terms));
+}
+// Same text as polyToExpr(poly)->toString(), without building the chain.
+void Polynomial::print(ExpWriter& out) const {
+    bool first = true;
+    for (size_t i = poly.size(); i-- > 0;) {
+        double coeff = poly.coefficientAt(i);
+        if (coeff == 0.0) continue;
+        int exp = poly.degreeAt(i);
+        double shown = coeff;
+        if (!first) {
+            out << (coeff < 0.0 ? " - " : " + ");
+            shown = fabs(coeff);
+        }
+        // The leading term keeps its sign on the coefficient, so -1 still prints.
+        if (exp == 0 || shown != 1.0) {
+            out.number(shown);
+            if (exp != 0) out << '*';
+        }
+        if (exp == 1) {
+            out << 'x';
+        } else if (exp != 0) {
+            out << "x^";
+            out.number(exp);
+        }
+        first = false;
+    }
+    if (first) out << '0';
+}
+dExp Polynomial::derivativeNode() const {
+    return make_unique<Polynomial>(polyDerivative(poly))->simplify();
+}
+dExp Polynomial::simplifyNode() const {
+    return polyResult(poly);
+}
+double Polynomial::evaluate(double x) const {
+    double acc = 0.0;
+    int prev = -1; // degree of the last term folded in
+    for (size_t i = poly.size(); i-- > 0;) {
+        double c = poly.coefficientAt(i);
+        if (c == 0.0) continue;
+        int d = poly.degreeAt(i);
+        if (prev >= 0) acc *= powerStep(x, prev - d);
+        acc += c;
+        prev = d;
+    }
+    if (prev > 0) acc *= powerStep(x, prev);
+    return acc;
+}
+void Polynomial::evaluate(const double* xs, double* out, size_t n) const {
+    double step[batchBlock];
+    for (size_t start = 0; start < n; start += batchBlock) {
+        size_t m = min(batchBlock, n - start);
+        const double* x = xs + start;
+        double* o = out + start;
+        fill(o, o + m, 0.0);
+        int prev = -1;
+        auto scale = [&](int k) {
+            if (k == 1) {
+                for (size_t i = 0; i < m; ++i) o[i] *= x[i];
+                return;
+            }
+            batchPow(x, k, step, m);
+            for (size_t i = 0; i < m; ++i) o[i] *= step[i];
+        };
+        for (size_t t = poly.size(); t-- > 0;) {
+            double c = poly.coefficientAt(t);
+            if (c == 0.0) continue;
+            int d = poly.degreeAt(t);
+            if (prev >= 0) scale(prev - d);
+            for (size_t i = 0; i < m; ++i) o[i] += c;
+            prev = d;
+        }
+        if (prev > 0) scale(prev);
+    }
+}
+Dual Polynomial::evaluateWithDerivative(double x) const {
+    double v = 0.0;
+    double dv = 0.0;
+    int prev = -1;
+    for (size_t i = poly.size(); i-- > 0;) {
+        double c = poly.coefficientAt(i);
+        if (c == 0.0) continue;
+        int d = poly.degreeAt(i);
+        if (prev >= 0) dualPowerStep(x, prev - d, v, dv);
+        v += c;
+        prev = d;
+    }
+    if (prev > 0) dualPowerStep(x, prev, v, dv);
+    return Dual{v, dv};
+}
 
-dExp Constant::substitute(const shared_ptr<Exp>& replacement) const {
-    if (hasFraction) return make_unique<Constant>(num, den);
+dExp Constant::substituteNode(const shared_ptr<Exp>& replacement) const {
+    if (hasFraction) return make_unique<Constant>(fraction);
     return make_unique<Constant>(value);
 }
-dExp VariableX::substitute(const shared_ptr<Exp>& replacement) const {
+dExp VariableX::substituteNode(const shared_ptr<Exp>& replacement) const {
     return dExp(move(replacement->simplify()));
 }
-dExp Power::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Power::substituteNode(const shared_ptr<Exp>& replacement) const {
     if (hasFraction) {
-        return make_unique<PowerComposed>(replacement, num, den)->simplify();
+        return make_unique<PowerComposed>(replacement, fraction)->simplify();
     }
     return make_unique<PowerComposed>(replacement, exponent)->simplify();
 }
-dExp Exponential::substitute(const shared_ptr<Exp>& replacement) const {
-    return make_unique<Exponential>(coefficient);
+dExp Exponential::substituteNode(const shared_ptr<Exp>& replacement) const {
+    if (coefficient == 1.0) return make_unique<ExponentialComposed>(replacement)->simplify();
+    return make_unique<ExponentialComposed>(
+        makeNode<Multiply>(makeNode<Constant>(coefficient), replacement)
+    )->simplify();
 }
-dExp AddSub::substitute(const shared_ptr<Exp>& replacement) const {
+dExp AddSub::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<AddSub>(
         left->substitute(replacement),
         right->substitute(replacement),
         op
     )->simplify();
 }
-dExp Multiply::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Multiply::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<Multiply>(
         left->substitute(replacement),
         right->substitute(replacement)
     )->simplify();
 }
-dExp Divide::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Divide::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<Divide>(
         left->substitute(replacement),
         right->substitute(replacement)
     )->simplify();
 }
+dExp Polynomial::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return polyToExpr(poly)->substitute(replacement);
+}
+
+
+dExp VariableX::clone() const {
+    return make_unique<VariableX>(*this);
+}
+dExp Constant::clone() const {
+    return make_unique<Constant>(*this);
+}
+dExp Power::clone() const {
+    return make_unique<Power>(*this);
+}
+dExp Exponential::clone() const {
+    return make_unique<Exponential>(*this);
+}
+dExp AddSub::clone() const {
+    return make_unique<AddSub>(*this);
+}
+dExp Multiply::clone() const {
+    return make_unique<Multiply>(*this);
+}
+dExp Divide::clone() const {
+    return make_unique<Divide>(*this);
+}
+dExp Polynomial::clone() const {
+    return make_unique<Polynomial>(*this);
+}
+
+bool sameNumber(double a, const Rational* fa, double b, const Rational* fb) {
+    if (fa && fb) return *fa == *fb;
+    if (fa) return fa->isExactDouble() && a == b;
+    if (fb) return fb->isExactDouble() && a == b;
+    return a == b;
+}
+// A fraction that is exactly its double hashes as that double, so it meets the bare
+// doubles it equals.
+size_t numberHash(double v, const Rational* f) {
+    size_t h = hash<double>()(v);
+    return f && !f->isExactDouble() ? hashCombine(h, f->hashCode()) : h;
+}
+
+bool Constant::equals(const Exp& other) const {
+    auto c = as<Constant>(&other);
+    return c && sameNumber(value, hasFraction ? &fraction : nullptr, c->value, c->hasFraction ? &c->fraction : nullptr);
+}
+size_t Constant::computeHashCode() const {
+    return hashCombine(static_cast<size_t>(Kind), numberHash(value, hasFraction ? &fraction : nullptr));
+}
+bool Power::equals(const Exp& other) const {
+    auto p = as<Power>(&other);
+    return p && sameNumber(exponent, hasFraction ? &fraction : nullptr, p->exponent, p->hasFraction ? &p->fraction : nullptr);
+}
+size_t Power::computeHashCode() const {
+    return hashCombine(static_cast<size_t>(Kind), numberHash(exponent, hasFraction ? &fraction : nullptr));
+}
+bool Exponential::equals(const Exp& other) const {
+    auto e = as<Exponential>(&other);
+    return e && e->coefficient == coefficient;
+}
+size_t Exponential::computeHashCode() const {
+    return hashCombine(static_cast<size_t>(Kind), hash<double>()(coefficient));
+}
+bool AddSub::equals(const Exp& other) const {
+    auto add = as<AddSub>(&other);
+    return add && add->op == op && sameExp(left, add->left) && sameExp(right, add->right);
+}
+size_t AddSub::computeHashCode() const {
+    size_t h = hashCombine(static_cast<size_t>(Kind), static_cast<size_t>(op));
+    h = hashCombine(h, left->hashCode());
+    return hashCombine(h, right->hashCode());
+}
+bool Multiply::equals(const Exp& other) const {
+    auto mul = as<Multiply>(&other);
+    return mul && sameExp(left, mul->left) && sameExp(right, mul->right);
+}
+size_t Multiply::computeHashCode() const {
+    size_t h = hashCombine(static_cast<size_t>(Kind), left->hashCode());
+    return hashCombine(h, right->hashCode());
+}
+bool Divide::equals(const Exp& other) const {
+    auto div = as<Divide>(&other);
+    return div && sameExp(left, div->left) && sameExp(right, div->right);
+}
+size_t Divide::computeHashCode() const {
+    size_t h = hashCombine(static_cast<size_t>(Kind), left->hashCode());
+    return hashCombine(h, right->hashCode());
+}
+bool Polynomial::equals(const Exp& other) const {
+    auto p = as<Polynomial>(&other);
+    if (!p || p->poly.size() != poly.size()) return false;
+    for (size_t i = 0; i < poly.size(); ++i) {
+        if (p->poly.degreeAt(i) != poly.degreeAt(i) || p->poly.coefficientAt(i) != poly.coefficientAt(i)) return false;
+    }
+    return true;
+}
+size_t Polynomial::computeHashCode() const {
+    size_t h = static_cast<size_t>(Kind);
+    for (size_t i = 0; i < poly.size(); ++i) {
+        h = hashCombine(h, static_cast<size_t>(poly.degreeAt(i)));
+        h = hashCombine(h, hash<double>()(poly.coefficientAt(i)));
+    }
+    return h;
+}
 
 #endif
\ No newline at end of file
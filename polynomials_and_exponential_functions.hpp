@@ -2,90 +2,169 @@
 #define POLYNOMIALS_AND_EXPONENTIAL_FUNCTIONS_HPP
 
 #include "expression.hpp"
+#include "poly_kernel.hpp"
+#include "rational.hpp"
 
 class VariableX : public Exp {
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::VariableX;
+        VariableX() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
+// Equality and hashing for a number held as a double with an optional exact fraction
+// (nullptr when there is none), as Constant, Power and PowerComposed hold theirs. Two
+// fractions must be equal; a fraction and a bare double are equal only when the
+// fraction is exactly that double, so 2/1 is 2 but 1/3 is not 0.3333333333333333.
+bool sameNumber(double a, const Rational* fa, double b, const Rational* fb);
+size_t numberHash(double v, const Rational* f);
+
 class Constant : public Exp {   // Rule #1: (c*f)' = c*f'
     public:
+        static constexpr ExpKind Kind = ExpKind::Constant;
         double value;
         bool hasFraction = false;
-        long long num = 0;
-        long long den = 1;
+        Rational fraction; // exact value when hasFraction
         Constant(double v);
         Constant(long long n, long long d);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        explicit Constant(const Rational& r);
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 
 class Power : public Exp {  // Rule #2: (x^n)' = n*x^(n-1)
     public:
+        static constexpr ExpKind Kind = ExpKind::Power;
         double exponent;
         bool hasFraction = false;
-        long long num = 0;
-        long long den = 1;
+        Rational fraction; // exact exponent when hasFraction
         Power(double n);
         Power(long long n, long long d);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        explicit Power(const Rational& r);
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 class Exponential : public Exp { // Rule #3: (e^(a*x))' = a*e^(a*x)
     public:
+        static constexpr ExpKind Kind = ExpKind::Exponential;
         double coefficient;
         Exponential(double a);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 class AddSub : public Exp {  // Rule #4: (f ± g)' = f' ± g'
     public:
+        static constexpr ExpKind Kind = ExpKind::AddSub;
         shared_ptr<Exp> left, right;
         char op;
         AddSub(shared_ptr<Exp> l, shared_ptr<Exp> r, char o);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 class Multiply : public Exp { // Rule #5: (f*g)' = f'*g + f*g'
     public:
+        static constexpr ExpKind Kind = ExpKind::Multiply;
         shared_ptr<Exp> left, right;
         Multiply(shared_ptr<Exp> l, shared_ptr<Exp> r);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 class Divide : public Exp { // Rule #6: (f/g)' = (f'*g - f*g')/g^2
     public:
+        static constexpr ExpKind Kind = ExpKind::Divide;
         shared_ptr<Exp> left, right;
         Divide(shared_ptr<Exp> l, shared_ptr<Exp> r);
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
+        double evaluate(double x) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
+};
+
+// A polynomial in x kept as its coefficients. AddSub::simplify() returns one whenever
+// the result has two or more terms, so the next simplify() reads the coefficients back
+// instead of rebuilding them from a chain of AddSub/Multiply/Power nodes. It prints
+// exactly as that chain would, differentiates by shifting coefficients, and evaluates
+// with Horner's rule. Terms below 1e-12 in magnitude are dropped on construction.
+class Polynomial : public Exp {
+    public:
+        static constexpr ExpKind Kind = ExpKind::Polynomial;
+        Poly poly;
+        explicit Polynomial(const Poly& p);
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
+        bool equals(const Exp& other) const override;
+    protected:
+        size_t computeHashCode() const override;
 };
 
 #endif
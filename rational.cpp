@@ -0,0 +1,455 @@
+#ifndef RATIONAL_CPP
+#define RATIONAL_CPP
+
+#include "rational.hpp"
+
+#include "expression_utils.hpp"
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Sign and magnitude; the magnitude is little-endian 32-bit limbs with no leading
+// zero limb, so zero is an empty vector and is never negative.
+struct BigInt {
+    bool negative = false;
+    vector<uint32_t> mag;
+};
+
+struct BigFraction {
+    BigInt num;
+    BigInt den;
+};
+
+static thread_local size_t promotionCount = 0;
+
+static void trim(vector<uint32_t>& m) {
+    while (!m.empty() && m.back() == 0) m.pop_back();
+}
+
+static BigInt bigFromWide(__int128 v) {
+    BigInt b;
+    b.negative = v < 0;
+    unsigned __int128 u = v < 0 ? -static_cast<unsigned __int128>(v) : static_cast<unsigned __int128>(v);
+    while (u != 0) {
+        b.mag.push_back(static_cast<uint32_t>(u));
+        u >>= 32;
+    }
+    return b;
+}
+
+static bool bigIsOne(const BigInt& b) {
+    return !b.negative && b.mag.size() == 1 && b.mag[0] == 1;
+}
+
+// Fits in a long long; den additionally has to be positive, which fromBig guarantees.
+static bool fitsLong(const BigInt& b, long long& out) {
+    if (b.mag.size() > 2) return false;
+    unsigned long long u = 0;
+    for (size_t i = b.mag.size(); i-- > 0;) u = (u << 32) | b.mag[i];
+    unsigned long long limit = b.negative ? 1ULL << 63 : static_cast<unsigned long long>(LLONG_MAX);
+    if (u > limit) return false;
+    out = b.negative ? static_cast<long long>(0 - u) : static_cast<long long>(u);
+    return true;
+}
+
+static int compareMag(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static vector<uint32_t> addMag(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+    const vector<uint32_t>& longer = a.size() >= b.size() ? a : b;
+    const vector<uint32_t>& shorter = a.size() >= b.size() ? b : a;
+    vector<uint32_t> out(longer.size() + 1, 0);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < longer.size(); ++i) {
+        uint64_t s = carry + longer[i] + (i < shorter.size() ? shorter[i] : 0);
+        out[i] = static_cast<uint32_t>(s);
+        carry = s >> 32;
+    }
+    out[longer.size()] = static_cast<uint32_t>(carry);
+    trim(out);
+    return out;
+}
+
+// a - b for a >= b.
+static vector<uint32_t> subMag(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+    vector<uint32_t> out(a.size(), 0);
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        int64_t s = static_cast<int64_t>(a[i]) - borrow - (i < b.size() ? b[i] : 0);
+        borrow = s < 0;
+        out[i] = static_cast<uint32_t>(s + (borrow << 32));
+    }
+    trim(out);
+    return out;
+}
+
+static vector<uint32_t> mulMag(const vector<uint32_t>& a, const vector<uint32_t>& b) {
+    if (a.empty() || b.empty()) return {};
+    vector<uint32_t> out(a.size() + b.size(), 0);
+    for (size_t i = 0; i < a.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b.size(); ++j) {
+            uint64_t t = static_cast<uint64_t>(a[i]) * b[j] + out[i + j] + carry;
+            out[i + j] = static_cast<uint32_t>(t);
+            carry = t >> 32;
+        }
+        out[i + b.size()] = static_cast<uint32_t>(carry);
+    }
+    trim(out);
+    return out;
+}
+
+static size_t bitLength(const vector<uint32_t>& m) {
+    if (m.empty()) return 0;
+    size_t bits = 32 * (m.size() - 1);
+    for (uint32_t top = m.back(); top != 0; top >>= 1) ++bits;
+    return bits;
+}
+
+static vector<uint32_t> shiftLeft(const vector<uint32_t>& m, size_t bits) {
+    if (m.empty()) return {};
+    size_t limbs = bits / 32;
+    unsigned rest = bits % 32;
+    vector<uint32_t> out(m.size() + limbs + 1, 0);
+    for (size_t i = 0; i < m.size(); ++i) {
+        uint64_t v = static_cast<uint64_t>(m[i]) << rest;
+        out[i + limbs] |= static_cast<uint32_t>(v);
+        out[i + limbs + 1] |= static_cast<uint32_t>(v >> 32);
+    }
+    trim(out);
+    return out;
+}
+
+// Binary long division, one bit of a at a time; only the fallback path gets here.
+static void divModMag(const vector<uint32_t>& a, const vector<uint32_t>& b,
+                      vector<uint32_t>& q, vector<uint32_t>& r) {
+    q.assign(a.size(), 0);
+    r.clear();
+    for (size_t i = bitLength(a); i-- > 0;) {
+        r = shiftLeft(r, 1);
+        if ((a[i / 32] >> (i % 32)) & 1u) {
+            if (r.empty()) r.push_back(1);
+            else r[0] |= 1u;
+        }
+        if (compareMag(r, b) >= 0) {
+            r = subMag(r, b);
+            q[i / 32] |= 1u << (i % 32);
+        }
+    }
+    trim(q);
+}
+
+static uint32_t divSmallMag(vector<uint32_t>& m, uint32_t divisor) {
+    uint64_t rem = 0;
+    for (size_t i = m.size(); i-- > 0;) {
+        uint64_t cur = (rem << 32) | m[i];
+        m[i] = static_cast<uint32_t>(cur / divisor);
+        rem = cur % divisor;
+    }
+    trim(m);
+    return static_cast<uint32_t>(rem);
+}
+
+static vector<uint32_t> gcdMag(vector<uint32_t> a, vector<uint32_t> b) {
+    vector<uint32_t> q, r;
+    while (!b.empty()) {
+        divModMag(a, b, q, r);
+        a = move(b);
+        b = move(r);
+    }
+    return a;
+}
+
+static BigInt bigAdd(const BigInt& a, const BigInt& b) {
+    BigInt out;
+    if (a.negative == b.negative) {
+        out.negative = a.negative;
+        out.mag = addMag(a.mag, b.mag);
+        return out;
+    }
+    int c = compareMag(a.mag, b.mag);
+    if (c == 0) return out;
+    out.negative = c > 0 ? a.negative : b.negative;
+    out.mag = c > 0 ? subMag(a.mag, b.mag) : subMag(b.mag, a.mag);
+    return out;
+}
+
+static BigInt bigNeg(BigInt a) {
+    if (!a.mag.empty()) a.negative = !a.negative;
+    return a;
+}
+
+static BigInt bigMul(const BigInt& a, const BigInt& b) {
+    BigInt out;
+    out.mag = mulMag(a.mag, b.mag);
+    out.negative = !out.mag.empty() && a.negative != b.negative;
+    return out;
+}
+
+static string bigToString(const BigInt& b) {
+    if (b.mag.empty()) return "0";
+    vector<uint32_t> m = b.mag;
+    vector<uint32_t> chunks; // base 10^9, least significant first
+    while (!m.empty()) chunks.push_back(divSmallMag(m, 1000000000u));
+    string out = b.negative ? "-" : "";
+    out += to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        string part = to_string(chunks[i]);
+        out += string(9 - part.size(), '0') + part;
+    }
+    return out;
+}
+
+// m = m * mul + add.
+static void mulAddSmallMag(vector<uint32_t>& m, uint32_t mul, uint32_t add) {
+    uint64_t carry = add;
+    for (uint32_t& limb : m) {
+        uint64_t t = static_cast<uint64_t>(limb) * mul + carry;
+        limb = static_cast<uint32_t>(t);
+        carry = t >> 32;
+    }
+    if (carry != 0) m.push_back(static_cast<uint32_t>(carry));
+}
+
+// Decimal digits with an optional leading '-'; false on anything else.
+static bool bigFromString(string_view text, BigInt& out) {
+    out = BigInt();
+    bool negative = !text.empty() && text[0] == '-';
+    if (negative) text.remove_prefix(1);
+    if (text.empty()) return false;
+    for (char c : text) {
+        if (c < '0' || c > '9') return false;
+        mulAddSmallMag(out.mag, 10, static_cast<uint32_t>(c - '0'));
+    }
+    out.negative = negative && !out.mag.empty();
+    return true;
+}
+
+// Binary GCD, with gcd(0, b) = b.
+static unsigned long long gcdNarrow(unsigned long long a, unsigned long long b) {
+    if (a == 0) return b;
+    if (b == 0) return a;
+    int shift = __builtin_ctzll(a | b);
+    a >>= __builtin_ctzll(a);
+    do {
+        b >>= __builtin_ctzll(b);
+        if (a > b) swap(a, b);
+        b -= a;
+    } while (b != 0);
+    return a << shift;
+}
+
+static unsigned __int128 gcdWide(unsigned __int128 a, unsigned __int128 b) {
+    if ((a >> 64) == 0 && (b >> 64) == 0) {
+        return gcdNarrow(static_cast<unsigned long long>(a), static_cast<unsigned long long>(b));
+    }
+    while (b != 0) {
+        unsigned __int128 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+Rational::Rational(long long num, long long den) {
+    *this = fromWide(num, den);
+}
+
+Rational Rational::fromWide(__int128 num, __int128 den) {
+    if (den < 0) {
+        num = -num;
+        den = -den;
+    }
+    unsigned __int128 absNum = num < 0 ? -static_cast<unsigned __int128>(num) : static_cast<unsigned __int128>(num);
+    unsigned __int128 g = gcdWide(absNum, static_cast<unsigned __int128>(den));
+    if (g > 1) {
+        if ((absNum >> 64) == 0 && (den >> 64) == 0) {
+            absNum = static_cast<unsigned long long>(absNum) / static_cast<unsigned long long>(g);
+            den = static_cast<long long>(static_cast<unsigned long long>(den) / static_cast<unsigned long long>(g));
+            num = num < 0 ? -static_cast<__int128>(absNum) : static_cast<__int128>(absNum);
+        } else {
+            num /= static_cast<__int128>(g);
+            den /= static_cast<__int128>(g);
+        }
+    }
+    if (num >= LLONG_MIN && num <= LLONG_MAX && den <= LLONG_MAX) {
+        Rational r;
+        r.n = static_cast<long long>(num);
+        r.d = static_cast<long long>(den);
+        return r;
+    }
+    return fromBig(BigFraction{bigFromWide(num), bigFromWide(den)});
+}
+
+Rational Rational::fromBig(BigFraction f) {
+    if (f.den.negative) {
+        f.den.negative = false;
+        f.num = bigNeg(move(f.num));
+    }
+    vector<uint32_t> g = gcdMag(f.num.mag, f.den.mag);
+    if (!g.empty() && !(g.size() == 1 && g[0] == 1)) {
+        vector<uint32_t> q, r;
+        divModMag(f.num.mag, g, q, r);
+        f.num.mag = move(q);
+        divModMag(f.den.mag, g, q, r);
+        f.den.mag = move(q);
+    }
+    if (f.num.mag.empty()) f.num.negative = false;
+
+    Rational out;
+    long long smallNum, smallDen;
+    if (fitsLong(f.num, smallNum) && fitsLong(f.den, smallDen)) {
+        out.n = smallNum;
+        out.d = smallDen;
+        return out;
+    }
+    ++promotionCount;
+    out.big = make_shared<const BigFraction>(move(f));
+    return out;
+}
+
+BigFraction Rational::widen() const {
+    if (big) return *big;
+    return BigFraction{bigFromWide(n), bigFromWide(d)};
+}
+
+bool Rational::isZero() const {
+    return !big && n == 0;
+}
+bool Rational::isOne() const {
+    return !big && n == 1 && d == 1;
+}
+bool Rational::isInteger() const {
+    return big ? bigIsOne(big->den) : d == 1;
+}
+
+// A double holds n/d exactly when d is a power of two and n has at most 53 significant
+// bits; a big value qualifies only as an integer, and below the double range.
+bool Rational::isExactDouble() const {
+    if (big) {
+        if (!bigIsOne(big->den)) return false;
+        const vector<uint32_t>& m = big->num.mag;
+        size_t low = 0;
+        while (!((m[low / 32] >> (low % 32)) & 1u)) ++low;
+        size_t bits = bitLength(m);
+        return bits <= 1024 && bits - low <= 53;
+    }
+    if ((d & (d - 1)) != 0) return false;
+    unsigned long long m = n < 0 ? 0ULL - static_cast<unsigned long long>(n) : static_cast<unsigned long long>(n);
+    while (m != 0 && !(m & 1)) m >>= 1;
+    return m < (1ULL << 53);
+}
+
+double Rational::toDouble() const {
+    if (!big) return static_cast<double>(n) / static_cast<double>(d);
+    // Scale so the quotient carries about 64 significant bits, then undo the scale.
+    vector<uint32_t> num = big->num.mag;
+    vector<uint32_t> den = big->den.mag;
+    long long k = 64 - (static_cast<long long>(bitLength(num)) - static_cast<long long>(bitLength(den)));
+    if (k > 0) num = shiftLeft(num, static_cast<size_t>(k));
+    else den = shiftLeft(den, static_cast<size_t>(-k));
+    vector<uint32_t> q, r;
+    divModMag(num, den, q, r);
+    double v = 0.0;
+    for (size_t i = q.size(); i-- > 0;) v = v * 4294967296.0 + q[i];
+    v = ldexp(v, static_cast<int>(-k));
+    return big->num.negative ? -v : v;
+}
+
+string Rational::toString() const {
+    if (!big) {
+        if (d == 1) return to_string(n);
+        return to_string(n) + "/" + to_string(d);
+    }
+    if (bigIsOne(big->den)) return bigToString(big->num);
+    return bigToString(big->num) + "/" + bigToString(big->den);
+}
+
+bool Rational::parse(string_view text, Rational& out) {
+    size_t slash = text.find('/');
+    BigFraction f;
+    if (!bigFromString(text.substr(0, slash), f.num)) return false;
+    if (slash == string_view::npos) {
+        f.den = bigFromWide(1);
+    } else if (!bigFromString(text.substr(slash + 1), f.den) || f.den.mag.empty()) {
+        return false;
+    }
+    out = fromBig(move(f));
+    return true;
+}
+
+Rational Rational::operator-() const {
+    if (!big) return fromWide(-static_cast<__int128>(n), d);
+    return fromBig(BigFraction{bigNeg(big->num), big->den});
+}
+
+Rational operator+(const Rational& a, const Rational& b) {
+    if (!a.big && !b.big) {
+        if (a.d == b.d) return Rational::fromWide(static_cast<__int128>(a.n) + b.n, a.d);
+        return Rational::fromWide(static_cast<__int128>(a.n) * b.d + static_cast<__int128>(b.n) * a.d,
+                                  static_cast<__int128>(a.d) * b.d);
+    }
+    BigFraction x = a.widen(), y = b.widen();
+    return Rational::fromBig(BigFraction{bigAdd(bigMul(x.num, y.den), bigMul(y.num, x.den)), bigMul(x.den, y.den)});
+}
+
+Rational operator-(const Rational& a, const Rational& b) {
+    if (!a.big && !b.big) {
+        if (a.d == b.d) return Rational::fromWide(static_cast<__int128>(a.n) - b.n, a.d);
+        return Rational::fromWide(static_cast<__int128>(a.n) * b.d - static_cast<__int128>(b.n) * a.d,
+                                  static_cast<__int128>(a.d) * b.d);
+    }
+    BigFraction x = a.widen(), y = b.widen();
+    return Rational::fromBig(
+        BigFraction{bigAdd(bigMul(x.num, y.den), bigNeg(bigMul(y.num, x.den))), bigMul(x.den, y.den)});
+}
+
+Rational operator*(const Rational& a, const Rational& b) {
+    if (!a.big && !b.big) {
+        return Rational::fromWide(static_cast<__int128>(a.n) * b.n, static_cast<__int128>(a.d) * b.d);
+    }
+    BigFraction x = a.widen(), y = b.widen();
+    return Rational::fromBig(BigFraction{bigMul(x.num, y.num), bigMul(x.den, y.den)});
+}
+
+Rational operator/(const Rational& a, const Rational& b) {
+    if (!a.big && !b.big) {
+        return Rational::fromWide(static_cast<__int128>(a.n) * b.d, static_cast<__int128>(a.d) * b.n);
+    }
+    BigFraction x = a.widen(), y = b.widen();
+    BigInt den = bigMul(x.den, y.num);
+    BigInt num = bigMul(x.num, y.den);
+    return Rational::fromBig(BigFraction{move(num), move(den)});
+}
+
+bool operator==(const Rational& a, const Rational& b) {
+    if (!a.big && !b.big) return a.n == b.n && a.d == b.d;
+    if (!a.big || !b.big) return false; // both forms are canonical, so they cannot be equal
+    return a.big->num.negative == b.big->num.negative && a.big->num.mag == b.big->num.mag &&
+           a.big->den.mag == b.big->den.mag;
+}
+
+size_t Rational::hashCode() const {
+    if (!big) return hashCombine(hash<long long>()(n), hash<long long>()(d));
+    size_t h = big->num.negative;
+    for (uint32_t w : big->num.mag) h = hashCombine(h, w);
+    for (uint32_t w : big->den.mag) h = hashCombine(h, w);
+    return h;
+}
+
+size_t Rational::promotions() {
+    return promotionCount;
+}
+
+#endif
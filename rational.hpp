@@ -0,0 +1,63 @@
+#ifndef RATIONAL_HPP
+#define RATIONAL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+struct BigFraction;
+
+// An exact fraction n/d in lowest terms with d > 0.
+//
+// The numerator and denominator normally sit inline as two long longs, and arithmetic
+// on them runs in 128-bit intermediates, so the common case never allocates. Only a
+// reduced result that no longer fits in 64 bits is moved to a shared, heap-held
+// arbitrary-precision fraction; a later result that fits again comes back inline.
+class Rational {
+    public:
+        Rational() = default;
+        Rational(long long n, long long d = 1);
+
+        // True while the value is held inline; num() and den() are only meaningful then.
+        bool isSmall() const { return !big; }
+        long long num() const { return n; }
+        long long den() const { return d; }
+
+        bool isZero() const;
+        bool isOne() const;
+        bool isInteger() const;
+        // True when toDouble() is this value exactly.
+        bool isExactDouble() const;
+        double toDouble() const;
+        string toString() const; // "n", or "n/d" when d != 1
+        // Reads toString()'s form back at any length: "n" or "n/d" in decimal, either
+        // part optionally negative. False when text is not that or d is zero.
+        static bool parse(string_view text, Rational& out);
+
+        Rational operator-() const;
+        friend Rational operator+(const Rational& a, const Rational& b);
+        friend Rational operator-(const Rational& a, const Rational& b);
+        friend Rational operator*(const Rational& a, const Rational& b);
+        // b must not be zero.
+        friend Rational operator/(const Rational& a, const Rational& b);
+        friend bool operator==(const Rational& a, const Rational& b);
+        // Equal fractions hash alike.
+        size_t hashCode() const;
+
+        // Results on this thread that had to leave the inline form.
+        static size_t promotions();
+
+    private:
+        long long n = 0;
+        long long d = 1;
+        shared_ptr<const BigFraction> big;
+
+        static Rational fromWide(__int128 num, __int128 den);
+        static Rational fromBig(BigFraction f);
+        BigFraction widen() const;
+};
+
+#endif
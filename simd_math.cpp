@@ -0,0 +1,265 @@
+#ifndef SIMD_MATH_CPP
+#define SIMD_MATH_CPP
+
+#include "simd_math.hpp"
+
+#include <cmath>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CALCULUS_HAVE_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static void scalarSin(const double* in, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = sin(in[i]);
+}
+static void scalarCos(const double* in, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = cos(in[i]);
+}
+static void scalarExp(const double* in, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = exp(in[i]);
+}
+static void scalarSqrt(const double* in, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = sqrt(in[i]);
+}
+static void scalarPow(const double* in, double exponent, double* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) out[i] = pow(in[i], exponent);
+}
+
+#ifdef CALCULUS_HAVE_AVX2_KERNELS
+
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+
+// Reduction constants and polynomials follow fdlibm (k_sin.c, k_cos.c, e_exp.c).
+static const double pio2_1 = 1.57079632673412561417e+00;
+static const double pio2_2 = 6.07710050630396597660e-11;
+static const double pio2_3 = 2.02226624871116645580e-21;
+static const double ln2hi = 6.93147180369123816490e-01;
+static const double ln2lo = 1.90821492927058770002e-10;
+static const double trigReduceLimit = 1e5;
+static const double expLimit = 708.0;
+
+AVX2_TARGET static inline __m256d polySin(__m256d r, __m256d z) {
+    __m256d p = _mm256_set1_pd(1.58969099521155010221e-10);
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(-2.50507602534068634195e-08));
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(2.75573137070700676789e-06));
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(-1.98412698298579493134e-04));
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(8.33333333332248946124e-03));
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(-1.66666666666666324348e-01));
+    return _mm256_fmadd_pd(_mm256_mul_pd(r, z), p, r);
+}
+
+AVX2_TARGET static inline __m256d polyCos(__m256d z) {
+    __m256d p = _mm256_set1_pd(-1.13596475577881948265e-11);
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(2.08757232129817482790e-09));
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(-2.75573143513906633035e-07));
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(2.48015872894767294178e-05));
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(-1.38888888888741095749e-03));
+    p = _mm256_fmadd_pd(p, z, _mm256_set1_pd(4.16666666666666019037e-02));
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d hz = _mm256_mul_pd(_mm256_set1_pd(0.5), z);
+    __m256d w = _mm256_sub_pd(one, hz);
+    // w + (((1 - w) - hz) + z*z*p) recovers the bits lost in 1 - hz
+    __m256d tail = _mm256_sub_pd(_mm256_sub_pd(one, w), hz);
+    return _mm256_add_pd(w, _mm256_fmadd_pd(_mm256_mul_pd(z, z), p, tail));
+}
+
+// Returns false if any lane is out of range (or NaN) and must take the scalar path.
+// The reduction works on |x|; sign holds the sign bit of x, for sin to put back.
+AVX2_TARGET static inline bool sinCos4(__m256d x, __m256d& s, __m256d& c, __m256i& quadrant, __m256d& sign) {
+    sign = _mm256_and_pd(_mm256_set1_pd(-0.0), x);
+    __m256d ax = _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+    __m256d ok = _mm256_cmp_pd(ax, _mm256_set1_pd(trigReduceLimit), _CMP_LE_OQ);
+    if (_mm256_movemask_pd(ok) != 0xF) return false;
+
+    __m256d j = _mm256_round_pd(_mm256_mul_pd(ax, _mm256_set1_pd(0.636619772367581343076)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2_1), ax);
+    r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2_2), r);
+    r = _mm256_fnmadd_pd(j, _mm256_set1_pd(pio2_3), r);
+    __m256d z = _mm256_mul_pd(r, r);
+    s = polySin(r, z);
+    c = polyCos(z);
+    quadrant = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(j));
+    return true;
+}
+
+AVX2_TARGET static inline __m256d selectQuadrant(__m256d s, __m256d c, __m256i q) {
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256d useCos = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(q, one), one));
+    __m256d v = _mm256_blendv_pd(s, c, useCos);
+    __m256i sign = _mm256_slli_epi64(_mm256_and_si256(q, _mm256_set1_epi64x(2)), 62);
+    return _mm256_xor_pd(v, _mm256_castsi256_pd(sign));
+}
+
+AVX2_TARGET static void avx2Sin(const double* in, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(in + i);
+        __m256d s, c, sign;
+        __m256i q;
+        if (!sinCos4(x, s, c, q, sign)) {
+            scalarSin(in + i, out + i, 4);
+            continue;
+        }
+        // sin is odd: sin(x) = sign(x) * sin(|x|), which also keeps sin(-0) = -0
+        _mm256_storeu_pd(out + i, _mm256_xor_pd(selectQuadrant(s, c, q), sign));
+    }
+    scalarSin(in + i, out + i, n - i);
+}
+
+AVX2_TARGET static void avx2Cos(const double* in, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(in + i);
+        __m256d s, c, sign;
+        __m256i q;
+        if (!sinCos4(x, s, c, q, sign)) {
+            scalarCos(in + i, out + i, 4);
+            continue;
+        }
+        // cos(r + q*pi/2) = sin(r + (q+1)*pi/2)
+        _mm256_storeu_pd(out + i, selectQuadrant(s, c, _mm256_add_epi64(q, _mm256_set1_epi64x(1))));
+    }
+    scalarCos(in + i, out + i, n - i);
+}
+
+AVX2_TARGET static void avx2Exp(const double* in, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(in + i);
+        __m256d ax = _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+        if (_mm256_movemask_pd(_mm256_cmp_pd(ax, _mm256_set1_pd(expLimit), _CMP_LE_OQ)) != 0xF) {
+            scalarExp(in + i, out + i, 4);
+            continue;
+        }
+        __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.44269504088896338700)),
+                                    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(ln2hi), x);
+        r = _mm256_fnmadd_pd(k, _mm256_set1_pd(ln2lo), r);
+
+        // Taylor series of e^r up to r^13; |r| <= ln(2)/2 keeps the truncation below 1e-17.
+        __m256d p = _mm256_set1_pd(1.0 / 6227020800.0);
+        static const double coeffs[] = {
+            1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0,
+            1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0,
+            1.0 / 6.0, 0.5, 1.0, 1.0
+        };
+        for (double coeff : coeffs) p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(coeff));
+
+        __m256i ki = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+        __m256i bits = _mm256_slli_epi64(_mm256_add_epi64(ki, _mm256_set1_epi64x(1023)), 52);
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(p, _mm256_castsi256_pd(bits)));
+    }
+    scalarExp(in + i, out + i, n - i);
+}
+
+AVX2_TARGET static void avx2Sqrt(const double* in, double* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_loadu_pd(in + i)));
+    }
+    scalarSqrt(in + i, out + i, n - i);
+}
+
+// Products as hi + lo: hi is the plain product, so infinities, zeros and signs come out
+// as pow's, and lo gathers the rounding error of every step (fma recovers it exactly).
+// That keeps the six squarings of x^64 within an ulp instead of compounding to ~50.
+AVX2_TARGET static inline void mulWithError(__m256d ah, __m256d al, __m256d bh, __m256d bl, __m256d& h, __m256d& l) {
+    h = _mm256_mul_pd(ah, bh);
+    l = _mm256_fmadd_pd(ah, bl, _mm256_fmadd_pd(al, bh, _mm256_fmsub_pd(ah, bh, h)));
+}
+
+AVX2_TARGET static void avx2IntPow(const double* in, long long exponent, double* out, size_t n) {
+    unsigned long long e = static_cast<unsigned long long>(exponent < 0 ? -exponent : exponent);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d inf = _mm256_set1_pd(HUGE_VAL);
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d base = _mm256_loadu_pd(in + i), baseLo = zero;
+        __m256d acc = one, accLo = zero;
+        for (unsigned long long bits = e; bits != 0; bits >>= 1) {
+            if (bits & 1) mulWithError(acc, accLo, base, baseLo, acc, accLo);
+            if (bits > 1) mulWithError(base, baseLo, base, baseLo, base, baseLo);
+        }
+        // One reciprocal of hi + lo, refined by a Newton step: q + q*(1 - q*hi - q*lo)
+        __m256d q = exponent < 0 ? _mm256_div_pd(one, acc) : acc;
+        // Only a finite, nonzero result has a meaningful correction (an infinite one
+        // leaves NaN there).
+        __m256d abs = _mm256_andnot_pd(_mm256_set1_pd(-0.0), q);
+        __m256d refine = _mm256_and_pd(_mm256_cmp_pd(abs, inf, _CMP_LT_OQ), _mm256_cmp_pd(abs, zero, _CMP_GT_OQ));
+        __m256d refined;
+        if (exponent < 0) {
+            __m256d r = _mm256_fnmadd_pd(q, accLo, _mm256_fnmadd_pd(q, acc, one));
+            refined = _mm256_fmadd_pd(q, r, q);
+        } else {
+            refined = _mm256_add_pd(acc, accLo);
+        }
+        _mm256_storeu_pd(out + i, _mm256_blendv_pd(q, refined, refine));
+    }
+    scalarPow(in + i, static_cast<double>(exponent), out + i, n - i);
+}
+
+bool simdAvailable() {
+    static const bool available = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return available;
+}
+
+#else
+
+bool simdAvailable() {
+    return false;
+}
+
+#endif
+
+void batchSin(const double* in, double* out, size_t n) {
+#ifdef CALCULUS_HAVE_AVX2_KERNELS
+    if (simdAvailable()) {
+        avx2Sin(in, out, n);
+        return;
+    }
+#endif
+    scalarSin(in, out, n);
+}
+void batchCos(const double* in, double* out, size_t n) {
+#ifdef CALCULUS_HAVE_AVX2_KERNELS
+    if (simdAvailable()) {
+        avx2Cos(in, out, n);
+        return;
+    }
+#endif
+    scalarCos(in, out, n);
+}
+void batchExp(const double* in, double* out, size_t n) {
+#ifdef CALCULUS_HAVE_AVX2_KERNELS
+    if (simdAvailable()) {
+        avx2Exp(in, out, n);
+        return;
+    }
+#endif
+    scalarExp(in, out, n);
+}
+void batchSqrt(const double* in, double* out, size_t n) {
+#ifdef CALCULUS_HAVE_AVX2_KERNELS
+    if (simdAvailable()) {
+        avx2Sqrt(in, out, n);
+        return;
+    }
+#endif
+    scalarSqrt(in, out, n);
+}
+void batchPow(const double* in, double exponent, double* out, size_t n) {
+#ifdef CALCULUS_HAVE_AVX2_KERNELS
+    if (simdAvailable() && exponent == nearbyint(exponent) && fabs(exponent) <= 64) {
+        avx2IntPow(in, static_cast<long long>(exponent), out, n);
+        return;
+    }
+#endif
+    scalarPow(in, exponent, out, n);
+}
+
+#endif
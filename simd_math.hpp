@@ -0,0 +1,22 @@
+#ifndef SIMD_MATH_HPP
+#define SIMD_MATH_HPP
+
+#include <cstddef>
+
+// Block size composite nodes use when they need a temporary buffer for a child.
+const size_t batchBlock = 256;
+
+// Elementwise kernels over arrays. in and out may be the same array.
+// On x86-64 with AVX2/FMA (checked at run time) sin, cos and exp use polynomial
+// kernels accurate to a few ulp; lanes outside their reduced range, and every other
+// platform, go through <cmath>. sqrt is exact either way.
+bool simdAvailable();
+void batchSin(const double* in, double* out, size_t n);
+void batchCos(const double* in, double* out, size_t n);
+void batchExp(const double* in, double* out, size_t n);
+void batchSqrt(const double* in, double* out, size_t n);
+// pow(in[i], exponent). Integer exponents up to 64 in magnitude are vectorised by
+// repeated squaring in double-double, so they stay within an ulp of pow.
+void batchPow(const double* in, double exponent, double* out, size_t n);
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef TAYLOR_TAPE_CPP
+#define TAYLOR_TAPE_CPP
+
+#include "taylor_tape.hpp"
+
+#include "multivariable.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+TaylorTape::TaylorTape(const Exp& expr) : TaylorTape(compile(expr)) {}
+
+TaylorTape::TaylorTape(CompiledExp compiled) : tape(move(compiled)) {}
+
+// c = a * b, truncated to n terms.
+static void seriesMul(const double* a, const double* b, double* c, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        double s = 0;
+        for (size_t j = 0; j <= k; ++j) s += a[j] * b[k - j];
+        c[k] = s;
+    }
+}
+
+// c = a / b; NaN throughout when b_0 == 0, like the scalar Div.
+static void seriesDiv(const double* a, const double* b, double* c, size_t n) {
+    if (b[0] == 0) {
+        fill(c, c + n, NAN);
+        return;
+    }
+    for (size_t k = 0; k < n; ++k) {
+        double s = a[k];
+        for (size_t j = 1; j <= k; ++j) s -= b[j] * c[k - j];
+        c[k] = s / b[0];
+    }
+}
+
+static void seriesSqrt(const double* a, double* c, size_t n) {
+    c[0] = sqrt(a[0]);
+    for (size_t k = 1; k < n; ++k) {
+        double s = a[k];
+        for (size_t j = 1; j < k; ++j) s -= c[j] * c[k - j];
+        c[k] = s / (2 * c[0]);
+    }
+}
+
+// c = exp(a): c' = a' c.
+static void seriesExp(const double* a, double* c, size_t n) {
+    c[0] = exp(a[0]);
+    for (size_t k = 1; k < n; ++k) {
+        double s = 0;
+        for (size_t j = 1; j <= k; ++j) s += j * a[j] * c[k - j];
+        c[k] = s / k;
+    }
+}
+
+// s = sin(a), c = cos(a): s' = a' c, c' = -a' s.
+static void seriesSinCos(const double* a, double* s, double* c, size_t n) {
+    s[0] = sin(a[0]);
+    c[0] = cos(a[0]);
+    for (size_t k = 1; k < n; ++k) {
+        double ss = 0;
+        double cs = 0;
+        for (size_t j = 1; j <= k; ++j) {
+            ss += j * a[j] * c[k - j];
+            cs += j * a[j] * s[k - j];
+        }
+        s[k] = ss / k;
+        c[k] = -cs / k;
+    }
+}
+
+// t = tan(a): t' = a' u with u = 1 + t^2, built alongside.
+static void seriesTan(const double* a, double* t, double* u, size_t n) {
+    t[0] = tan(a[0]);
+    u[0] = 1 + t[0] * t[0];
+    for (size_t k = 1; k < n; ++k) {
+        double s = 0;
+        for (size_t j = 1; j <= k; ++j) s += j * a[j] * u[k - j];
+        t[k] = s / k;
+        double q = 0;
+        for (size_t j = 0; j <= k; ++j) q += t[j] * t[k - j];
+        u[k] = q;
+    }
+}
+
+// c = a^p for a constant p: a c' = p a' c. Needs a_0 != 0 unless p is a small
+// non-negative integer, which is done by repeated multiplication instead.
+static void seriesPow(const double* a, double p, double* c, double* tmp, size_t n) {
+    if (a[0] == 0) {
+        if (p != floor(p) || p < 0 || p > 64) {
+            c[0] = pow(a[0], p);
+            fill(c + 1, c + n, NAN);
+            return;
+        }
+        fill(c, c + n, 0.0);
+        c[0] = 1;
+        for (int i = 0; i < static_cast<int>(p); ++i) {
+            seriesMul(c, a, tmp, n);
+            copy(tmp, tmp + n, c);
+        }
+        return;
+    }
+    c[0] = pow(a[0], p);
+    for (size_t k = 1; k < n; ++k) {
+        double s = 0;
+        for (size_t j = 1; j <= k; ++j) s += (p * j - (k - j)) * a[j] * c[k - j];
+        c[k] = s / (k * a[0]);
+    }
+}
+
+// c' w = a' for a known series w (c_0 given): k c_k w_0 = k a_k - sum j c_j w_(k-j).
+static void seriesIntegrateRatio(const double* a, const double* w, double* c, size_t n) {
+    for (size_t k = 1; k < n; ++k) {
+        double s = k * a[k];
+        for (size_t j = 1; j < k; ++j) s -= j * c[j] * w[k - j];
+        c[k] = s / (k * w[0]);
+    }
+}
+
+vector<double> TaylorTape::coefficients(double x0, int order) {
+    const size_t n = static_cast<size_t>(max(order, 0)) + 1;
+    series.assign(tape.registers() * n, 0.0);
+    scratch.assign(2 * n, 0.0);
+    double* w = scratch.data();
+    double* v = scratch.data() + n;
+    auto reg = [&](uint32_t r) { return series.data() + r * n; };
+
+    reg(CompiledExp::xReg)[0] = x0;
+    if (n > 1) reg(CompiledExp::xReg)[1] = 1;
+    for (uint32_t i = 1; i <= CompiledExp::yPrimeReg && i < tape.inputs; ++i) fill(reg(i), reg(i) + n, NAN);
+    // x_1, x_2, ... do not move with x: a constant series (series is zeroed above).
+    for (uint32_t i = CompiledExp::yPrimeReg + 1; i < tape.inputs; ++i) reg(i)[0] = variableValue(i - CompiledExp::yPrimeReg);
+    for (size_t c = 0; c < tape.consts.size(); ++c) reg(tape.firstConst() + c)[0] = tape.consts[c];
+
+    for (size_t i = 0; i < tape.code.size(); ++i) {
+        const TapeInstr& ins = tape.code[i];
+        const double* a = reg(ins.a);
+        const double* b = reg(ins.b);
+        double* c = reg(tape.firstTemp() + i);
+        switch (ins.op) {
+            case TapeOp::Add: for (size_t k = 0; k < n; ++k) c[k] = a[k] + b[k]; break;
+            case TapeOp::Sub: for (size_t k = 0; k < n; ++k) c[k] = a[k] - b[k]; break;
+            case TapeOp::Mul: seriesMul(a, b, c, n); break;
+            case TapeOp::Div: seriesDiv(a, b, c, n); break;
+            case TapeOp::Pow: seriesPow(a, b[0], c, w, n); break; // b is a constant
+            case TapeOp::Recip:
+                fill(w, w + n, 0.0);
+                w[0] = 1;
+                seriesDiv(w, a, c, n);
+                break;
+            case TapeOp::Square: seriesMul(a, a, c, n); break;
+            case TapeOp::Sqrt: seriesSqrt(a, c, n); break;
+            case TapeOp::Exp: seriesExp(a, c, n); break;
+            case TapeOp::Sin: seriesSinCos(a, c, w, n); break;
+            case TapeOp::Cos: seriesSinCos(a, w, c, n); break;
+            case TapeOp::Tan: seriesTan(a, c, w, n); break;
+            case TapeOp::Asin:
+            case TapeOp::Acos:
+                // asin' = a' / sqrt(1 - a^2); acos is its negation plus a constant.
+                seriesMul(a, a, v, n);
+                for (size_t k = 0; k < n; ++k) v[k] = -v[k];
+                v[0] += 1;
+                seriesSqrt(v, w, n);
+                c[0] = asin(a[0]);
+                seriesIntegrateRatio(a, w, c, n);
+                if (ins.op == TapeOp::Acos) {
+                    c[0] = acos(a[0]);
+                    for (size_t k = 1; k < n; ++k) c[k] = -c[k];
+                }
+                break;
+            case TapeOp::Atan:
+                seriesMul(a, a, w, n);
+                w[0] += 1;
+                c[0] = atan(a[0]);
+                seriesIntegrateRatio(a, w, c, n);
+                break;
+        }
+    }
+    const double* result = reg(tape.result);
+    return vector<double>(result, result + n);
+}
+
+vector<double> TaylorTape::derivatives(double x0, int order) {
+    vector<double> out = coefficients(x0, order);
+    double factorial = 1;
+    for (size_t k = 1; k < out.size(); ++k) {
+        factorial *= k;
+        out[k] *= factorial;
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef TAYLOR_TAPE_HPP
+#define TAYLOR_TAPE_HPP
+
+#include "compiled_expression.hpp"
+
+#include <vector>
+
+// Truncated Taylor arithmetic over a compiled tape. Every register carries the
+// coefficients c_0 .. c_order of its value as a series in (x - x0), and each tape
+// instruction combines them with the usual recurrences (Cauchy product for Mul,
+// division and root recurrences, and the ODE recurrences for exp/sin/cos/tan/pow and
+// the inverse trig functions). Cost is O(order^2) per instruction, so f^(k)(x0) for k
+// up to 20 needs no symbolic derivative() at all.
+//
+// y and y' are NaN and x_1, x_2, ... take their Environment values, as in
+// CompiledExp::evaluate(x).
+class TaylorTape {
+    public:
+        explicit TaylorTape(const Exp& expr);
+        explicit TaylorTape(CompiledExp compiled);
+
+        const CompiledExp& compiled() const { return tape; }
+
+        // c_k for k = 0 .. order, with f(x) ~ sum c_k (x - x0)^k.
+        vector<double> coefficients(double x0, int order);
+        // f^(k)(x0) = k! c_k for k = 0 .. order.
+        vector<double> derivatives(double x0, int order);
+
+    private:
+        CompiledExp tape;
+        vector<double> series;
+        vector<double> scratch;
+};
+
+#endif
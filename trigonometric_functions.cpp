@@ -3,140 +3,203 @@
 
 #include "trigonometric_functions.hpp"
 #include "chain_rule.hpp"
+#include "expression_writer.hpp"
 #include "polynomials_and_exponential_functions.hpp"
+#include "simd_math.hpp"
 
 #include <cmath>
 
 using namespace std;
 
-string Sine::toString() const {
-    return "sin(x)";
+void Sine::print(ExpWriter& out) const {
+    out << "sin(x)";
 }
-dExp Sine::derivative() const {
+dExp Sine::derivativeNode() const {
     return make_unique<Cosine>();
 }
-dExp Sine::simplify() const {
+dExp Sine::simplifyNode() const {
     return make_unique<Sine>();
 }
 double Sine::evaluate(double x) const {
     return sin(x);
 }
+void Sine::evaluate(const double* xs, double* out, size_t n) const {
+    batchSin(xs, out, n);
+}
+Dual Sine::evaluateWithDerivative(double x) const {
+    return Dual{sin(x), cos(x)};
+}
 
-string Cosine::toString() const {
-    return "cos(x)";
+void Cosine::print(ExpWriter& out) const {
+    out << "cos(x)";
 }
-dExp Cosine::derivative() const {
+dExp Cosine::derivativeNode() const {
     return make_unique<Multiply>(
-        make_shared<Constant>(-1),
-        make_shared<Sine>()
+        makeNode<Constant>(-1),
+        makeNode<Sine>()
     )->simplify();
 }
-dExp Cosine::simplify() const {
+dExp Cosine::simplifyNode() const {
     return make_unique<Cosine>();
 }
 double Cosine::evaluate(double x) const {
     return cos(x);
 }
+void Cosine::evaluate(const double* xs, double* out, size_t n) const {
+    batchCos(xs, out, n);
+}
+Dual Cosine::evaluateWithDerivative(double x) const {
+    return Dual{cos(x), -sin(x)};
+}
 
-string Tangent::toString() const {
-    return "tan(x)";
+void Tangent::print(ExpWriter& out) const {
+    out << "tan(x)";
 }
-dExp Tangent::derivative() const {
+dExp Tangent::derivativeNode() const {
     return make_unique<Multiply>(
-        make_shared<Secant>(),
-        make_shared<Secant>()
+        makeNode<Secant>(),
+        makeNode<Secant>()
     )->simplify();
 }
-dExp Tangent::simplify() const {
+dExp Tangent::simplifyNode() const {
     return make_unique<Tangent>();
 }
 double Tangent::evaluate(double x) const {
     return tan(x);
 }
+void Tangent::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = tan(xs[i]);
+}
+Dual Tangent::evaluateWithDerivative(double x) const {
+    double c = cos(x);
+    return Dual{tan(x), 1.0 / (c * c)};
+}
 
-string Cosecant::toString() const {
-    return "csc(x)";
+void Cosecant::print(ExpWriter& out) const {
+    out << "csc(x)";
 }
-dExp Cosecant::derivative() const {
+dExp Cosecant::derivativeNode() const {
     return make_unique<Multiply>(
-        make_shared<Constant>(-1),
-        make_shared<Multiply>(
-            make_shared<Cosecant>(),
-            make_shared<Cotangent>()
+        makeNode<Constant>(-1),
+        makeNode<Multiply>(
+            makeNode<Cosecant>(),
+            makeNode<Cotangent>()
         )
     )->simplify();
 }
-dExp Cosecant::simplify() const {
+dExp Cosecant::simplifyNode() const {
     return make_unique<Cosecant>();
 }
 double Cosecant::evaluate(double x) const {
     return 1.0 / sin(x);
 }
+void Cosecant::evaluate(const double* xs, double* out, size_t n) const {
+    batchSin(xs, out, n);
+    for (size_t i = 0; i < n; ++i) out[i] = 1.0 / out[i];
+}
+Dual Cosecant::evaluateWithDerivative(double x) const {
+    double s = sin(x);
+    return Dual{1.0 / s, -cos(x) / (s * s)};
+}
 
-string Secant::toString() const {
-    return "sec(x)";
+void Secant::print(ExpWriter& out) const {
+    out << "sec(x)";
 }
-dExp Secant::derivative() const {
+dExp Secant::derivativeNode() const {
     return make_unique<Multiply>(
-        make_shared<Secant>(),
-        make_shared<Tangent>()
+        makeNode<Secant>(),
+        makeNode<Tangent>()
     )->simplify();
 }
-dExp Secant::simplify() const {
+dExp Secant::simplifyNode() const {
     return make_unique<Secant>();
 }
 double Secant::evaluate(double x) const {
     return 1.0 / cos(x);
 }
+void Secant::evaluate(const double* xs, double* out, size_t n) const {
+    batchCos(xs, out, n);
+    for (size_t i = 0; i < n; ++i) out[i] = 1.0 / out[i];
+}
+Dual Secant::evaluateWithDerivative(double x) const {
+    double c = cos(x);
+    return Dual{1.0 / c, sin(x) / (c * c)};
+}
 
-string Cotangent::toString() const {
-    return "cot(x)";
+void Cotangent::print(ExpWriter& out) const {
+    out << "cot(x)";
 }
-dExp Cotangent::derivative() const {
+dExp Cotangent::derivativeNode() const {
     return make_unique<Multiply>(
-        make_shared<Constant>(-1),
-        make_unique<Divide>(
-            make_shared<Constant>(1),
-            make_unique<Multiply>(
-                make_shared<Sine>(),
-                make_shared<Sine>()
+        makeNode<Constant>(-1),
+        makeNode<Divide>(
+            makeNode<Constant>(1),
+            makeNode<Multiply>(
+                makeNode<Sine>(),
+                makeNode<Sine>()
             )
         )
     )->simplify();
 }
-dExp Cotangent::simplify() const {
+dExp Cotangent::simplifyNode() const {
     return make_unique<Cotangent>();
 }
 double Cotangent::evaluate(double x) const {
     return 1.0 / tan(x);
 }
+void Cotangent::evaluate(const double* xs, double* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) out[i] = 1.0 / tan(xs[i]);
+}
+Dual Cotangent::evaluateWithDerivative(double x) const {
+    double s = sin(x);
+    return Dual{1.0 / tan(x), -1.0 / (s * s)};
+}
 
-dExp Sine::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Sine::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<SineComposed>(replacement)->simplify();
 }
-dExp Cosine::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Cosine::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<CosineComposed>(replacement)->simplify();
 }
-dExp Tangent::substitute(const shared_ptr<Exp>& replacement) const {
-    return make_unique<Tangent>();
+dExp Tangent::substituteNode(const shared_ptr<Exp>& replacement) const {
+    return composeLeaf(*this, replacement);
 }
-dExp Cosecant::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Cosecant::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<Divide>(
-        make_shared<Constant>(1),
-        make_shared<SineComposed>(replacement)
+        makeNode<Constant>(1),
+        makeNode<SineComposed>(replacement)
     )->simplify();
 }
-dExp Secant::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Secant::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<Divide>(
-        make_shared<Constant>(1),
-        make_shared<CosineComposed>(replacement)
+        makeNode<Constant>(1),
+        makeNode<CosineComposed>(replacement)
     )->simplify();
 }
-dExp Cotangent::substitute(const shared_ptr<Exp>& replacement) const {
+dExp Cotangent::substituteNode(const shared_ptr<Exp>& replacement) const {
     return make_unique<Divide>(
-        make_shared<CosineComposed>(replacement),
-        make_shared<SineComposed>(replacement)
+        makeNode<CosineComposed>(replacement),
+        makeNode<SineComposed>(replacement)
     )->simplify();
 }
 
+dExp Sine::clone() const {
+    return make_unique<Sine>(*this);
+}
+dExp Cosine::clone() const {
+    return make_unique<Cosine>(*this);
+}
+dExp Tangent::clone() const {
+    return make_unique<Tangent>(*this);
+}
+dExp Cosecant::clone() const {
+    return make_unique<Cosecant>(*this);
+}
+dExp Secant::clone() const {
+    return make_unique<Secant>(*this);
+}
+dExp Cotangent::clone() const {
+    return make_unique<Cotangent>(*this);
+}
+
 #endif
\ No newline at end of file
@@ -5,56 +5,86 @@
 
 class Sine : public Exp { // (sin(x))' = cos(x)
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::Sine;
+        Sine() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class Cosine : public Exp { // (cos(x))' = -sin(x)
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::Cosine;
+        Cosine() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class Tangent : public Exp { // (tan(x))' = sec^2(x)
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::Tangent;
+        Tangent() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class Cosecant : public Exp { // (csc(x))' = -csc(x)*cot(x)
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::Cosecant;
+        Cosecant() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class Secant : public Exp { // (sec(x))' = sec(x)*tan(x)
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::Secant;
+        Secant() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 class Cotangent : public Exp { // (cot(x))' = -(csc(x))^2
     public:
-        string toString() const override;
-        dExp derivative() const override;
-        dExp simplify() const override;
+        static constexpr ExpKind Kind = ExpKind::Cotangent;
+        Cotangent() : Exp(Kind) {}
+        void print(ExpWriter& out) const override;
+        dExp derivativeNode() const override;
+        dExp simplifyNode() const override;
         double evaluate(double x) const override;
-        dExp substitute(const shared_ptr<Exp>& replacement) const override;
+        void evaluate(const double* xs, double* out, size_t n) const override;
+        Dual evaluateWithDerivative(double x) const override;
+        dExp substituteNode(const shared_ptr<Exp>& replacement) const override;
+        dExp clone() const override;
 };
 
 #endif